@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "Net.hpp"
+#include "Report.hpp"
+#include "Rng.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Connection churn benchmark: each session connects, reads the
+ * greeting, authenticates if asked, makes a few requests one by one
+ * and disconnects, the way a worker reconnecting for each request of
+ * its own does. Sessions are run from a number of threads at once.
+ */
+namespace Churn {
+
+/* The space the keys are selected from and the range of the keys. */
+constexpr uint32_t SPACE_ID = 512;
+constexpr uint32_t KEY_COUNT = 1000000;
+
+/* The moments of a session, counted from the start of the connect. */
+enum Moment {
+	CONNECTED,
+	GREETED,
+	AUTHENTICATED,
+	FIRST_RESPONSE,
+	CLOSED,
+	MOMENT_COUNT,
+};
+
+static constexpr const char *moment_names[] = {
+	"connect", "greeting", "auth", "first_response", "session",
+};
+
+struct Settings {
+	Net::Endpoint endpoint;
+	size_t thread_count;
+	size_t session_count;
+	/* Requests made by each session. */
+	size_t request_count;
+	/* Authenticate if the user is given. */
+	std::string user;
+	std::string password;
+};
+
+struct Result {
+	uint64_t duration_ns = 0;
+	size_t session_count = 0;
+	/* The time from the start of each session to each moment. */
+	std::vector<uint64_t> latencies_ns[MOMENT_COUNT];
+	/* The error responses to the requests. */
+	Tarantool::ErrorStats errors;
+	/* The failed connects per errno, the session is given up then. */
+	Tarantool::ErrorStats failures;
+
+	void
+	merge(const Result &other)
+	{
+		session_count += other.session_count;
+		for (size_t i = 0; i < MOMENT_COUNT; i++) {
+			latencies_ns[i].insert(latencies_ns[i].end(),
+					       other.latencies_ns[i].begin(),
+					       other.latencies_ns[i].end());
+		}
+		errors.merge(other.errors);
+		failures.merge(other.failures);
+	}
+};
+
+namespace {
+
+/* Run a session, @a result is left intact if the connect fails. */
+Error
+session(const Settings &settings, const Net::Address &address,
+	std::vector<uint8_t> &requests, std::vector<uint8_t> &buffer,
+	std::vector<Tarantool::Response> &responses, Result &result)
+{
+	uint64_t ns[MOMENT_COUNT] = {};
+	const uint64_t start_ns = Timer::now_ns();
+	const int fd = Net::try_connect(address);
+	if (fd < 0) {
+		result.failures.add(errno, strerror(errno));
+		return {};
+	}
+	{
+		Tarantool tt(fd);
+		ns[CONNECTED] = Timer::now_ns();
+		if (Error error = tt.read_greeting(); error)
+			return error;
+		ns[GREETED] = Timer::now_ns();
+		if (!settings.user.empty()) {
+			if (Error error = tt.authenticate(settings.user,
+							  settings.password); error)
+				return error;
+			ns[AUTHENTICATED] = Timer::now_ns();
+		}
+		for (size_t i = 0; i < settings.request_count; i++) {
+			requests.clear();
+			Tarantool::write_get_request(requests, SPACE_ID,
+						     Rng::u32() % KEY_COUNT,
+						     0);
+			if (Error error = tt.exchange(requests, 1, buffer,
+						      responses); error)
+				return error;
+			if (i == 0)
+				ns[FIRST_RESPONSE] = Timer::now_ns();
+			if (responses[0].is_error()) {
+				result.errors.add(responses[0].error_code(),
+						  responses[0].error_message());
+			}
+		}
+	}
+	ns[CLOSED] = Timer::now_ns();
+
+	for (size_t i = 0; i < MOMENT_COUNT; i++) {
+		if (ns[i] != 0)
+			result.latencies_ns[i].push_back(ns[i] - start_ns);
+	}
+	result.session_count++;
+	return {};
+}
+
+} // namespace
+
+/* Run the sessions from all the threads and merge the results. */
+Error
+run(const Settings &settings, Result &result)
+{
+	const Net::Address address = Net::resolve(settings.endpoint);
+	std::atomic<size_t> next_session = 0;
+	std::vector<Result> results(settings.thread_count);
+	std::vector<Error> errors(settings.thread_count);
+	std::vector<std::thread> threads;
+
+	const uint64_t start_ns = Timer::now_ns();
+	for (size_t i = 0; i < settings.thread_count; i++) {
+		threads.emplace_back([&, i] {
+			Rng::seed(i + 1);
+			std::vector<uint8_t> requests;
+			std::vector<uint8_t> buffer;
+			std::vector<Tarantool::Response> responses;
+			while (next_session++ < settings.session_count) {
+				errors[i] = session(settings, address, requests,
+						    buffer, responses, results[i]);
+				if (errors[i])
+					return;
+			}
+		});
+	}
+	for (auto &thread: threads)
+		thread.join();
+	result.duration_ns = Timer::now_ns() - start_ns;
+
+	for (size_t i = 0; i < settings.thread_count; i++) {
+		if (errors[i])
+			return std::move(errors[i]);
+		result.merge(results[i]);
+	}
+	return {};
+}
+
+/*
+ * Open and close the connections of the @a settings and report the
+ * latencies since the connect.
+ */
+Error
+benchmark(const Churn::Settings &settings, const char *results)
+{
+	Churn::Result result;
+	if (Error error = Churn::run(settings, result); error)
+		return error;
+
+	using namespace Statistics;
+	const double seconds = result.duration_ns / 1000000000.0;
+	printf("Threads: %lu\n", settings.thread_count);
+	printf("Requests per connection: %lu\n", settings.request_count);
+	printf("Authentication: %s\n",
+	       settings.user.empty() ? "none" : "chap-sha1");
+	printf("Connections: %lu\n", result.session_count);
+	printf("Connections per second: %.0f\n",
+	       result.session_count / seconds);
+	Report::print_errors(result.failures, "Failed connects", "Errno");
+	Report::print_errors(result.errors);
+	printf("%16s %10s %10s %10s %10s %10s\n", "Since connect", "Avg (μs)",
+	       "Med (μs)", "90% (μs)", "99% (μs)", "99.9% (μs)");
+	for (size_t i = 0; i < Churn::MOMENT_COUNT; i++) {
+		auto &latencies_ns = result.latencies_ns[i];
+		if (latencies_ns.empty())
+			continue;
+		std::sort(latencies_ns.begin(), latencies_ns.end());
+		printf("%16s %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+		       Churn::moment_names[i], average(latencies_ns) / 1000.0,
+		       median(latencies_ns) / 1000.0,
+		       percentile(latencies_ns, 0.9) / 1000.0,
+		       percentile(latencies_ns, 0.99) / 1000.0,
+		       percentile(latencies_ns, 0.999) / 1000.0);
+	}
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("threads");
+		json.value(uint64_t(settings.thread_count));
+		json.key("requests_per_connection");
+		json.value(uint64_t(settings.request_count));
+		json.key("auth");
+		json.value(!settings.user.empty());
+		json.key("summary");
+		json.begin_object();
+		{
+			json.key("connections");
+			json.value(uint64_t(result.session_count));
+			json.key("connections_per_second");
+			json.value(result.session_count / seconds);
+			json.key("failed_connects");
+			json.value(result.failures.count);
+			json.key("errors");
+			json.value(result.errors.count);
+			for (size_t i = 0; i < Churn::MOMENT_COUNT; i++) {
+				const auto &latencies_ns = result.latencies_ns[i];
+				if (latencies_ns.empty())
+					continue;
+				json.key(Churn::moment_names[i]);
+				json.begin_object();
+				Report::write_latencies(json, latencies_ns);
+				json.key("p90_us");
+				json.value(percentile(latencies_ns, 0.9) / 1000.0);
+				json.end_object();
+			}
+		}
+		json.end_object();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Churn
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ * Columnar MessagePack encoding of unsigned integers. A column of
+ * values is turned into the ready-to-store encodings at once (with
+ * AVX2 if the CPU has it), then the tuples are written row by row
+ * with a fixed-size store per value:
+ *
+ *   value <= 0x7f:       size 1, tag is the value itself
+ *   value <= 0xff:       size 2, tag 0xcc
+ *   value <= 0xffff:     size 3, tag 0xcd
+ *   value <= 0xffffffff: size 5, tag 0xce
+ *   otherwise:           size 9, tag 0xcf
+ *
+ * The stores write 9 bytes whatever the size is, so the output must
+ * have SLACK bytes after the last value. The excess bytes are then
+ * overwritten by the next value.
+ */
+namespace Columnar {
+
+static constexpr size_t SLACK = 8;
+
+class UintColumn {
+	/* The big-endian bytes of the value shifted to the start. */
+	std::vector<uint64_t> m_payloads;
+	/* The tag in the low byte, the encoded size in the high one. */
+	std::vector<uint16_t> m_metas;
+
+public:
+	/* Encode the @a count values, with AVX2 if @a vector is set. */
+	void
+	encode(const uint64_t *values, size_t count, bool vector)
+	{
+		m_payloads.resize(count);
+		m_metas.resize(count);
+		size_t i = 0;
+		if (vector)
+			i = encode_avx2(values, count);
+		for (; i < count; i++)
+			encode_scalar(values[i], m_payloads[i], m_metas[i]);
+	}
+
+	size_t
+	size(size_t i) const
+	{
+		return m_metas[i] >> 8;
+	}
+
+	char *
+	write(char *data, size_t i) const
+	{
+		data[0] = m_metas[i];
+		memcpy(data + 1, &m_payloads[i], sizeof(uint64_t));
+		return data + (m_metas[i] >> 8);
+	}
+
+	static void
+	encode_scalar(uint64_t value, uint64_t &payload, uint16_t &meta)
+	{
+		const unsigned m0 = value > 0x7f;
+		const unsigned m1 = value > 0xff;
+		const unsigned m2 = value > 0xffff;
+		const unsigned m3 = value > 0xffffffff;
+		const unsigned length = m0 + m1 + 2 * m2 + 4 * m3;
+		const unsigned tag = m0 ? 0xcc + m1 + m2 + m3 : value;
+		payload = __builtin_bswap64(value) >> ((64 - 8 * length) & 63);
+		meta = tag | (length + 1) << 8;
+	}
+
+private:
+	/* Returns the amount of values encoded, a multiple of 4. */
+	__attribute__((target("avx2"))) size_t
+	encode_avx2(const uint64_t *values, size_t count)
+	{
+		/* There's no unsigned 64-bit comparison, flip the signs. */
+		const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+		const __m256i max0 = _mm256_set1_epi64x(0x7f ^ INT64_MIN);
+		const __m256i max1 = _mm256_set1_epi64x(0xff ^ INT64_MIN);
+		const __m256i max2 = _mm256_set1_epi64x(0xffff ^ INT64_MIN);
+		const __m256i max3 = _mm256_set1_epi64x(0xffffffff ^ INT64_MIN);
+		const __m256i bswap = _mm256_setr_epi8(
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+		/* The two low bytes of each value to the low dword of the lane. */
+		const __m256i gather = _mm256_setr_epi8(
+			0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m256i lanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const __m256i v = _mm256_loadu_si256(
+				(const __m256i *)&values[i]);
+			const __m256i s = _mm256_xor_si256(v, sign);
+			/* The masks are -1 where the value is greater. */
+			const __m256i m0 = _mm256_cmpgt_epi64(s, max0);
+			const __m256i m1 = _mm256_cmpgt_epi64(s, max1);
+			const __m256i m2 = _mm256_cmpgt_epi64(s, max2);
+			const __m256i m3 = _mm256_cmpgt_epi64(s, max3);
+			const __m256i length = _mm256_sub_epi64(
+				_mm256_sub_epi64(_mm256_setzero_si256(),
+						 _mm256_add_epi64(m0, m1)),
+				_mm256_add_epi64(_mm256_slli_epi64(m2, 1),
+						 _mm256_slli_epi64(m3, 2)));
+			const __m256i shift = _mm256_and_si256(
+				_mm256_sub_epi64(_mm256_set1_epi64x(64),
+						 _mm256_slli_epi64(length, 3)),
+				_mm256_set1_epi64x(63));
+			const __m256i payload = _mm256_srlv_epi64(
+				_mm256_shuffle_epi8(v, bswap), shift);
+			_mm256_storeu_si256((__m256i *)&m_payloads[i], payload);
+
+			const __m256i tag = _mm256_blendv_epi8(v,
+				_mm256_add_epi64(_mm256_set1_epi64x(0xcc),
+					_mm256_sub_epi64(_mm256_setzero_si256(),
+						_mm256_add_epi64(m1,
+							_mm256_add_epi64(m2, m3)))),
+				m0);
+			const __m256i size = _mm256_add_epi64(length,
+							      _mm256_set1_epi64x(1));
+			const __m256i meta = _mm256_or_si256(
+				_mm256_and_si256(tag, _mm256_set1_epi64x(0xff)),
+				_mm256_slli_epi64(size, 8));
+			const __m256i packed = _mm256_permutevar8x32_epi32(
+				_mm256_shuffle_epi8(meta, gather), lanes);
+			_mm_storel_epi64((__m128i *)&m_metas[i],
+					 _mm256_castsi256_si128(packed));
+		}
+		return i;
+	}
+};
+
+/* Does the CPU support the vector encoding? */
+inline bool
+has_avx2()
+{
+	static const bool result = __builtin_cpu_supports("avx2");
+	return result;
+}
+
+} // namespace Columnar
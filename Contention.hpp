@@ -0,0 +1,334 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "Payload.hpp"
+#include "Report.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Hot-key contention benchmark: a number of connections run
+ * read-modify-write transactions (read a counter, write it back
+ * incremented) over a small set of keys, so that MVCC has to abort
+ * the conflicting ones. The aborted transactions are retried.
+ */
+namespace Contention {
+
+/* The space ID the counters are stored in. */
+constexpr uint32_t SPACE_ID = 512;
+
+/* Error code of a transaction aborted due to a conflict. */
+constexpr uint32_t ER_TRANSACTION_CONFLICT = 97;
+
+/* Results of a single contention level. */
+struct Result {
+	size_t hot_key_count = 0;
+	size_t commit_count = 0;
+	size_t abort_count = 0;
+	size_t retry_count = 0;
+	/* Transactions given up after all the attempts failed. */
+	size_t failure_count = 0;
+	uint64_t duration_ns = 0;
+	/* End-to-end transaction latencies including the retries. */
+	std::vector<uint64_t> latencies_ns;
+};
+
+/* A connection running transactions in its own stream. */
+struct Session {
+	Tarantool tt;
+	uint64_t stream_id;
+
+	/* Keys to run transactions over in the current level. */
+	std::vector<uint64_t> keys;
+
+	/* Per-level counters merged into the Result. */
+	Result result;
+	Error error;
+
+	/* Buffers reused by all the transactions. */
+	std::vector<uint8_t> requests;
+	std::vector<uint8_t> buffer;
+	std::vector<Tarantool::Response> responses;
+
+	Session(const Net::Endpoint &endpoint, uint64_t stream_id)
+	: tt(endpoint)
+	, stream_id(stream_id)
+	{}
+};
+
+namespace {
+
+bool
+is_conflict(const Tarantool::Response &response)
+{
+	return response.is_error() &&
+	       response.error_code() == ER_TRANSACTION_CONFLICT;
+}
+
+Error
+response_error(const Tarantool::Response &response)
+{
+	return Error_ResponseError(response.error_code(),
+				   response.error_message());
+}
+
+/* Get the counter (the second field) of the selected tuple. */
+Error
+decode_counter(const Tarantool::Response &response, uint64_t &counter)
+{
+	const char *data = response.data();
+	if (data == NULL)
+		return Error_ResponseBody();
+	counter = 0;
+	if (mp_decode_array(&data) == 0)
+		return {};
+	if (mp_typeof(*data) != MP_ARRAY || mp_decode_array(&data) < 2)
+		return Error_ResponseBody();
+	mp_next(&data);
+	if (mp_typeof(*data) != MP_UINT)
+		return Error_ResponseBody();
+	counter = mp_decode_uint(&data);
+	return {};
+}
+
+/* Roll back an aborted transaction, its result doesn't matter. */
+Error
+rollback(Session &s)
+{
+	s.requests.clear();
+	Tarantool::write_txn_request(s.requests, 0x10, "IPROTO_ROLLBACK",
+				     s.stream_id);
+	return s.tt.exchange(s.requests, 1, s.buffer, s.responses);
+}
+
+/*
+ * Attempt to run the read-modify-write transaction over the key.
+ * @a committed is set to false if the transaction was aborted due
+ * to a conflict with another one.
+ */
+Error
+attempt(Session &s, uint64_t key, bool &committed)
+{
+	committed = false;
+
+	/* Begin the transaction and read the counter. */
+	s.requests.clear();
+	Tarantool::write_txn_request(s.requests, 0x0E, "IPROTO_BEGIN",
+				     s.stream_id);
+	Tarantool::write_get_request(s.requests, SPACE_ID, key, s.stream_id);
+	if (Error error = s.tt.exchange(s.requests, 2, s.buffer,
+					s.responses); error)
+		return error;
+	if (s.responses[0].is_error())
+		return response_error(s.responses[0]);
+	if (is_conflict(s.responses[1]))
+		return rollback(s);
+	if (s.responses[1].is_error())
+		return response_error(s.responses[1]);
+
+	uint64_t counter = 0;
+	if (Error error = decode_counter(s.responses[1], counter); error)
+		return error;
+
+	/* Write the incremented counter back and commit. */
+	s.requests.clear();
+	Tarantool::write_put_request(s.requests, SPACE_ID, key, counter + 1,
+				     s.stream_id);
+	Tarantool::write_txn_request(s.requests, 0x0F, "IPROTO_COMMIT",
+				     s.stream_id);
+	if (Error error = s.tt.exchange(s.requests, 2, s.buffer,
+					s.responses); error)
+		return error;
+	if (is_conflict(s.responses[0]) || is_conflict(s.responses[1]))
+		return rollback(s);
+	if (s.responses[0].is_error())
+		return response_error(s.responses[0]);
+	if (s.responses[1].is_error())
+		return response_error(s.responses[1]);
+
+	committed = true;
+	return {};
+}
+
+void
+worker(Session &s, size_t max_attempts, std::atomic<bool> &start)
+{
+	while (!start.load(std::memory_order_acquire))
+		;
+
+	for (size_t i = 0; i < s.keys.size(); i++) {
+		Timer timer;
+		bool committed = false;
+		size_t attempts = 0;
+		while (!committed && attempts < max_attempts) {
+			if (attempts != 0)
+				s.result.retry_count++;
+			attempts++;
+			if (Error error = attempt(s, s.keys[i], committed); error) {
+				s.error = Error_Transaction(error, i);
+				return;
+			}
+			if (!committed)
+				s.result.abort_count++;
+		}
+		if (committed) {
+			s.result.commit_count++;
+			s.result.latencies_ns.push_back(timer.ns());
+		} else {
+			s.result.failure_count++;
+		}
+	}
+}
+
+} // namespace
+
+/* Write the zero counters of all the hot keys. */
+Error
+prepare(Session &s, size_t hot_key_count)
+{
+	/* Keep the pipelined batches reasonably small. */
+	const size_t batch_size = 1000;
+	for (size_t key = 0; key < hot_key_count; key += batch_size) {
+		const size_t count = std::min(batch_size, hot_key_count - key);
+		s.requests.clear();
+		for (size_t i = 0; i < count; i++)
+			Tarantool::write_put_request(s.requests, SPACE_ID,
+						     key + i, 0, 0);
+		if (Error error = s.tt.exchange(s.requests, count, s.buffer,
+						s.responses); error)
+			return Error_HotSetPrepare(error, hot_key_count);
+		for (const auto &response: s.responses) {
+			if (!response.is_error())
+				continue;
+			Error error = response_error(response);
+			return Error_HotSetPrepare(error, hot_key_count);
+		}
+	}
+	return {};
+}
+
+/*
+ * Run @a transaction_count transactions spread over all the
+ * sessions with keys uniformly distributed over the hot set.
+ */
+Error
+run(std::vector<std::unique_ptr<Session>> &sessions,
+    size_t hot_key_count, size_t transaction_count, size_t max_attempts,
+    Result &result)
+{
+	result = {};
+	result.hot_key_count = hot_key_count;
+
+	if (Error error = prepare(*sessions[0], hot_key_count); error)
+		return error;
+
+	/* Draw the keys from the hot set. */
+	Payload payload(transaction_count);
+	payload.parts.clear();
+	payload.parts.emplace_back(Payload::Part::Type::UINT64,
+				   Payload::Part::Value(uint64_t(0)),
+				   Payload::Part::Value(uint64_t(hot_key_count)),
+				   Payload::Part::Distribution::UNIFORM,
+				   transaction_count);
+	std::vector<Payload::Part::Value> values;
+	for (size_t i = 0; i < sessions.size(); i++) {
+		Session &s = *sessions[i];
+		s.keys.clear();
+		s.result = {};
+		const size_t count = transaction_count / sessions.size() +
+				     (i < transaction_count % sessions.size());
+		for (size_t j = 0; j < count; j++) {
+			values.clear();
+			payload.next(values);
+			s.keys.push_back(values[0].value.uint64);
+		}
+	}
+
+	/* Start the workers all at once. */
+	std::atomic<bool> start(false);
+	std::vector<std::thread> threads;
+	for (auto &s: sessions)
+		threads.emplace_back(worker, std::ref(*s), max_attempts,
+				     std::ref(start));
+	Timer timer;
+	start.store(true, std::memory_order_release);
+	for (auto &thread: threads)
+		thread.join();
+	result.duration_ns = timer.ns();
+
+	/* Merge the results. */
+	for (auto &s: sessions) {
+		if (s->error)
+			return std::move(s->error);
+		result.commit_count += s->result.commit_count;
+		result.abort_count += s->result.abort_count;
+		result.retry_count += s->result.retry_count;
+		result.failure_count += s->result.failure_count;
+		result.latencies_ns.insert(result.latencies_ns.end(),
+					   s->result.latencies_ns.begin(),
+					   s->result.latencies_ns.end());
+	}
+	std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+	return {};
+}
+
+/*
+ * Run the contention levels of @a hot_key_counts in turn over the
+ * @a connection_count sessions and print a row per level.
+ */
+Error
+benchmark(const Net::Endpoint &endpoint, size_t connection_count,
+	  const std::vector<size_t> &hot_key_counts, size_t transaction_count,
+	  size_t max_attempts)
+{
+	/* Connect to Tarantool, each connection has its own stream. */
+	std::vector<std::unique_ptr<Contention::Session>> sessions;
+	for (size_t i = 0; i < connection_count; i++) {
+		sessions.push_back(std::make_unique<Contention::Session>(
+			endpoint, i + 1));
+	}
+
+	printf("Connections: %lu\n", connection_count);
+	printf("Transactions: %lu\n", transaction_count);
+	printf("%10s %10s %10s %10s %10s %10s %8s %10s %10s %10s %10s\n",
+	       "Hot keys", "TPS", "Commits", "Aborts", "Retries",
+	       "Failures", "Abort%", "Avg (μs)", "Med (μs)", "99% (μs)",
+	       "99.9% (μs)");
+
+	/* Run the levels in the given order, e.g. rising contention. */
+	for (size_t hot_key_count: hot_key_counts) {
+		Contention::Result result;
+		if (Error error = Contention::run(sessions, hot_key_count,
+						  transaction_count,
+						  max_attempts, result); error)
+			return error;
+
+		using namespace Statistics;
+		const auto &latencies_ns = result.latencies_ns;
+		const size_t attempt_count = result.commit_count +
+					     result.abort_count;
+		const double tps = (double)result.commit_count /
+				   (result.duration_ns / 1000000000.0);
+		const double abort_rate = attempt_count == 0 ? 0.0 :
+			100.0 * result.abort_count / attempt_count;
+		const bool empty = latencies_ns.empty();
+		const double avg_us = empty ? 0 : average(latencies_ns) / 1000.0;
+		const double med_us = empty ? 0 : median(latencies_ns) / 1000.0;
+		const double p99_us = empty ? 0 :
+			percentile(latencies_ns, 0.99) / 1000.0;
+		const double p999_us = empty ? 0 :
+			percentile(latencies_ns, 0.999) / 1000.0;
+
+		printf("%10lu %10.0f %10lu %10lu %10lu %10lu %8.2f %10.3f "
+		       "%10.3f %10.3f %10.3f\n", hot_key_count, tps,
+		       result.commit_count, result.abort_count,
+		       result.retry_count, result.failure_count, abort_rate,
+		       avg_us, med_us, p99_us, p999_us);
+	}
+	return {};
+}
+
+} // namespace Contention
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 namespace Data {
 
 uint64_t
@@ -7,7 +9,7 @@ get_unsigned_be(const uint8_t *buf, int bytes)
 {
 	uint64_t result = 0;
 	for (int i = 0; i < bytes; i++)
-		result |= buf[i] >> ((bytes - 1 - i) * 8);
+		result |= uint64_t(buf[i]) << ((bytes - 1 - i) * 8);
 	return result;
 }
 
@@ -49,4 +51,64 @@ set_uint32_le(uint8_t *buf, uint32_t value)
 	set_unsigned_le(buf, value, sizeof(value));
 }
 
+/*
+ * Decode the base64 @a text of @a size characters into at most
+ * @a capacity bytes. Stops at the padding or at a non-base64 character.
+ * Returns the amount of bytes decoded.
+ */
+size_t
+decode_base64(const char *text, size_t size, uint8_t *out, size_t capacity)
+{
+	size_t count = 0;
+	uint32_t bits = 0;
+	int bit_count = 0;
+	for (size_t i = 0; i < size && count < capacity; i++) {
+		const char c = text[i];
+		int value;
+		if (c >= 'A' && c <= 'Z')
+			value = c - 'A';
+		else if (c >= 'a' && c <= 'z')
+			value = c - 'a' + 26;
+		else if (c >= '0' && c <= '9')
+			value = c - '0' + 52;
+		else if (c == '+')
+			value = 62;
+		else if (c == '/')
+			value = 63;
+		else
+			break;
+		bits = bits << 6 | value;
+		bit_count += 6;
+		if (bit_count >= 8) {
+			bit_count -= 8;
+			out[count++] = bits >> bit_count;
+		}
+	}
+	return count;
+}
+
+/*
+ * Update the CRC32C (Castagnoli) @a crc with @a size bytes of @a data.
+ * Start from 0xFFFFFFFF. The final inversion is left to the caller, the
+ * digest.crc32() of Tarantool skips it.
+ */
+uint32_t
+update_crc32c(uint32_t crc, const void *data, size_t size)
+{
+	static const auto table = [] {
+		std::array<uint32_t, 256> result;
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; bit++)
+				value = (value >> 1) ^ (0x82F63B78 & -(value & 1));
+			result[i] = value;
+		}
+		return result;
+	}();
+	const uint8_t *bytes = (const uint8_t *)data;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
 } // namespace Data
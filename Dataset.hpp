@@ -0,0 +1,564 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "msgpuck/msgpuck.h"
+#include "MsgPack.hpp"
+#include "Payload.hpp"
+
+/*
+ * A dataset the tuples are taken from: a CSV file or a MessagePack
+ * file with a tuple (an array) per record. The file is mapped into
+ * memory, only the offsets of the records are kept, and the cells of
+ * a record are converted into the fields of the payload parts mapped
+ * to its columns as the requests are generated.
+ */
+class Dataset {
+public:
+	enum Format {
+		CSV,
+		MSGPACK,
+	};
+
+	/* A cell of a record: CSV text or a MessagePack value. */
+	struct Cell {
+		const char *data;
+		size_t size;
+	};
+
+	Dataset() = default;
+	Dataset(const Dataset &other) = delete;
+
+	~Dataset()
+	{
+		if (m_data != NULL)
+			munmap((void *)m_data, m_size);
+	}
+
+	/* Map the file and index its records. */
+	Error
+	open(const char *path)
+	{
+		m_path = path;
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return Error_System("Can't open the dataset");
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return Error_System("Can't open the dataset");
+		}
+		m_size = st.st_size;
+		if (m_size == 0) {
+			::close(fd);
+			return Error_Dataset(path, "the file is empty");
+		}
+		void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return Error_System("Can't map the dataset");
+		m_data = (const char *)data;
+
+		/* A text file can't start with a MessagePack array. */
+		const uint8_t first = m_data[0];
+		m_format = (first >= 0x90 && first <= 0x9f) ||
+			   first == 0xdc || first == 0xdd ? MSGPACK : CSV;
+		const size_t length = strlen(path);
+		m_delimiter = length > 4 &&
+			      strcmp(path + length - 4, ".tsv") == 0 ? '\t' : ',';
+		if (m_format == MSGPACK)
+			return index_msgpack();
+		index_csv();
+		return {};
+	}
+
+	/*
+	 * Resolve the columns of the @a payload parts and check all the
+	 * mapped cells of all the records convert into the part types.
+	 * The columns can be referenced by name only in CSV files with
+	 * a header line.
+	 */
+	Error
+	bind(Payload &payload)
+	{
+		using Type = Payload::Part::Type;
+		bool by_name = false;
+		for (const auto &part: payload.parts)
+			by_name = by_name || !part.column_name.empty();
+		if (by_name && m_format != CSV)
+			return Error_Dataset(m_path.c_str(),
+					     "columns can only be named in CSV files");
+		m_first_record = by_name ? 1 : 0;
+		if (m_records.size() <= m_first_record)
+			return Error_Dataset(m_path.c_str(), "no records");
+
+		/* The header is split whole. */
+		std::vector<Cell> header;
+		std::string scratch;
+		if (by_name) {
+			m_cell_count = SIZE_MAX;
+			split_at(m_records[0], header, scratch);
+		}
+		m_cell_count = 0;
+		for (auto &part: payload.parts) {
+			if (!part.column_name.empty()) {
+				part.column = Payload::Part::NO_COLUMN;
+				for (size_t i = 0; i < header.size(); i++) {
+					if (std::string_view(header[i].data,
+							     header[i].size) ==
+					    part.column_name)
+						part.column = i;
+				}
+				if (part.column == Payload::Part::NO_COLUMN)
+					return Error_DatasetColumn(m_path.c_str(),
+								   part.column_name.c_str());
+			}
+			if (part.column == Payload::Part::NO_COLUMN)
+				continue;
+			if (m_format == CSV &&
+			    (part.type == Type::ARRAY || part.type == Type::MAP))
+				return Error_Dataset(m_path.c_str(),
+						     "CSV cells can't be arrays or maps");
+			m_cell_count = std::max(m_cell_count, part.column + 1);
+		}
+		if (m_cell_count == 0)
+			return Error_Dataset(m_path.c_str(),
+					     "no payload parts are mapped to its columns");
+		return check(payload);
+	}
+
+	size_t
+	record_count() const
+	{
+		return m_records.size() - m_first_record;
+	}
+
+	/*
+	 * Split the record @a i into the cells up to the last mapped
+	 * column. The quoted CSV cells with escaped quotes are copied to
+	 * @a scratch unescaped.
+	 */
+	void
+	split(size_t i, std::vector<Cell> &cells, std::string &scratch) const
+	{
+		split_at(m_records[m_first_record + i], cells, scratch);
+	}
+
+	/* The size of a field the @a cell is converted into is below it. */
+	static size_t
+	max_sizeof_field(const Cell &cell)
+	{
+		/* The largest header, the extensions and the numbers fit. */
+		return cell.size + 32;
+	}
+
+	/*
+	 * Encode the @a cell as the field of the @a part type. Returns
+	 * NULL if the cell can't be converted into the type.
+	 */
+	char *
+	encode_field(char *data, const Payload::Part &part, const Cell &cell) const
+	{
+		if (m_format == CSV)
+			return encode_text(data, part.type, {cell.data, cell.size});
+		return encode_value(data, part.type, cell);
+	}
+
+private:
+	/*
+	 * Collect the starts of the non-empty lines. The file is split
+	 * into a chunk per thread, a line belongs to the chunk it starts
+	 * in.
+	 */
+	void
+	index_csv()
+	{
+		const size_t thread_count = std::max(1U,
+			std::min(std::thread::hardware_concurrency(),
+				 unsigned(m_size / MIN_CHUNK_SIZE + 1)));
+		std::vector<std::vector<uint64_t>> chunks(thread_count);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < thread_count; t++) {
+			threads.emplace_back([this, &chunks, t, thread_count] {
+				const char *const end = m_data + m_size;
+				const char *p = m_data + m_size * t / thread_count;
+				const char *const chunk_end =
+					m_data + m_size * (t + 1) / thread_count;
+				if (p != m_data && p[-1] != '\n')
+					p = next_line(p, end);
+				while (p < chunk_end) {
+					if (*p != '\n' && *p != '\r')
+						chunks[t].push_back(p - m_data);
+					p = next_line(p, end);
+				}
+			});
+		}
+		for (auto &thread: threads)
+			thread.join();
+		for (const auto &chunk: chunks)
+			m_records.insert(m_records.end(), chunk.begin(), chunk.end());
+	}
+
+	/* The records are checked while indexed, they may be of any size. */
+	Error
+	index_msgpack()
+	{
+		const char *p = m_data;
+		const char *const end = m_data + m_size;
+		while (p < end) {
+			m_records.push_back(p - m_data);
+			if (mp_typeof(*p) != MP_ARRAY || mp_check(&p, end) != 0)
+				return Error_Dataset(m_path.c_str(),
+						     "a record is not a MessagePack array");
+		}
+		return {};
+	}
+
+	static const char *
+	next_line(const char *p, const char *end)
+	{
+		const char *newline = (const char *)memchr(p, '\n', end - p);
+		return newline != NULL ? newline + 1 : end;
+	}
+
+	void
+	split_at(uint64_t offset, std::vector<Cell> &cells,
+		 std::string &scratch) const
+	{
+		const char *p = m_data + offset;
+		cells.clear();
+		if (m_format == MSGPACK) {
+			const uint32_t count = mp_decode_array(&p);
+			for (uint32_t i = 0; i < count && cells.size() < m_cell_count;
+			     i++) {
+				const char *value = p;
+				mp_next(&p);
+				cells.push_back({value, size_t(p - value)});
+			}
+			return;
+		}
+		const char *end = (const char *)memchr(p, '\n',
+						       m_data + m_size - p);
+		if (end == NULL)
+			end = m_data + m_size;
+		if (end > p && end[-1] == '\r')
+			end--;
+		/* The unescaped cells are never longer than the line. */
+		scratch.clear();
+		scratch.reserve(end - p);
+		while (cells.size() < m_cell_count) {
+			if (p < end && *p == '"') {
+				cells.push_back(unquote(p, end, scratch));
+			} else {
+				const char *cell_end = (const char *)
+					memchr(p, m_delimiter, end - p);
+				if (cell_end == NULL)
+					cell_end = end;
+				cells.push_back({p, size_t(cell_end - p)});
+				p = cell_end;
+			}
+			if (p >= end)
+				break;
+			p++;
+		}
+	}
+
+	/*
+	 * Take the quoted cell at @a p and step to the delimiter after
+	 * it. The doubled quotes are unescaped into @a scratch.
+	 */
+	Cell
+	unquote(const char *&p, const char *end, std::string &scratch) const
+	{
+		const char *begin = ++p;
+		bool escaped = false;
+		while (p < end) {
+			p = (const char *)memchr(p, '"', end - p);
+			if (p == NULL) {
+				p = end;
+				break;
+			}
+			if (p + 1 < end && p[1] == '"') {
+				escaped = true;
+				p += 2;
+				continue;
+			}
+			break;
+		}
+		Cell cell = {begin, size_t(p - begin)};
+		if (escaped) {
+			const size_t offset = scratch.size();
+			for (const char *c = begin; c < p; c++) {
+				scratch.push_back(*c);
+				if (*c == '"')
+					c++;
+			}
+			cell = {scratch.data() + offset, scratch.size() - offset};
+		}
+		p = (const char *)memchr(p, m_delimiter, end - p);
+		if (p == NULL)
+			p = end;
+		return cell;
+	}
+
+	/* Convert all the mapped cells in parallel, report the first failure. */
+	Error
+	check(const Payload &payload)
+	{
+		const size_t count = record_count();
+		const size_t thread_count = std::max(1U,
+			std::min(std::thread::hardware_concurrency(),
+				 unsigned(count / MIN_CHUNK_RECORDS + 1)));
+		/* The first record and column failed to convert per thread. */
+		std::vector<std::pair<size_t, size_t>> failures(
+			thread_count, {SIZE_MAX, 0});
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < thread_count; t++) {
+			threads.emplace_back([&, t] {
+				std::vector<Cell> cells;
+				std::string scratch;
+				std::vector<char> field;
+				for (size_t i = count * t / thread_count;
+				     i < count * (t + 1) / thread_count; i++) {
+					split(i, cells, scratch);
+					for (const auto &part: payload.parts) {
+						if (part.column == Payload::Part::NO_COLUMN)
+							continue;
+						if (part.column >= cells.size()) {
+							failures[t] = {i, part.column};
+							return;
+						}
+						const Cell &cell = cells[part.column];
+						field.resize(max_sizeof_field(cell));
+						if (encode_field(field.data(), part,
+								 cell) == NULL) {
+							failures[t] = {i, part.column};
+							return;
+						}
+					}
+				}
+			});
+		}
+		for (auto &thread: threads)
+			thread.join();
+		for (const auto &failure: failures) {
+			if (failure.first != SIZE_MAX)
+				return Error_DatasetCell(m_path.c_str(),
+							 failure.first,
+							 failure.second);
+		}
+		return {};
+	}
+
+	/* Parse the whole text as a number. */
+	template <class T>
+	static bool
+	parse(std::string_view text, T &value)
+	{
+		const char *end = text.data() + text.size();
+		const auto result = std::from_chars(text.data(), end, value);
+		return result.ec == std::errc() && result.ptr == end;
+	}
+
+	/* Empty cells are nils unless they're strings or binaries. */
+	static char *
+	encode_text(char *data, Payload::Part::Type type, std::string_view text)
+	{
+		using Type = Payload::Part::Type;
+		if (text.empty() && type != Type::STRING && type != Type::BINARY)
+			return mp_encode_nil(data);
+		switch (type) {
+		case Type::UINT64:
+			if (uint64_t value; parse(text, value))
+				return mp_encode_uint(data, value);
+			if (int64_t value; parse(text, value))
+				return mp_encode_int(data, value);
+			return NULL;
+		case Type::STRING:
+			return mp_encode_str(data, text.data(), text.size());
+		case Type::BINARY:
+			return mp_encode_bin(data, text.data(), text.size());
+		case Type::DOUBLE:
+			if (double value; parse(text, value))
+				return mp_encode_double(data, value);
+			return NULL;
+		case Type::UUID:
+			return encode_uuid(data, text);
+		case Type::DECIMAL:
+			return encode_decimal(data, text);
+		case Type::DATETIME:
+			if (int64_t seconds; parse(text, seconds))
+				return MsgPack::encode_datetime(data, seconds);
+			return NULL;
+		case Type::BOOLEAN:
+			if (text == "true" || text == "1")
+				return mp_encode_bool(data, true);
+			if (text == "false" || text == "0")
+				return mp_encode_bool(data, false);
+			return NULL;
+		case Type::NIL:
+			return mp_encode_nil(data);
+		case Type::ARRAY:
+		case Type::MAP:
+			return NULL;
+		}
+		std::unreachable();
+	}
+
+	/*
+	 * The values of the part type are copied as is, the strings are
+	 * converted as CSV text, the integers are taken as numbers.
+	 */
+	static char *
+	encode_value(char *data, Payload::Part::Type type, const Cell &cell)
+	{
+		using Type = Payload::Part::Type;
+		const char *value = cell.data;
+		bool same = false;
+		switch (mp_typeof(*value)) {
+		case MP_NIL:
+			same = true;
+			break;
+		case MP_UINT:
+		case MP_INT:
+			same = type == Type::UINT64;
+			break;
+		case MP_STR:
+			same = type == Type::STRING;
+			break;
+		case MP_BIN:
+			same = type == Type::BINARY;
+			break;
+		case MP_FLOAT:
+		case MP_DOUBLE:
+			same = type == Type::DOUBLE;
+			break;
+		case MP_BOOL:
+			same = type == Type::BOOLEAN;
+			break;
+		case MP_ARRAY:
+			same = type == Type::ARRAY;
+			break;
+		case MP_MAP:
+			same = type == Type::MAP;
+			break;
+		case MP_EXT: {
+			int8_t ext;
+			const char *p = value;
+			mp_decode_extl(&p, &ext);
+			same = (ext == MsgPack::EXT_UUID && type == Type::UUID) ||
+			       (ext == MsgPack::EXT_DECIMAL &&
+				type == Type::DECIMAL) ||
+			       (ext == MsgPack::EXT_DATETIME &&
+				type == Type::DATETIME);
+			break;
+		}
+		}
+		if (type == Type::NIL)
+			return mp_encode_nil(data);
+		if (same) {
+			memcpy(data, value, cell.size);
+			return data + cell.size;
+		}
+		if (mp_typeof(*value) == MP_STR) {
+			uint32_t length;
+			const char *text = mp_decode_str(&value, &length);
+			return encode_text(data, type, {text, length});
+		}
+		if (mp_typeof(*value) == MP_UINT || mp_typeof(*value) == MP_INT) {
+			/* Print the integer and convert it as text. */
+			char text[24];
+			std::to_chars_result result;
+			if (mp_typeof(*value) == MP_UINT) {
+				result = std::to_chars(text, text + sizeof(text),
+						       mp_decode_uint(&value));
+			} else {
+				result = std::to_chars(text, text + sizeof(text),
+						       mp_decode_int(&value));
+			}
+			return encode_text(data, type,
+					   {text, size_t(result.ptr - text)});
+		}
+		return NULL;
+	}
+
+	/* The canonical text form: 8-4-4-4-12 hexadecimal digits. */
+	static char *
+	encode_uuid(char *data, std::string_view text)
+	{
+		if (text.size() != 36)
+			return NULL;
+		uint8_t uuid[16];
+		size_t digit = 0;
+		for (size_t i = 0; i < text.size(); i++) {
+			if (i == 8 || i == 13 || i == 18 || i == 23) {
+				if (text[i] != '-')
+					return NULL;
+				continue;
+			}
+			uint8_t nibble;
+			const auto result = std::from_chars(&text[i], &text[i] + 1,
+							    nibble, 16);
+			if (result.ec != std::errc())
+				return NULL;
+			if (digit % 2 == 0)
+				uuid[digit / 2] = nibble << 4;
+			else
+				uuid[digit / 2] |= nibble;
+			digit++;
+		}
+		return MsgPack::encode_uuid(data, uuid);
+	}
+
+	/* A decimal of up to 19 digits, the scale is taken from the text. */
+	static char *
+	encode_decimal(char *data, std::string_view text)
+	{
+		const bool negative = text.starts_with('-');
+		if (negative)
+			text.remove_prefix(1);
+		const size_t point = text.find('.');
+		std::string_view integral = text.substr(0, point);
+		std::string_view fraction = point == std::string_view::npos ?
+			std::string_view() : text.substr(point + 1);
+		if (integral.empty() && fraction.empty())
+			return NULL;
+		if (integral.size() + fraction.size() > 19)
+			return NULL;
+		uint64_t value = 0;
+		for (std::string_view part: {integral, fraction}) {
+			for (char c: part) {
+				if (c < '0' || c > '9')
+					return NULL;
+				value = value * 10 + (c - '0');
+			}
+		}
+		return MsgPack::encode_decimal(data, value, fraction.size(),
+					       negative);
+	}
+
+private:
+	/* Less than this isn't worth a thread. */
+	static constexpr size_t MIN_CHUNK_SIZE = 1024 * 1024;
+	static constexpr size_t MIN_CHUNK_RECORDS = 64 * 1024;
+
+	std::string m_path;
+	const char *m_data = NULL;
+	size_t m_size = 0;
+	enum Format m_format = CSV;
+	char m_delimiter = ',';
+	/* Offsets of the records, the first one is the header if named. */
+	std::vector<uint64_t> m_records;
+	size_t m_first_record = 0;
+	/* The records are split up to the last mapped column. */
+	size_t m_cell_count = 0;
+};
@@ -7,9 +7,11 @@
 
 #define Error_Argparse() Error_0("Error parsing the command line")
 
+#define Error_NoRequests() Error_0("No requests to send")
+
 #define Error_Usage(argv0)						\
 	Error_0("Usage: `%s <request> [-b <request_count_per_transfer>"	\
-		"] [-p <port>][-c <request_count>]'", argv0)
+		"] [-p <port>] [-u <socket_path>] [-c <request_count>]'", argv0)
 
 #define Error_BatchSize(request_count, request_count_per_transfer)	\
 	Error_0("Request count must be divisible by the batch size. "	\
@@ -23,6 +25,9 @@
 #define Error_BenchmarkFailed(benchmark_error)				\
 	Error_1(benchmark_error, "Failed to benchmark Tarantool")
 
+#define Error_SamplerFailed(sampler_error)				\
+	Error_1(sampler_error, "Failed to sample the server metrics")
+
 #define Error_BatchBuild(build_error, i)				\
 	Error_1(build_error, "Couldn't prepare transfer #%lu", i)
 
@@ -35,12 +40,120 @@
 #define Error_ResponseSize()						\
 	Error_0("Expected 4-byte MsgPack as the response size")
 
+#define Error_ConnectionClosed()					\
+	Error_0("The server closed the connection")
+
 #define Error_System(message)				\
 	Error_0("%s: ", message, strerror(errno))
 
+#define Error_CpuList(list)					\
+	Error_0("Invalid CPU list: '%s'", list)
+
 #define Error_UnknownRequest(name)	\
 	Error_0("Unknown request name: '%s'", name)
 
+#define Error_WorkloadFile(path)					\
+	Error_0("Invalid workload file: '%s'", path)
+
+#define Error_WorkloadRecord(record_error)				\
+	Error_1(record_error, "Couldn't record the workload")
+
+#define Error_Xlog(path, reason)					\
+	Error_0("Invalid xlog file '%s': %s", path, reason)
+
+#define Error_XlogRow(reason)						\
+	Error_0("Can't read the xlog row: %s", reason)
+
+#define Error_Dataset(path, reason)					\
+	Error_0("Invalid dataset '%s': %s", path, reason)
+
+#define Error_DatasetColumn(path, name)					\
+	Error_0("No column '%s' in the header of the dataset '%s'",	\
+		name, path)
+
+#define Error_DatasetCell(path, record, column)				\
+	Error_0("Can't convert column %lu of record #%lu of the "	\
+		"dataset '%s' into the field type", column, record, path)
+
+#define Error_NoDataset()						\
+	Error_0("The payload maps dataset columns, but no dataset is given")
+
+#define Error_SizeList(list)						\
+	Error_0("Invalid list of sizes: '%s'", list)
+
+#define Error_SweepParameter(spec)					\
+	Error_0("Invalid sweep parameter: '%s'", spec)
+
+#define Error_SweepRequest(request_name)				\
+	Error_0("The sweep re-sends the requests at each point, so "	\
+		"'%s' can't be used: it isn't idempotent", request_name)
+
+#define Error_SloTarget(spec)						\
+	Error_0("Invalid SLO: '%s', expected <percentile>:<latency_us>"	\
+		"[:<run_count>[:<error_budget>]]", spec)
+
+#define Error_SloRequest(request_name)					\
+	Error_0("The SLO search re-sends the same requests, so '%s' "	\
+		"can't be used: it isn't idempotent", request_name)
+
+#define Error_UserScript(script)					\
+	Error_0("Invalid user script: '%s', expected a comma-separated "	\
+		"list of ping, get, put and update", script)
+
+#define Error_ThinkTime(spec)						\
+	Error_0("Invalid think time: '%s', expected "			\
+		"<constant|uniform|exponential>:<mean_us>", spec)
+
+#define Error_Endpoint(spec)						\
+	Error_0("Invalid endpoint: '%s', expected <port>, <host>:<port> "	\
+		"or a unix socket path", spec)
+
+#define Error_Port(spec)						\
+	Error_0("Invalid port: '%s', expected 1-65535", spec)
+
+#define Error_ShardKey(request_name)					\
+	Error_0("Couldn't find the bucket of a '%s' request, the first "	\
+		"key part must be a number, a string or a boolean",	\
+		request_name)
+
+#define Error_Server(script, reason, log)				\
+	Error_0("The instance running %s %s, see %s", script, reason, log)
+
+#define Error_ReplicaTimeout(key)					\
+	Error_0("The replica didn't show the key %lu in time", key)
+
+#define Error_VinylKey()						\
+	Error_0("The vinyl benchmark needs the first field of the "	\
+		"tuples to be unsigned to read them by")
+
+#define Error_VinylEngine(engine)					\
+	Error_0("The vinyl benchmark needs space s to be a vinyl one, "	\
+		"not %.*s", (int)(engine).size(), (engine).data())
+
+#define Error_GrowthKey()						\
+	Error_0("The growth benchmark needs the first part of the "	\
+		"payload to be unsigned and not uniform to read the "	\
+		"tuples by")
+
+#define Error_Greeting(reason)						\
+	Error_0("Unexpected greeting: %s", reason)
+
+#define Error_NoOpenssl()						\
+	Error_0("Authentication requires ttbench built with OpenSSL")
+
+#define Error_ResponseError(code, message)				\
+	Error_0("Tarantool returned error %u: %.*s", code,		\
+		(int)(message).size(), (message).data())
+
+#define Error_ResponseBody()						\
+	Error_0("Malformed response body")
+
+#define Error_Transaction(transaction_error, i)				\
+	Error_1(transaction_error, "Couldn't run transaction #%lu", i)
+
+#define Error_HotSetPrepare(prepare_error, count)			\
+	Error_1(prepare_error, "Couldn't prepare %lu hot keys", count)
+
 namespace {
 
 std::unique_ptr<char[]>
@@ -91,13 +204,7 @@ public:
 	, m_message(std::move(message))
 	{}
 
-	/*
-	Error &operator=(Error &&other)
-	{
-		
-		return *this;
-	}
-	*/
+	Error &operator=(Error &&other) = default;
 
 	void
 	report(int level = 0)
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "Report.hpp"
+#include "Rng.hpp"
+#include "Server.hpp"
+#include "Sweep.hpp"
+#include "Tarantool.hpp"
+
+/*
+ * Performance against the dataset size: the space is filled with the
+ * tuples of the payload in chunks, and at each of the sizes the filling
+ * pauses for a fixed mix of the reads of the tuples inserted so far and
+ * of the inserts of the next ones. The keys read are told by the
+ * position they were drawn at, so nothing is kept per tuple and the
+ * memory taken doesn't depend on the size.
+ */
+namespace Growth {
+
+/* The requests generated at once while filling the space. */
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+/* The measurements at a dataset size. */
+struct Milestone {
+	/* The tuples inserted prior to the mix. */
+	uint64_t tuple_count = 0;
+	/* Filling the space up from the previous size. */
+	double fill_rps = 0;
+	uint64_t fill_error_count = 0;
+	Sweep::Result reads;
+	Sweep::Result writes;
+};
+
+/*
+ * Can the keys of the tuples be told by the position? The first part of
+ * the payload has to be unsigned and drawn in a reproducible order.
+ */
+inline Error
+check_payload(const Payload &payload)
+{
+	if (payload.parts.empty())
+		return Error_GrowthKey();
+	const auto &part = payload.parts[0];
+	if (part.type != Payload::Part::Type::UINT64 ||
+	    part.column != Payload::Part::NO_COLUMN ||
+	    part.distribution == Payload::Part::Distribution::UNIFORM)
+		return Error_GrowthKey();
+	return {};
+}
+
+class Stream {
+public:
+	Stream(const Net::Endpoint &endpoint, Payload &payload,
+	       size_t connection_count, size_t response_buffer_size)
+	: m_payload(payload)
+	, m_runner(endpoint, connection_count, response_buffer_size)
+	, m_inserted(0)
+	{}
+
+	/* The tuples inserted so far. */
+	uint64_t
+	inserted() const
+	{
+		return m_inserted;
+	}
+
+	/*
+	 * Insert the next @a count tuples of the payload at once, the
+	 * generator also inserts one to learn the response size.
+	 */
+	Error
+	insert(size_t count, const Sweep::Point &point, Sweep::Result &result)
+	{
+		if (Error error = m_runner.generate(m_payload, "insert",
+						    count); error)
+			return error;
+		m_inserted += count + 1;
+		return m_runner.run(point, result);
+	}
+
+	/* Insert the tuples in chunks until there are @a tuple_count. */
+	Error
+	fill(uint64_t tuple_count, const Sweep::Point &point, Milestone &m)
+	{
+		uint64_t count = 0;
+		double duration_s = 0;
+		while (m_inserted < tuple_count) {
+			/* The tuple inserted by the generator is counted too. */
+			const size_t n = std::min<size_t>(
+				CHUNK_SIZE, tuple_count - m_inserted - 1);
+			if (n == 0) {
+				if (Error error = m_runner.generate(m_payload,
+								    "insert",
+								    0); error)
+					return error;
+				m_inserted++;
+				break;
+			}
+			Sweep::Result result;
+			if (Error error = insert(n, point, result); error)
+				return error;
+			count += n;
+			duration_s += n / result.rps;
+			m.fill_error_count += result.error_count;
+		}
+		m.fill_rps = count != 0 ? count / duration_s : 0;
+		return {};
+	}
+
+	/* Select @a count of the tuples inserted so far at random. */
+	Error
+	read(size_t count, const Sweep::Point &point, Sweep::Result &result)
+	{
+		const auto &part = m_payload.parts[0];
+		std::vector<uint8_t> requests;
+		for (size_t i = 0; i < count; i++) {
+			const uint64_t key =
+				part.value_at(Rng::u64() % m_inserted).value.uint64;
+			Tarantool::write_get_request(requests, 512, key, 0);
+		}
+		m_runner.assign(std::move(requests), count);
+		return m_runner.run(point, result);
+	}
+
+private:
+	Payload &m_payload;
+	Sweep::Runner m_runner;
+	uint64_t m_inserted;
+};
+
+/*
+ * Fill the space up to @a m.tuple_count with the @a stream and run the
+ * mix of @a read_count reads and @a write_count inserts.
+ */
+inline Error
+measure(Stream &stream, const Sweep::Point &point, size_t read_count,
+	size_t write_count, Milestone &m)
+{
+	if (Error error = stream.fill(m.tuple_count, point, m); error)
+		return error;
+	m.tuple_count = stream.inserted();
+	if (read_count != 0) {
+		if (Error error = stream.read(read_count, point, m.reads); error)
+			return error;
+	}
+	if (write_count != 0) {
+		if (Error error = stream.insert(write_count, point,
+						m.writes); error)
+			return error;
+	}
+	return {};
+}
+
+/*
+ * Grow the space up to each of the @a tuple_counts and report the mix
+ * of the reads and the inserts at each size.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, const char *script, Payload &payload,
+	  const std::vector<size_t> &tuple_counts, size_t mix_count,
+	  size_t read_percent, size_t batch, size_t connection_count,
+	  size_t response_buffer_size, const char *results)
+{
+	if (Error error = Growth::check_payload(payload); error)
+		return error;
+	std::unique_ptr<Server> server;
+	if (script != NULL) {
+		server = std::make_unique<Server>(script, endpoint);
+		if (Error error = server->start(); error)
+			return error;
+	} else {
+		/* The keys are inserted from the first one on. */
+		Tarantool tt(endpoint);
+		std::vector<uint8_t> buffer;
+		const char *value;
+		if (Error error = tt.evaluate("box.space.s:truncate()", buffer,
+					      &value); error)
+			return error;
+	}
+
+	const size_t read_count = mix_count * read_percent / 100;
+	const size_t write_count = mix_count - read_count;
+	const Sweep::Point point = {batch, connection_count, batch, 0};
+	Growth::Stream stream(endpoint, payload, connection_count,
+			      response_buffer_size);
+	std::vector<Growth::Milestone> milestones;
+	for (size_t tuple_count: tuple_counts) {
+		Growth::Milestone m;
+		m.tuple_count = tuple_count;
+		if (Error error = Growth::measure(stream, point, read_count,
+						  write_count, m); error)
+			return error;
+		milestones.push_back(m);
+	}
+
+	printf("Mix: %lu reads, %lu inserts\n", read_count, write_count);
+	printf("Batch size: %lu\n", batch);
+	printf("Connections: %lu\n", connection_count);
+	printf("%12s %10s %10s %10s %10s %10s %10s %10s %10s %8s\n",
+	       "Tuples", "Fill RPS", "Read RPS", "Read med", "Read 99%",
+	       "Write RPS", "Write med", "Write 99%", "Write 99.9", "Errors");
+	for (const auto &m: milestones) {
+		printf("%12lu %10.0f %10.0f %10.3f %10.3f %10.0f %10.3f %10.3f "
+		       "%10.3f %8lu\n", m.tuple_count, m.fill_rps, m.reads.rps,
+		       m.reads.med_us, m.reads.p99_us, m.writes.rps,
+		       m.writes.med_us, m.writes.p99_us, m.writes.p999_us,
+		       m.fill_error_count + m.reads.error_count +
+		       m.writes.error_count);
+	}
+	printf("The latencies are in μs.\n");
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("reads");
+		json.value(uint64_t(read_count));
+		json.key("writes");
+		json.value(uint64_t(write_count));
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("connections");
+		json.value(uint64_t(connection_count));
+		json.key("milestones");
+		json.begin_array();
+		for (const auto &m: milestones) {
+			json.begin_object();
+			json.key("tuples");
+			json.value(m.tuple_count);
+			json.key("fill_rps");
+			json.value(m.fill_rps);
+			json.key("fill_errors");
+			json.value(m.fill_error_count);
+			for (const auto &[name, r]: {std::pair{"reads", &m.reads},
+						     std::pair{"writes",
+							       &m.writes}}) {
+				json.key(name);
+				json.begin_object();
+				Report::write_latencies(json, *r);
+				json.end_object();
+			}
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Growth
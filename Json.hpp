@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cmath>
+#include <string_view>
+#include <vector>
+
+#include "msgpuck/msgpuck.h"
+
+namespace Json {
+
+/*
+ * A streaming JSON writer. It only tracks where the commas go, so
+ * the caller is responsible for the keys to be written in objects
+ * and the values in arrays.
+ */
+class Writer {
+	FILE *m_out;
+	/* Is there an item written in the current object or array? */
+	std::vector<bool> m_has_items;
+	/* Has a key been written and now its value is expected? */
+	bool m_after_key;
+
+public:
+	Writer(FILE *out)
+	: m_out(out)
+	, m_after_key(false)
+	{}
+
+	void
+	begin_object()
+	{
+		separate();
+		fputc('{', m_out);
+		m_has_items.push_back(false);
+	}
+
+	void
+	end_object()
+	{
+		m_has_items.pop_back();
+		fputc('}', m_out);
+		if (m_has_items.empty())
+			fputc('\n', m_out);
+	}
+
+	void
+	begin_array()
+	{
+		separate();
+		fputc('[', m_out);
+		m_has_items.push_back(false);
+	}
+
+	void
+	end_array()
+	{
+		m_has_items.pop_back();
+		fputc(']', m_out);
+	}
+
+	void
+	key(std::string_view name)
+	{
+		separate();
+		string(name);
+		fputc(':', m_out);
+		m_after_key = true;
+	}
+
+	void
+	value(std::string_view str)
+	{
+		separate();
+		string(str);
+	}
+
+	void
+	value(const char *str)
+	{
+		value(std::string_view(str));
+	}
+
+	void
+	value(uint64_t number)
+	{
+		separate();
+		fprintf(m_out, "%lu", number);
+	}
+
+	void
+	value(int64_t number)
+	{
+		separate();
+		fprintf(m_out, "%ld", number);
+	}
+
+	void
+	value(double number)
+	{
+		separate();
+		/* JSON has no representation for NaN and infinities. */
+		if (std::isfinite(number))
+			fprintf(m_out, "%.9g", number);
+		else
+			fputs("null", m_out);
+	}
+
+	void
+	value(bool boolean)
+	{
+		separate();
+		fputs(boolean ? "true" : "false", m_out);
+	}
+
+	void
+	null()
+	{
+		separate();
+		fputs("null", m_out);
+	}
+
+	/*
+	 * Write a MsgPack value as JSON and step over it. Non-string map
+	 * keys are written as strings, binary and extension values which
+	 * have no JSON counterpart are written as nulls.
+	 */
+	void
+	msgpack(const char **data)
+	{
+		switch (mp_typeof(**data)) {
+		case MP_NIL:
+			mp_decode_nil(data);
+			return null();
+		case MP_UINT:
+			return value(uint64_t(mp_decode_uint(data)));
+		case MP_INT:
+			return value(int64_t(mp_decode_int(data)));
+		case MP_STR: {
+			uint32_t len;
+			const char *str = mp_decode_str(data, &len);
+			return value(std::string_view(str, len));
+		}
+		case MP_BOOL:
+			return value(mp_decode_bool(data));
+		case MP_FLOAT:
+			return value(double(mp_decode_float(data)));
+		case MP_DOUBLE:
+			return value(mp_decode_double(data));
+		case MP_ARRAY: {
+			uint32_t size = mp_decode_array(data);
+			begin_array();
+			for (uint32_t i = 0; i < size; i++)
+				msgpack(data);
+			return end_array();
+		}
+		case MP_MAP: {
+			uint32_t size = mp_decode_map(data);
+			begin_object();
+			for (uint32_t i = 0; i < size; i++) {
+				msgpack_key(data);
+				msgpack(data);
+			}
+			return end_object();
+		}
+		default:
+			mp_next(data);
+			return null();
+		}
+	}
+
+private:
+	void
+	msgpack_key(const char **data)
+	{
+		char buf[32];
+		switch (mp_typeof(**data)) {
+		case MP_STR: {
+			uint32_t len;
+			const char *str = mp_decode_str(data, &len);
+			return key(std::string_view(str, len));
+		}
+		case MP_UINT:
+			snprintf(buf, sizeof(buf), "%lu", mp_decode_uint(data));
+			return key(buf);
+		case MP_INT:
+			snprintf(buf, sizeof(buf), "%ld", mp_decode_int(data));
+			return key(buf);
+		default:
+			mp_next(data);
+			return key("?");
+		}
+	}
+
+	/* Put a comma if the value is not the first one in the scope. */
+	void
+	separate()
+	{
+		if (m_after_key) {
+			m_after_key = false;
+			return;
+		}
+		if (m_has_items.empty())
+			return;
+		if (m_has_items.back())
+			fputc(',', m_out);
+		m_has_items.back() = true;
+	}
+
+	void
+	string(std::string_view str)
+	{
+		fputc('"', m_out);
+		for (char c: str) {
+			if (c == '"' || c == '\\')
+				fprintf(m_out, "\\%c", c);
+			else if ((unsigned char)c < 0x20)
+				fprintf(m_out, "\\u%04x", c);
+			else
+				fputc(c, m_out);
+		}
+		fputc('"', m_out);
+	}
+};
+
+} // namespace Json
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <string>
+
+#include "Report.hpp"
+#include "Server.hpp"
+#include "Sweep.hpp"
+#include "Tarantool.hpp"
+
+/*
+ * Memory efficiency of a payload: the space is filled with the tuples of
+ * the payload from empty, then the size of the tuple data and of each
+ * index (bsize()) and the memtx allocator statistics (box.slab.info())
+ * are divided by the number of the tuples, so the memory a number of
+ * tuples of the shape takes can be told in advance.
+ */
+namespace Memory {
+
+/*
+ * The expression sampling the sizes of the space, the indexes come as
+ * {id, name, bsize} in the order of the ids.
+ */
+constexpr const char *STAT =
+	"local s = box.space.s "
+	"local indexes = {} "
+	"for id, index in pairs(s.index) do "
+	"    if type(id) == 'number' then "
+	"        table.insert(indexes, {id, index.name, index:bsize()}) "
+	"    end "
+	"end "
+	"table.sort(indexes, function(a, b) return a[1] < b[1] end) "
+	"return {len = s:len(), bsize = s:bsize(), indexes = indexes, "
+	"        slab = box.slab.info()}";
+
+struct Index {
+	std::string name;
+	uint64_t bytes;
+};
+
+/* The sizes compared before and after the space is filled. */
+struct Stat {
+	uint64_t tuple_count = 0;
+	/* Bytes. */
+	uint64_t data = 0;
+	std::vector<Index> indexes;
+	/* The tuple slabs and the memory they hold the tuples in. */
+	uint64_t items_size = 0;
+	uint64_t items_used = 0;
+	/* All the memtx memory, the indexes included. */
+	uint64_t arena_used = 0;
+};
+
+/* The measurements of a tuple shape. */
+struct Shape {
+	/* The payload config, NULL for the default one. */
+	const char *config_file = NULL;
+	Sweep::Result fill;
+	Stat before;
+	Stat after;
+
+	uint64_t
+	tuple_count() const
+	{
+		return after.tuple_count - before.tuple_count;
+	}
+
+	/* The growth of the @a bytes per tuple added. */
+	double
+	per_tuple(uint64_t before_bytes, uint64_t after_bytes) const
+	{
+		if (tuple_count() == 0)
+			return 0;
+		return (double(after_bytes) - before_bytes) / tuple_count();
+	}
+
+	/* Bytes per tuple of the index @a i, 0 if it's not there before. */
+	double
+	index_per_tuple(size_t i) const
+	{
+		const Index &index = after.indexes[i];
+		uint64_t before_bytes = 0;
+		for (const auto &b: before.indexes) {
+			if (b.name == index.name)
+				before_bytes = b.bytes;
+		}
+		return per_tuple(before_bytes, index.bytes);
+	}
+
+	/* The share of the tuple slabs not taken by the tuples. */
+	double
+	fragmentation() const
+	{
+		if (after.items_size == 0)
+			return 0;
+		return 1 - double(after.items_used) / after.items_size;
+	}
+};
+
+inline Error
+read_stat(Tarantool &tt, Stat &stat)
+{
+	std::vector<uint8_t> buffer;
+	const char *data;
+	if (Error error = tt.evaluate(STAT, buffer, &data); error)
+		return error;
+	if (data == NULL || mp_typeof(*data) != MP_MAP)
+		return Error_ResponseBody();
+	Tarantool::lookup(data, {"len"}, stat.tuple_count);
+	Tarantool::lookup(data, {"bsize"}, stat.data);
+	Tarantool::lookup(data, {"slab", "items_size"}, stat.items_size);
+	Tarantool::lookup(data, {"slab", "items_used"}, stat.items_used);
+	Tarantool::lookup(data, {"slab", "arena_used"}, stat.arena_used);
+
+	/* Find the indexes. */
+	stat.indexes.clear();
+	const uint32_t size = mp_decode_map(&data);
+	for (uint32_t i = 0; i < size; i++) {
+		if (mp_typeof(*data) != MP_STR) {
+			mp_next(&data);
+			mp_next(&data);
+			continue;
+		}
+		uint32_t len;
+		const char *key = mp_decode_str(&data, &len);
+		if (std::string_view(key, len) != "indexes" ||
+		    mp_typeof(*data) != MP_ARRAY) {
+			mp_next(&data);
+			continue;
+		}
+		const uint32_t count = mp_decode_array(&data);
+		for (uint32_t j = 0; j < count; j++) {
+			if (mp_typeof(*data) != MP_ARRAY ||
+			    mp_decode_array(&data) != 3)
+				return Error_ResponseBody();
+			mp_next(&data);
+			if (mp_typeof(*data) != MP_STR)
+				return Error_ResponseBody();
+			const char *name = mp_decode_str(&data, &len);
+			if (mp_typeof(*data) != MP_UINT)
+				return Error_ResponseBody();
+			stat.indexes.push_back({std::string(name, len),
+						mp_decode_uint(&data)});
+		}
+	}
+	return {};
+}
+
+/*
+ * Fill the space with the requests of the @a runner and compare the
+ * sizes before and after.
+ */
+inline Error
+measure(const Net::Endpoint &endpoint, Sweep::Runner &runner,
+	const Sweep::Point &point, Shape &shape)
+{
+	Tarantool tt(endpoint);
+	if (Error error = read_stat(tt, shape.before); error)
+		return error;
+	if (Error error = runner.run(point, shape.fill); error)
+		return error;
+	return read_stat(tt, shape.after);
+}
+
+/*
+ * Measure the memory per tuple of each of the @a config_files, of the
+ * @a payload if there's none or one, and report the shapes.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, const char *script, Payload &payload,
+	  const std::vector<const char *> &config_files, size_t tuple_count,
+	  size_t batch, size_t connection_count, size_t response_buffer_size,
+	  const char *results)
+{
+	/* Each config is a shape, the default payload is with none given. */
+	std::vector<Memory::Shape> shapes(std::max(config_files.size(), 1UL));
+	for (size_t i = 0; i < config_files.size(); i++)
+		shapes[i].config_file = config_files[i];
+
+	const Sweep::Point point = {batch, connection_count, batch, 0};
+	std::unique_ptr<Server> server;
+	for (auto &shape: shapes) {
+		/* Each shape starts with an empty space. */
+		if (script != NULL) {
+			server.reset();
+			server = std::make_unique<Server>(script, endpoint);
+			if (Error error = server->start(); error)
+				return error;
+		} else {
+			Tarantool tt(endpoint);
+			std::vector<uint8_t> buffer;
+			const char *value;
+			if (Error error = tt.evaluate("box.space.s:truncate()",
+						      buffer, &value); error)
+				return error;
+		}
+
+		/* A single config is the payload parsed already. */
+		Payload shape_payload(shapes.size() > 1 ?
+				      tuple_count + connection_count : 0);
+		if (shapes.size() > 1) {
+			if (Error error = shape_payload.parse_config(
+					shape.config_file); error)
+				return Error_ConfigParseFailed(error,
+							       shape.config_file);
+			if (shape_payload.has_columns())
+				return Error_NoDataset();
+		}
+		Sweep::Runner runner(endpoint, connection_count,
+				     response_buffer_size);
+		if (Error error = runner.generate(shapes.size() > 1 ?
+						  shape_payload : payload,
+						  "replace", tuple_count); error)
+			return error;
+		if (Error error = Memory::measure(endpoint, runner, point,
+						  shape); error)
+			return error;
+	}
+
+	/* The index columns are named after the ones of the first shape. */
+	const auto &indexes = shapes.front().after.indexes;
+	auto shape_name = [](const Memory::Shape &shape) {
+		return shape.config_file != NULL ? shape.config_file : "default";
+	};
+	printf("Requests: %lu\n", tuple_count);
+	printf("Batch size: %lu\n", batch);
+	printf("Connections: %lu\n", connection_count);
+	printf("%-20s %12s %10s", "Shape", "Tuples", "Data");
+	for (const auto &index: indexes)
+		printf(" %10s", index.name.c_str());
+	printf(" %10s %10s %8s %12s\n", "Tuple mem", "Arena", "Frag %",
+	       "MB/1M tuples");
+	for (const auto &shape: shapes) {
+		const auto &b = shape.before;
+		const auto &a = shape.after;
+		const double arena = shape.per_tuple(b.arena_used, a.arena_used);
+		printf("%-20s %12lu %10.1f", shape_name(shape),
+		       shape.tuple_count(), shape.per_tuple(b.data, a.data));
+		for (size_t i = 0; i < indexes.size(); i++) {
+			if (i < a.indexes.size())
+				printf(" %10.1f", shape.index_per_tuple(i));
+			else
+				printf(" %10s", "-");
+		}
+		printf(" %10.1f %10.1f %8.1f %12.1f\n",
+		       shape.per_tuple(b.items_used, a.items_used), arena,
+		       shape.fragmentation() * 100, arena * 1e6 / 1048576);
+	}
+	printf("The sizes are in bytes per tuple.\n");
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("requests");
+		json.value(uint64_t(tuple_count));
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("connections");
+		json.value(uint64_t(connection_count));
+		json.key("shapes");
+		json.begin_array();
+		for (const auto &shape: shapes) {
+			const auto &b = shape.before;
+			const auto &a = shape.after;
+			json.begin_object();
+			json.key("config");
+			json.value(shape_name(shape));
+			json.key("tuples");
+			json.value(shape.tuple_count());
+			json.key("fill_rps");
+			json.value(shape.fill.rps);
+			json.key("data_bytes");
+			json.value(a.data);
+			json.key("items_used_bytes");
+			json.value(a.items_used);
+			json.key("items_size_bytes");
+			json.value(a.items_size);
+			json.key("arena_used_bytes");
+			json.value(a.arena_used);
+			json.key("fragmentation");
+			json.value(shape.fragmentation());
+			json.key("per_tuple");
+			json.begin_object();
+			{
+				json.key("data");
+				json.value(shape.per_tuple(b.data, a.data));
+				json.key("tuple_memory");
+				json.value(shape.per_tuple(b.items_used,
+							   a.items_used));
+				json.key("arena");
+				json.value(shape.per_tuple(b.arena_used,
+							   a.arena_used));
+			}
+			json.end_object();
+			json.key("indexes");
+			json.begin_array();
+			for (size_t i = 0; i < a.indexes.size(); i++) {
+				json.begin_object();
+				json.key("name");
+				json.value(a.indexes[i].name.c_str());
+				json.key("bytes");
+				json.value(a.indexes[i].bytes);
+				json.key("per_tuple");
+				json.value(shape.index_per_tuple(i));
+				json.end_object();
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Memory
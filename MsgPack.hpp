@@ -28,6 +28,88 @@ encode_array(uint8_t *buffer, uint32_t size)
 	mp_encode_array((char *)buffer, size);
 }
 
+/* The MsgPack extension types of Tarantool. */
+enum Ext : int8_t {
+	EXT_DECIMAL = 1,
+	EXT_UUID = 2,
+	EXT_DATETIME = 4,
+};
+
+size_t
+sizeof_uuid()
+{
+	return mp_sizeof_ext(16);
+}
+
+char *
+encode_uuid(char *data, const uint8_t (&uuid)[16])
+{
+	return mp_encode_ext(data, EXT_UUID, (const char *)uuid, 16);
+}
+
+/* The amount of decimal digits in the value, one for zero. */
+size_t
+count_digits(uint64_t value)
+{
+	size_t count = 1;
+	while (value >= 10) {
+		value /= 10;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * A decimal is encoded as its scale followed by the packed BCD digits
+ * of the unscaled @a value with the sign in the last nibble, so the
+ * number is value / 10^scale.
+ */
+size_t
+sizeof_decimal(uint64_t value, uint32_t scale)
+{
+	const size_t bcd_size = (count_digits(value) + 2) / 2;
+	return mp_sizeof_ext(mp_sizeof_uint(scale) + bcd_size);
+}
+
+char *
+encode_decimal(char *data, uint64_t value, uint32_t scale,
+	       bool negative = false)
+{
+	const size_t digit_count = count_digits(value);
+	const size_t bcd_size = (digit_count + 2) / 2;
+	data = mp_encode_extl(data, EXT_DECIMAL,
+			      mp_sizeof_uint(scale) + bcd_size);
+	data = mp_encode_uint(data, scale);
+	/* Fill the nibbles from the end: the sign, the digits. */
+	uint8_t *bcd = (uint8_t *)data;
+	memset(bcd, 0, bcd_size);
+	size_t nibble = bcd_size * 2 - 1;
+	bcd[nibble / 2] = negative ? 0x0D : 0x0C;
+	for (size_t i = 0; i < digit_count; i++, value /= 10) {
+		nibble--;
+		const uint8_t digit = value % 10;
+		bcd[nibble / 2] |= nibble % 2 == 0 ? digit << 4 : digit;
+	}
+	return data + bcd_size;
+}
+
+/* A datetime without the fractional part and the timezone. */
+size_t
+sizeof_datetime()
+{
+	return mp_sizeof_ext(8);
+}
+
+char *
+encode_datetime(char *data, int64_t seconds)
+{
+	data = mp_encode_extl(data, EXT_DATETIME, 8);
+	/* The seconds are little-endian unlike the rest of MsgPack. */
+	for (int i = 0; i < 8; i++)
+		*data++ = (char)(uint64_t(seconds) >> (i * 8));
+	return data;
+}
+
 class Builder {
 	std::vector<uint8_t> m_buffer;
 	uint8_t *m_ptr;
@@ -66,6 +148,17 @@ public:
 		m_ptr += 4;
 	}
 
+	void
+	append_str(std::string_view value, const char *name)
+	{
+		assert(m_buffer.size() != 0);
+		size_t sz = mp_sizeof_str(value.size());
+		if (m_ptr + sz > m_end)
+			return overflow(name);
+		m_ptr = (uint8_t *)mp_encode_str((char *)m_ptr, value.data(),
+						 value.size());
+	}
+
 	void
 	append_raw(uint8_t value, const char *name)
 	{
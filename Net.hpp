@@ -3,9 +3,48 @@
 #include <errno.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/un.h>
+
+#include <string>
 
 namespace Net {
 
+/* Either a TCP host and port or a unix socket path. */
+struct Endpoint {
+	/* Host name or the unix socket path. */
+	std::string host;
+	/* TCP port, zero for a unix socket. */
+	uint16_t port;
+
+	bool
+	is_unix() const
+	{
+		return port == 0;
+	}
+
+	/* The endpoint as given on the command line, for the output. */
+	std::string
+	name() const
+	{
+		if (is_unix())
+			return host;
+		return host + ":" + std::to_string(port);
+	}
+};
+
+void
+set_timeouts(int fd)
+{
+	const struct timeval tmout_send = {};
+	const struct timeval tmout_recv = {};
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+		       &tmout_send, sizeof(tmout_send)) == -1)
+		Log::fatal_error("Couldn't set socket send timeout");
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+		       &tmout_recv, sizeof(tmout_recv)) == -1)
+		Log::fatal_error("Couldn't set socket recv timeout");
+}
+
 int
 connect(const char *hostname, uint16_t port)
 {
@@ -14,16 +53,7 @@ connect(const char *hostname, uint16_t port)
 	if (fd < 0)
 		Log::fatal_error("Couldn't create a socket");
 	/* Set socket options. */
-	{
-		const struct timeval tmout_send = {};
-		const struct timeval tmout_recv = {};
-		if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
-			       &tmout_send, sizeof(tmout_send)) == -1)
-			Log::fatal_error("Couldn't set socket send timeout");
-		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
-			       &tmout_recv, sizeof(tmout_recv)) == -1)
-			Log::fatal_error("Couldn't set socket recv timeout");
-	}
+	set_timeouts(fd);
 	/* Get Tarantool address. */
 	struct sockaddr_in addr = {};
 	addr.sin_family = AF_INET;
@@ -43,4 +73,86 @@ connect(const char *hostname, uint16_t port)
 	return fd;
 }
 
+int
+connect_unix(const char *path)
+{
+	/* Create the connection socket. */
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		Log::fatal_error("Couldn't create a socket");
+	/* Set socket options. */
+	set_timeouts(fd);
+	/* Get Tarantool address. */
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		Log::fatal_error("The socket path is too long: %s", path);
+	strcpy(addr.sun_path, path);
+	/* Connect to the Tarantool. */
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+		Log::fatal_error("Couldn't connect to Tarantool at %s", path);
+	return fd;
+}
+
+int
+connect(const Endpoint &endpoint)
+{
+	if (endpoint.is_unix())
+		return connect_unix(endpoint.host.c_str());
+	return connect(endpoint.host.c_str(), endpoint.port);
+}
+
+/* The address of an endpoint resolved once to connect to it repeatedly. */
+struct Address {
+	struct sockaddr_storage addr;
+	socklen_t size;
+};
+
+Address
+resolve(const Endpoint &endpoint)
+{
+	Address address = {};
+	if (endpoint.is_unix()) {
+		struct sockaddr_un *addr = (struct sockaddr_un *)&address.addr;
+		addr->sun_family = AF_UNIX;
+		if (endpoint.host.size() >= sizeof(addr->sun_path))
+			Log::fatal_error("The socket path is too long: %s",
+					 endpoint.host.c_str());
+		strcpy(addr->sun_path, endpoint.host.c_str());
+		address.size = sizeof(*addr);
+		return address;
+	}
+	struct sockaddr_in *addr = (struct sockaddr_in *)&address.addr;
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(endpoint.port);
+	struct addrinfo *addr_info = NULL;
+	if (getaddrinfo(endpoint.host.c_str(), NULL, NULL, &addr_info) != 0)
+		Log::fatal_error("Couldn't resolve the IP address");
+	addr->sin_addr = ((struct sockaddr_in *)addr_info->ai_addr)->sin_addr;
+	freeaddrinfo(addr_info);
+	address.size = sizeof(*addr);
+	return address;
+}
+
+/*
+ * Connect to the resolved address. Returns -1 with errno set if the
+ * connection fails, so it may be retried.
+ */
+int
+try_connect(const Address &address)
+{
+	const int fd = socket(address.addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	set_timeouts(fd);
+	if (connect(fd, (const struct sockaddr *)&address.addr,
+		    address.size) == -1) {
+		const int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+	return fd;
+}
+
 } // namespace Net
@@ -4,12 +4,40 @@
 #include <string_view>
 #include <algorithm>
 #include <cassert>
+#include <memory>
+#include <vector>
 #include <yaml.h>
 
+#include "Rng.hpp"
+
+class Dataset;
+
 struct Payload {
 	struct Part {
+		/*
+		 * The field type. The values of all the types are drawn as
+		 * numbers which are then turned into the fields of the type,
+		 * so the distributions apply to all of them.
+		 */
 		enum Type {
 			UINT64,
+			STRING,   /* The number padded to the length. */
+			DOUBLE,   /* The number / 10^scale. */
+			UUID,     /* Random with the number in the last bytes. */
+			DECIMAL,  /* The number / 10^scale. */
+			DATETIME, /* The number of seconds since the epoch. */
+			BOOLEAN,  /* The lowest bit of the number. */
+			NIL,
+			ARRAY,    /* The numbers from the drawn one on. */
+			MAP,      /* Indexes mapped to the numbers as above. */
+			BINARY,   /* Bytes of the pool. */
+		};
+
+		/* The data pool strings and binaries take their bytes from. */
+		enum Pool {
+			NO_POOL,
+			RANDOM, /* Random bytes (or characters), incompressible. */
+			TEXT,   /* Words separated by spaces, compressible. */
 		};
 
 		/* The object type to return on next value request. */
@@ -81,16 +109,36 @@ struct Payload {
 			DECREMENTAL, /* From max_value to min_value. */
 			LINEAR,      /* Random, linear distribution. */
 			NORMAL,      /* Random, normal distribution. */
+			UNIFORM,     /* Random, uniform with repetitions. */
 		};
 
 		enum Type type;
 		Value min;
 		Value max;
 		enum Distribution distribution;
+		/* The length of strings and the size of arrays and maps. */
+		size_t min_length = 0;
+		size_t max_length = 0;
+		/* The number of fractional digits of decimals and doubles. */
+		uint32_t scale = 0;
+		/*
+		 * The pool is generated once and shared by all the copies of
+		 * the part, the fields reference random slices of it.
+		 */
+		enum Pool pool_kind = NO_POOL;
+		std::shared_ptr<const std::vector<uint8_t>> pool;
+		/*
+		 * The column of the dataset the field is taken from, given
+		 * by the index or by the name in the header.
+		 */
+		static constexpr size_t NO_COLUMN = SIZE_MAX;
+		size_t column = NO_COLUMN;
+		std::string column_name;
 
 	public:
-		Part(Value min, Value max, Distribution distribution, size_t request_count)
-		: type(min.type)
+		Part(Type type, Value min, Value max, Distribution distribution,
+		     size_t request_count)
+		: type(type)
 		, min(min)
 		, max(max)
 		, distribution(distribution)
@@ -101,17 +149,31 @@ struct Payload {
 				m_next_value = min;
 			} else if (distribution == DECREMENTAL) {
 				m_next_value = max;
+			} else if (distribution == UNIFORM) {
+				/* Values are drawn on request, nothing to prepare. */
+				assert(min < max);
 			} else {
-				for (Value i = min; i < max; i++)
-					m_values.emplace_back(i);
-				if (m_values.size() < request_count)
+				const uint64_t size = max.value.uint64 -
+						      min.value.uint64;
+				if (size < request_count)
 					Log::fatal_error("No enough values between min and max to provide data for at least %lu requests.\n", request_count);
-				std::random_shuffle(m_values.begin(),
-						    m_values.end());
+				m_permutation = Rng::Permutation(size);
 				m_values_i = 0;
 			}
 		}
 
+		/* Step over @a count values as if they were requested. */
+		void
+		skip(size_t count)
+		{
+			if (distribution == INCREMENTAL)
+				m_next_value = m_next_value + count;
+			else if (distribution == DECREMENTAL)
+				m_next_value.value.uint64 -= count;
+			else if (distribution != UNIFORM)
+				m_values_i += count;
+		}
+
 		Value
 		next()
 		{
@@ -119,16 +181,101 @@ struct Payload {
 				return m_next_value++;
 			else if (distribution == DECREMENTAL)
 				return m_next_value--;
+			else if (distribution == UNIFORM)
+				return min + uniform(max.value.uint64 -
+						     min.value.uint64);
+			else
+				return value_at(m_values_i++);
+		}
+
+		/*
+		 * A random number within [0, @a range). Rng::u32() stops
+		 * short of 2^31, so the wider ranges take Rng::u64().
+		 */
+		static uint64_t
+		uniform(uint64_t range)
+		{
+			if (range < 0x7ffffffe)
+				return Rng::u32() % range;
+			return Rng::u64() % range;
+		}
+
+		/*
+		 * The value drawn @a i-th since the part was made, it can't
+		 * be told for the uniform distribution.
+		 */
+		Value
+		value_at(uint64_t i) const
+		{
+			assert(distribution != UNIFORM);
+			if (distribution == INCREMENTAL)
+				return min.value.uint64 + i;
+			else if (distribution == DECREMENTAL)
+				return max.value.uint64 - i;
 			else
-				return m_values[m_values_i++];
+				return min.value.uint64 +
+				       m_permutation(i % m_permutation.size());
+		}
+
+		/* Draw the length of a string or the size of a container. */
+		size_t
+		next_length()
+		{
+			if (min_length >= max_length)
+				return min_length;
+			return min_length + Rng::u32() % (max_length - min_length + 1);
+		}
+
+		/*
+		 * Generate the pool of @a size bytes, at least as large as
+		 * the longest field taken from it.
+		 */
+		void
+		make_pool(enum Pool kind, size_t size)
+		{
+			static const char *const words[] = {
+				"tarantool", "tuple", "space", "index", "memtx",
+				"vinyl", "fiber", "box", "lua", "iproto", "wal",
+				"the", "a", "of", "and", "to", "in", "is", "it",
+			};
+			static const char alphabet[] =
+				"abcdefghijklmnopqrstuvwxyz"
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+			pool_kind = kind;
+			auto data = std::make_shared<std::vector<uint8_t>>(
+				std::max(size, max_length));
+			for (size_t i = 0; i < data->size(); ) {
+				if (kind == TEXT) {
+					const char *word = words[Rng::u32() %
+						(sizeof(words) / sizeof(words[0]))];
+					for (; *word != '\0' && i < data->size(); word++)
+						(*data)[i++] = *word;
+					if (i < data->size())
+						(*data)[i++] = ' ';
+				} else if (type == STRING) {
+					(*data)[i++] = alphabet[Rng::u32() %
+								(sizeof(alphabet) - 1)];
+				} else {
+					(*data)[i++] = Rng::u32() >> 7;
+				}
+			}
+			pool = std::move(data);
+		}
+
+		/* Draw a slice of the pool of @a length bytes. */
+		const uint8_t *
+		pool_slice(size_t length) const
+		{
+			const size_t range = pool->size() - length + 1;
+			return pool->data() + Rng::u32() % range;
 		}
 
 	private:
 		/* FIXME(multitool): data to be used by tuple generators. */
 
 		/* For random distribution. */
-		std::vector<Value> m_values;
-		size_t m_values_i; /* Current position in m_values. */
+		Rng::Permutation m_permutation;
+		size_t m_values_i; /* Current position in m_permutation. */
 
 		/* For incremental/decremental distribution. */
 		Value m_next_value;
@@ -136,15 +283,24 @@ struct Payload {
 
 public:
 	std::vector<Part> parts;
+	/*
+	 * The records the column parts are taken from. All the column
+	 * parts draw the same incremental numbers, which are the record
+	 * numbers, so the fields of a tuple come from the same record.
+	 */
+	std::shared_ptr<const Dataset> dataset;
 
 private:
 	size_t m_request_count;
 
+	static constexpr size_t DEFAULT_POOL_SIZE = 16 * 1024 * 1024;
+
 public:
 	Payload(size_t request_count)
 	: m_request_count(request_count)
 	{
-		parts.emplace_back(Part::Value(uint64_t(0)),
+		parts.emplace_back(Part::Type::UINT64,
+				   Part::Value(uint64_t(0)),
 				   Part::Value(uint64_t(request_count)),
 				   Part::Distribution::INCREMENTAL,
 				   request_count);
@@ -178,6 +334,13 @@ public:
 			PARSE_MIN,
 			PARSE_MAX,
 			PARSE_DISTRIBUTION,
+			PARSE_LENGTH,
+			PARSE_MIN_LENGTH,
+			PARSE_MAX_LENGTH,
+			PARSE_SCALE,
+			PARSE_POOL,
+			PARSE_POOL_SIZE,
+			PARSE_COLUMN,
 		} state;
 
 		struct {
@@ -185,6 +348,12 @@ public:
 			std::optional<Part::Value> min;
 			std::optional<Part::Value> max;
 			std::optional<Part::Distribution> distribution;
+			std::optional<size_t> min_length;
+			std::optional<size_t> max_length;
+			std::optional<uint32_t> scale;
+			std::optional<Part::Pool> pool;
+			std::optional<size_t> pool_size;
+			std::optional<std::string> column;
 		} next_part;
 
 		int level = 0;
@@ -208,6 +377,20 @@ public:
 						state = PARSE_MAX;
 					else if (key == "distribution")
 						state = PARSE_DISTRIBUTION;
+					else if (key == "length")
+						state = PARSE_LENGTH;
+					else if (key == "min_length")
+						state = PARSE_MIN_LENGTH;
+					else if (key == "max_length")
+						state = PARSE_MAX_LENGTH;
+					else if (key == "scale")
+						state = PARSE_SCALE;
+					else if (key == "pool")
+						state = PARSE_POOL;
+					else if (key == "pool_size")
+						state = PARSE_POOL_SIZE;
+					else if (key == "column")
+						state = PARSE_COLUMN;
 					else
 						Log::fatal_error("Unrecognised part property: %s", key.data());
 				} else if (state == PARSE_TYPE) {
@@ -215,6 +398,26 @@ public:
 							     token.data.scalar.length);
 					if (key == "uint64")
 						next_part.type = Part::Type::UINT64;
+					else if (key == "string")
+						next_part.type = Part::Type::STRING;
+					else if (key == "double")
+						next_part.type = Part::Type::DOUBLE;
+					else if (key == "uuid")
+						next_part.type = Part::Type::UUID;
+					else if (key == "decimal")
+						next_part.type = Part::Type::DECIMAL;
+					else if (key == "datetime")
+						next_part.type = Part::Type::DATETIME;
+					else if (key == "boolean")
+						next_part.type = Part::Type::BOOLEAN;
+					else if (key == "nil")
+						next_part.type = Part::Type::NIL;
+					else if (key == "array")
+						next_part.type = Part::Type::ARRAY;
+					else if (key == "map")
+						next_part.type = Part::Type::MAP;
+					else if (key == "binary")
+						next_part.type = Part::Type::BINARY;
 					else
 						Log::fatal_error("Unrecognised part type: %s", key.data());
 				} else if (state == PARSE_DISTRIBUTION) {
@@ -226,6 +429,8 @@ public:
 						next_part.distribution = Part::Distribution::INCREMENTAL;
 					else if (key == "decremental")
 						next_part.distribution = Part::Distribution::DECREMENTAL;
+					else if (key == "uniform")
+						next_part.distribution = Part::Distribution::UNIFORM;
 					else
 						Log::fatal_error("Unrecognised distribution: %s", key.data());
 					state = PARSE_KEY;
@@ -234,7 +439,7 @@ public:
 						Log::fatal_error("Part type must be set prior to the min/max.\n");
 					std::string key((char *)token.data.scalar.value,
 							token.data.scalar.length);
-					if (*next_part.type == Part::Type::UINT64) {
+					if (*next_part.type != Part::Type::NIL) {
 						uint64_t value = std::stoul(key);
 						if (state == PARSE_MIN)
 							next_part.min = Part::Value(value);
@@ -244,18 +449,49 @@ public:
 						Log::fatal_error("Min/max for this type is not implemented.\n");
 					}
 					state = PARSE_KEY;
+				} else if (state == PARSE_LENGTH ||
+					   state == PARSE_MIN_LENGTH ||
+					   state == PARSE_MAX_LENGTH ||
+					   state == PARSE_SCALE) {
+					std::string key((char *)token.data.scalar.value,
+							token.data.scalar.length);
+					const size_t value = std::stoul(key);
+					if (state != PARSE_MAX_LENGTH && state != PARSE_SCALE)
+						next_part.min_length = value;
+					if (state != PARSE_MIN_LENGTH && state != PARSE_SCALE)
+						next_part.max_length = value;
+					if (state == PARSE_SCALE)
+						next_part.scale = value;
+					state = PARSE_KEY;
+				} else if (state == PARSE_POOL) {
+					std::string_view key((char *)token.data.scalar.value,
+							     token.data.scalar.length);
+					if (key == "random")
+						next_part.pool = Part::Pool::RANDOM;
+					else if (key == "text")
+						next_part.pool = Part::Pool::TEXT;
+					else
+						Log::fatal_error("Unrecognised pool: %s", key.data());
+					state = PARSE_KEY;
+				} else if (state == PARSE_POOL_SIZE) {
+					std::string key((char *)token.data.scalar.value,
+							token.data.scalar.length);
+					next_part.pool_size = std::stoul(key);
+					state = PARSE_KEY;
+				} else if (state == PARSE_COLUMN) {
+					next_part.column = std::string((char *)token.data.scalar.value,
+								       token.data.scalar.length);
+					state = PARSE_KEY;
 				}
 				break;
-			case YAML_BLOCK_ENTRY_TOKEN:
+			case YAML_BLOCK_SEQUENCE_START_TOKEN:
+			case YAML_BLOCK_MAPPING_START_TOKEN:
 				level++;
-				if (parts.size() == 0)
-					break;
-				[[fallthrough]];
+				break;
 			case YAML_BLOCK_END_TOKEN:
-				/* FIXME: get rid of this shit. */
-				if (level == 0)
+				/* Only the end of a part mapping in the list matters. */
+				if (--level != 1)
 					break;
-				level--;
 				if (!next_part.type)
 					Log::fatal_error("Part type must be specified.\n");
 				if (!next_part.min)
@@ -264,12 +500,56 @@ public:
 					next_part.max = *next_part.min + m_request_count;
 				if (!next_part.distribution)
 					next_part.distribution = Part::Distribution::LINEAR;
-				parts.emplace_back(*next_part.min, *next_part.max,
+				/* The column parts count the records from the first. */
+				if (next_part.column) {
+					if (next_part.pool)
+						Log::fatal_error("Dataset columns don't take a pool.\n");
+					next_part.min = Part::Value(uint64_t(0));
+					next_part.max = Part::Value(m_request_count);
+					next_part.distribution = Part::Distribution::INCREMENTAL;
+				}
+				parts.emplace_back(*next_part.type,
+						   *next_part.min, *next_part.max,
 						   *next_part.distribution, m_request_count);
-				next_part.type = {};
-				next_part.min = {};
-				next_part.max = {};
-				next_part.distribution = {};
+				/* Strings and containers are 16 and 4 long by default. */
+				{
+					const size_t length =
+						*next_part.type == Part::Type::STRING ||
+						*next_part.type == Part::Type::BINARY ? 16 :
+						*next_part.type == Part::Type::ARRAY ||
+						*next_part.type == Part::Type::MAP ? 4 : 0;
+					Part &part = parts.back();
+					part.min_length = next_part.min_length.value_or(length);
+					part.max_length = next_part.max_length.value_or(
+						std::max(part.min_length, length));
+					part.scale = next_part.scale.value_or(
+						*next_part.type == Part::Type::DECIMAL ? 2 : 0);
+					if (part.max_length < part.min_length)
+						Log::fatal_error("Part max_length is less than min_length.\n");
+					/* Binaries always come from a pool. */
+					if (*next_part.type == Part::Type::BINARY &&
+					    !next_part.pool)
+						next_part.pool = Part::Pool::RANDOM;
+					if (next_part.pool) {
+						if (*next_part.type != Part::Type::STRING &&
+						    *next_part.type != Part::Type::BINARY)
+							Log::fatal_error("Only strings and binaries take a pool.\n");
+						part.make_pool(*next_part.pool,
+							       next_part.pool_size.value_or(
+								       DEFAULT_POOL_SIZE));
+					}
+				}
+				if (next_part.column) {
+					const std::string &column = *next_part.column;
+					Part &part = parts.back();
+					if (!column.empty() &&
+					    column.find_first_not_of("0123456789") ==
+					    std::string::npos)
+						part.column = std::stoul(column);
+					else
+						part.column_name = column;
+				}
+				next_part = {};
 				break;
 			default:
 				break;
@@ -285,6 +565,40 @@ public:
 		return {};
 	}
 
+	/* Do some of the fields take their bytes from a pool? */
+	bool
+	has_pool() const
+	{
+		for (const auto &part: parts) {
+			if (part.pool)
+				return true;
+		}
+		return false;
+	}
+
+	/* Are some of the fields taken from a dataset? */
+	bool
+	has_columns() const
+	{
+		for (const auto &part: parts) {
+			if (part.column != Part::NO_COLUMN ||
+			    !part.column_name.empty())
+				return true;
+		}
+		return false;
+	}
+
+	/*
+	 * Step over @a count tuples. Used to give each of the workers
+	 * its own slice of the payload.
+	 */
+	void
+	skip(size_t count)
+	{
+		for (auto &part: parts)
+			part.skip(count);
+	}
+
 	void
 	next(std::vector<struct Part::Value> &output)
 	{
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <sys/resource.h>
+
+/* Client-side time spent in each of the phases of a transfer. */
+struct Phases {
+	enum Phase {
+		GENERATE,   /* Building the transfer. */
+		SEND,       /* The send syscall. */
+		FIRST_BYTE, /* Waiting for the first byte of responses. */
+		DRAIN,      /* Receiving the rest of responses. */
+		VALIDATE,   /* Checking the responses. */
+		COUNT,
+	};
+
+	static constexpr const char *names[COUNT] = {
+		"generate", "send", "first_byte", "drain", "validate",
+	};
+
+	uint64_t ns[COUNT] = {};
+
+	Phases &
+	operator+=(const Phases &other)
+	{
+		for (int i = 0; i < COUNT; i++)
+			ns[i] += other.ns[i];
+		return *this;
+	}
+
+	/* User and system CPU time consumed by the process so far. */
+	static uint64_t
+	cpu_ns()
+	{
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		       1000000000llu +
+		       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		       1000llu;
+	}
+};
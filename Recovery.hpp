@@ -0,0 +1,296 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Report.hpp"
+#include "Server.hpp"
+#include "Sweep.hpp"
+
+/*
+ * Checkpoint and recovery: the space is filled up to a number of
+ * tuples, then box.snapshot() is made while the tuples are replaced
+ * again, so the latency of the load during the checkpoint can be
+ * compared against the one without it. Then the instance is killed and
+ * restarted, and the recovery of the snapshot and of the xlogs written
+ * since is timed until the greeting is sent again.
+ */
+namespace Recovery {
+
+/* The load is sent in windows of this share of the dataset. */
+constexpr size_t WINDOW_COUNT = 10;
+
+/* The files read by the recovery. */
+struct Files {
+	uint64_t snap_bytes = 0;
+	uint64_t xlog_bytes = 0;
+};
+
+/* The measurements of a window of the load started during the snapshot. */
+struct Window {
+	/* The start of the window since the start of the snapshot. */
+	uint64_t start_ns;
+	Sweep::Result result;
+};
+
+/* The measurements of a dataset size. */
+struct Milestone {
+	size_t tuple_count = 0;
+	/* Filling the space up to the size. */
+	Sweep::Result fill;
+	/* A window of the load without the snapshot. */
+	Sweep::Result baseline;
+	uint64_t snapshot_ns = 0;
+	/* The windows of the load during the snapshot. */
+	std::vector<Window> windows;
+	/* box.space.s:bsize() prior to the crash. */
+	uint64_t data_bytes = 0;
+	Files files;
+	uint64_t recovery_ns = 0;
+};
+
+/*
+ * Sum up the size of the latest snapshot in the @a dir and of the xlogs
+ * written since, they're named by the vclock signature zero-padded.
+ */
+inline Error
+measure_files(const std::string &dir, Files &files)
+{
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL)
+		return Error_System("Can't open the instance directory.");
+	std::vector<std::pair<std::string, uint64_t>> xlogs;
+	std::string snap;
+	files = {};
+	while (struct dirent *entry = readdir(d)) {
+		const std::string_view name(entry->d_name);
+		const bool is_snap = name.ends_with(".snap");
+		if (!is_snap && !name.ends_with(".xlog"))
+			continue;
+		struct stat st;
+		if (stat((dir + "/" + entry->d_name).c_str(), &st) != 0)
+			continue;
+		if (!is_snap) {
+			xlogs.emplace_back(name, st.st_size);
+		} else if (name > snap) {
+			snap = name;
+			files.snap_bytes = st.st_size;
+		}
+	}
+	closedir(d);
+	const std::string signature = snap.substr(0, snap.find('.'));
+	for (const auto &[name, size]: xlogs) {
+		if (name.substr(0, name.find('.')) >= signature)
+			files.xlog_bytes += size;
+	}
+	return {};
+}
+
+/* Evaluate the @a expression returning an unsigned number. */
+inline Error
+evaluate_uint(Tarantool &tt, const char *expression, uint64_t &value)
+{
+	std::vector<uint8_t> buffer;
+	const char *data;
+	if (Error error = tt.evaluate(expression, buffer, &data); error)
+		return error;
+	if (data == NULL || mp_typeof(*data) != MP_UINT)
+		return Error_ResponseBody();
+	value = mp_decode_uint(&data);
+	return {};
+}
+
+/*
+ * Fill the space from @a filled tuples up to @a m.tuple_count with the
+ * requests of the @a runner, make the snapshot under the load, crash
+ * and recover the @a server. The runner is connected anew then. The
+ * generator has replaced the first tuple already, so the requests are
+ * one fewer than the tuples.
+ */
+inline Error
+measure(Server &server, Sweep::Runner &runner, const Sweep::Point &point,
+	size_t filled, Milestone &m)
+{
+	const size_t size = m.tuple_count - 1;
+	runner.set_range(filled, size - filled);
+	if (Error error = runner.run(point, m.fill); error)
+		return error;
+
+	/* The load without and with the snapshot. */
+	const size_t window = std::min(size, std::max(size / WINDOW_COUNT,
+						      point.batch *
+						      point.connection_count));
+	runner.set_range(0, window);
+	if (Error error = runner.run(point, m.baseline); error)
+		return error;
+
+	Tarantool tt(server.endpoint());
+	std::atomic<bool> snapshot = true;
+	Error snapshot_error;
+	const uint64_t start_ns = Timer::now_ns();
+	std::thread checkpoint([&] {
+		std::vector<uint8_t> buffer;
+		const char *value;
+		snapshot_error = tt.evaluate("box.snapshot()", buffer, &value);
+		m.snapshot_ns = Timer::now_ns() - start_ns;
+		snapshot = false;
+	});
+	Error load_error;
+	size_t first = 0;
+	do {
+		Window w = {Timer::now_ns() - start_ns};
+		runner.set_range(first, std::min(window, size - first));
+		if ((load_error = runner.run(point, w.result)))
+			break;
+		m.windows.push_back(w);
+		first = (first + window) % size;
+	} while (snapshot);
+	checkpoint.join();
+	if (snapshot_error)
+		return snapshot_error;
+	if (load_error)
+		return load_error;
+
+	/* Crash and recover. */
+	if (Error error = evaluate_uint(tt, "return box.space.s:bsize()",
+					m.data_bytes); error)
+		return error;
+	if (Error error = measure_files(server.dir(), m.files); error)
+		return error;
+	server.stop(SIGKILL);
+	if (Error error = server.start(&m.recovery_ns); error)
+		return error;
+	runner.reconnect();
+	return {};
+}
+
+/*
+ * Fill the space up to each of the @a tuple_counts, snapshot it and
+ * recover the instance launched with the @a script, and report the
+ * milestones.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, const char *script, Payload &payload,
+	  const std::vector<size_t> &tuple_counts, size_t batch,
+	  size_t connection_count, size_t response_buffer_size,
+	  const char *results)
+{
+	Server server(script, endpoint);
+	if (Error error = server.start(); error)
+		return error;
+
+	/*
+	 * All the tuples are generated at once, each size adds its share.
+	 * The generator replaces one of them on its own.
+	 */
+	Sweep::Runner runner(endpoint, connection_count, response_buffer_size);
+	if (Error error = runner.generate(payload, "replace",
+					  tuple_counts.back() - 1); error)
+		return error;
+	const Sweep::Point point = {batch, connection_count, batch, 0};
+	std::vector<Recovery::Milestone> milestones;
+	size_t filled = 0;
+	for (size_t tuple_count: tuple_counts) {
+		Recovery::Milestone m;
+		m.tuple_count = tuple_count;
+		if (Error error = Recovery::measure(server, runner, point, filled,
+						    m); error)
+			return error;
+		milestones.push_back(std::move(m));
+		filled = tuple_count - 1;
+	}
+
+	/* The worst window of the load during the snapshot. */
+	auto worst = [](const Recovery::Milestone &m) {
+		Sweep::Result result = m.baseline;
+		for (const auto &w: m.windows) {
+			result.p99_us = std::max(result.p99_us, w.result.p99_us);
+			result.p999_us = std::max(result.p999_us,
+						  w.result.p999_us);
+			result.rps = std::min(result.rps, w.result.rps);
+		}
+		return result;
+	};
+
+	printf("Batch size: %lu\n", batch);
+	printf("Connections: %lu\n", connection_count);
+	printf("%12s %10s %10s %10s %10s %10s %10s %12s %12s %12s %10s\n",
+	       "Tuples", "Data (MB)", "Snap (MB)", "Xlog (MB)", "Snapshot",
+	       "Base 99%", "Snap 99%", "Snap 99.9%", "Recovery",
+	       "Tuples/s", "MB/s");
+	for (const auto &m: milestones) {
+		const double recovery_s = m.recovery_ns / 1e9;
+		const double file_mb = (m.files.snap_bytes +
+					m.files.xlog_bytes) / 1048576.0;
+		printf("%12lu %10.1f %10.1f %10.1f %10.3f %10.3f %10.3f %12.3f "
+		       "%12.3f %12.0f %10.1f\n", m.tuple_count,
+		       m.data_bytes / 1048576.0,
+		       m.files.snap_bytes / 1048576.0,
+		       m.files.xlog_bytes / 1048576.0, m.snapshot_ns / 1e9,
+		       m.baseline.p99_us, worst(m).p99_us, worst(m).p999_us,
+		       recovery_s, m.tuple_count / recovery_s,
+		       file_mb / recovery_s);
+	}
+	printf("The snapshot and the recovery are in seconds, the latencies "
+	       "in μs.\n");
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("connections");
+		json.value(uint64_t(connection_count));
+		json.key("milestones");
+		json.begin_array();
+		for (const auto &m: milestones) {
+			const double recovery_s = m.recovery_ns / 1e9;
+			json.begin_object();
+			json.key("tuples");
+			json.value(uint64_t(m.tuple_count));
+			json.key("fill_rps");
+			json.value(m.fill.rps);
+			json.key("data_bytes");
+			json.value(m.data_bytes);
+			json.key("snap_bytes");
+			json.value(m.files.snap_bytes);
+			json.key("xlog_bytes");
+			json.value(m.files.xlog_bytes);
+			json.key("snapshot_s");
+			json.value(m.snapshot_ns / 1e9);
+			json.key("baseline");
+			json.begin_object();
+			Report::write_latencies(json, m.baseline);
+			json.end_object();
+			json.key("snapshot_windows");
+			json.begin_array();
+			for (const auto &w: m.windows) {
+				json.begin_object();
+				json.key("t");
+				json.value(w.start_ns / 1e9);
+				Report::write_latencies(json, w.result);
+				json.end_object();
+			}
+			json.end_array();
+			json.key("recovery_s");
+			json.value(recovery_s);
+			json.key("recovery_tuples_per_s");
+			json.value(m.tuple_count / recovery_s);
+			json.key("recovery_bytes_per_s");
+			json.value((m.files.snap_bytes + m.files.xlog_bytes) /
+				   recovery_s);
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Recovery
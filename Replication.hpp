@@ -0,0 +1,398 @@
+#pragma once
+
+#include <atomic>
+#include <ctime>
+#include <thread>
+
+#include "Report.hpp"
+#include "Sampler.hpp"
+#include "Server.hpp"
+#include "Slo.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Replication lag: a writer replaces keys on the master in batches,
+ * optionally at a set rate, while a poller selects the last key of the
+ * latest acknowledged batch on the replica until it shows up there. The
+ * lag of the batch is the time from the acknowledgement by the master to
+ * the response of the replica showing the key, so it includes one poll
+ * at most. The poller skips to the latest batch each time, so the lag
+ * of a replica falling behind isn't hidden by polling the old batches.
+ */
+namespace Replication {
+
+/* The space the keys are written to. */
+constexpr uint32_t SPACE_ID = 512;
+
+/* The time the replica is given to show a key. */
+constexpr uint64_t CATCH_UP_TIMEOUT_NS = 60 * 1000000000ULL;
+
+/* The expression sampling the replication state of the replica. */
+constexpr const char *REPLICATION_INFO = "return box.info.replication";
+
+/* The measurements of the writes of a batch size at a rate. */
+struct Result {
+	size_t batch = 0;
+	/* Offered writes per second, 0 for the writes sent at will. */
+	size_t rate = 0;
+	double write_rps = 0;
+	uint64_t error_count = 0;
+	/* The batch latency on the master, from the time it was due. */
+	std::vector<uint64_t> write_latencies_ns;
+	/* The lag of each batch polled, sorted. */
+	std::vector<uint64_t> lags_ns;
+	uint64_t poll_count = 0;
+	/* The bounds of the run. */
+	uint64_t start_ns = 0;
+	uint64_t end_ns = 0;
+};
+
+class Probe {
+public:
+	Probe(const Net::Endpoint &master, const Net::Endpoint &replica)
+	: m_master(master)
+	, m_replica(replica)
+	{
+		/* The keys are unique across the runs against the same data. */
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		m_next_key = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+	/*
+	 * Write a batch of @a batch keys every 1/@a rate of a second (or
+	 * at will) until @a write_count keys are written and poll them on
+	 * the replica.
+	 */
+	Error
+	run(size_t batch, size_t rate, size_t write_count, Result &result)
+	{
+		assert(batch != 0);
+		const size_t group_count = write_count / batch;
+		const uint64_t interval_ns = rate == 0 ? 0 :
+					     batch * 1000000000 / rate;
+		const uint64_t first_key = m_next_key;
+		m_next_key += group_count * batch;
+		result = {};
+		result.batch = batch;
+		result.rate = rate;
+
+		/* The acknowledgement times published to the poller. */
+		std::vector<uint64_t> ack_ns(group_count);
+		std::atomic<size_t> acked = 0;
+		std::atomic<bool> writing = true;
+		std::atomic<bool> polling = true;
+		Error write_error;
+		result.start_ns = Timer::now_ns();
+		std::thread writer([&] {
+			write_error = write(first_key, batch, group_count,
+					    interval_ns, polling, ack_ns, acked,
+					    result);
+			writing = false;
+		});
+
+		Error poll_error;
+		size_t polled = 0;
+		while (true) {
+			const size_t n = acked.load(std::memory_order_acquire);
+			if (n == polled) {
+				if (!writing)
+					break;
+				std::this_thread::yield();
+				continue;
+			}
+			const uint64_t key = first_key + n * batch - 1;
+			uint64_t seen_ns;
+			poll_error = poll(key, ack_ns[n - 1], seen_ns, result);
+			if (poll_error)
+				break;
+			result.lags_ns.push_back(seen_ns - ack_ns[n - 1]);
+			polled = n;
+		}
+		polling = false;
+		writer.join();
+		result.end_ns = group_count == 0 ? result.start_ns :
+				ack_ns[group_count - 1];
+		if (write_error)
+			return write_error;
+		if (poll_error)
+			return poll_error;
+		result.write_rps = group_count * batch /
+				   ((result.end_ns - result.start_ns) / 1e9);
+		std::sort(result.lags_ns.begin(), result.lags_ns.end());
+		return {};
+	}
+
+private:
+	Error
+	write(uint64_t first_key, size_t batch, size_t group_count,
+	      uint64_t interval_ns, const std::atomic<bool> &polling,
+	      std::vector<uint64_t> &ack_ns, std::atomic<size_t> &acked,
+	      Result &result)
+	{
+		std::vector<uint8_t> requests;
+		std::vector<uint8_t> buffer;
+		std::vector<Tarantool::Response> responses;
+		for (size_t g = 0; g < group_count && polling; g++) {
+			uint64_t due_ns = Timer::now_ns();
+			if (interval_ns != 0) {
+				due_ns = result.start_ns + g * interval_ns;
+				wait_until(due_ns);
+			}
+			requests.clear();
+			for (size_t i = 0; i < batch; i++) {
+				Tarantool::write_put_request(requests, SPACE_ID,
+							     first_key + g * batch + i,
+							     g, 0);
+			}
+			if (Error error = m_master.exchange(requests, batch, buffer,
+							    responses); error)
+				return error;
+			ack_ns[g] = Timer::now_ns();
+			acked.store(g + 1, std::memory_order_release);
+			result.write_latencies_ns.push_back(ack_ns[g] - due_ns);
+			for (const auto &response: responses)
+				result.error_count += response.is_error();
+		}
+		return {};
+	}
+
+	/*
+	 * Select the @a key on the replica until it's there, the time of
+	 * the response showing it is stored into @a seen_ns.
+	 */
+	Error
+	poll(uint64_t key, uint64_t ack_ns, uint64_t &seen_ns, Result &result)
+	{
+		m_request.clear();
+		Tarantool::write_get_request(m_request, SPACE_ID, key, 0);
+		while (true) {
+			if (Error error = m_replica.exchange(m_request, 1, m_buffer,
+							     m_responses); error)
+				return error;
+			seen_ns = Timer::now_ns();
+			result.poll_count++;
+			const auto &response = m_responses[0];
+			if (response.is_error())
+				return Error_ResponseError(response.error_code(),
+							   response.error_message());
+			const char *data = response.data();
+			if (data == NULL)
+				return Error_ResponseBody();
+			if (mp_decode_array(&data) != 0)
+				return {};
+			if (seen_ns - ack_ns > CATCH_UP_TIMEOUT_NS)
+				return Error_ReplicaTimeout(key);
+		}
+	}
+
+	/* Sleep till close to the deadline, then spin. */
+	static void
+	wait_until(uint64_t deadline_ns)
+	{
+		while (true) {
+			const uint64_t now_ns = Timer::now_ns();
+			if (now_ns >= deadline_ns)
+				return;
+			if (deadline_ns - now_ns > 100000) {
+				const uint64_t ns = deadline_ns - now_ns - 50000;
+				const struct timespec pause = {
+					time_t(ns / 1000000000), long(ns % 1000000000)
+				};
+				nanosleep(&pause, NULL);
+			}
+		}
+	}
+
+private:
+	Tarantool m_master;
+	Tarantool m_replica;
+	uint64_t m_next_key;
+	/* The poll request and its response. */
+	std::vector<uint8_t> m_request;
+	std::vector<uint8_t> m_buffer;
+	std::vector<Tarantool::Response> m_responses;
+};
+
+/*
+ * Measure the lag of the @a replica behind the @a master at each batch
+ * size and rate of the @a settings, against the @a budget if it's given.
+ * The instances are launched with the @a script unless it's NULL.
+ */
+Error
+benchmark(const Net::Endpoint &master, const Net::Endpoint &replica,
+	  const char *script, const Sweep::Settings &settings,
+	  size_t write_count, const Slo::Target *budget,
+	  uint64_t sample_interval_ms, const char *results)
+{
+	/* Launch the master and then the replica following it. */
+	std::unique_ptr<Server> master_server;
+	std::unique_ptr<Server> replica_server;
+	if (script != NULL) {
+		master_server = std::make_unique<Server>(script, master);
+		if (Error error = master_server->start(); error)
+			return error;
+		replica_server = std::make_unique<Server>(script, replica,
+							  &master);
+		if (Error error = replica_server->start(); error)
+			return error;
+	}
+
+	Replication::Probe probe(master, replica);
+	std::unique_ptr<Sampler> sampler;
+	if (sample_interval_ms != 0) {
+		sampler = std::make_unique<Sampler>(replica,
+						    sample_interval_ms * 1000000,
+						    Replication::REPLICATION_INFO);
+	}
+	const uint64_t origin_ns = Timer::now_ns();
+	if (sampler)
+		sampler->start();
+	std::vector<Replication::Result> results_list;
+	for (size_t batch: settings.batches) {
+		for (size_t rate: settings.rates) {
+			Replication::Result result;
+			if (Error error = probe.run(batch, rate, write_count,
+						    result); error)
+				return error;
+			results_list.push_back(std::move(result));
+		}
+	}
+	if (sampler) {
+		if (Error error = sampler->stop(); error)
+			return Error_SamplerFailed(error);
+	}
+
+	/* Is the lag at the percentile within the staleness budget? */
+	using namespace Statistics;
+	auto within = [budget](const Replication::Result &r) {
+		return r.lags_ns.empty() ? false :
+		       percentile(r.lags_ns, budget->percentile) / 1000.0 <=
+		       budget->latency_us &&
+		       r.write_rps >= r.rate * Slo::KEEP_UP &&
+		       r.error_count <= budget->error_budget;
+	};
+
+	printf("Master: %s\n", master.name().c_str());
+	printf("Replica: %s\n", replica.name().c_str());
+	printf("Writes per run: %lu\n", write_count);
+	printf("%8s %10s %10s %8s %12s %8s %12s %12s %12s %12s%s\n",
+	       "Batch", "Rate", "Write RPS", "Errors", "Write 99%",
+	       "Samples", "Lag med", "Lag 99%", "Lag 99.9%", "Lag max",
+	       budget != NULL ? "   Budget" : "");
+	for (const auto &r: results_list) {
+		std::vector<uint64_t> write_ns = r.write_latencies_ns;
+		std::sort(write_ns.begin(), write_ns.end());
+		const bool empty = r.lags_ns.empty();
+		char rate[32] = "-";
+		if (r.rate != 0)
+			snprintf(rate, sizeof(rate), "%lu", r.rate);
+		printf("%8lu %10s %10.0f %8lu %12.3f %8lu %12.3f %12.3f %12.3f "
+		       "%12.3f%s\n", r.batch, rate, r.write_rps, r.error_count,
+		       write_ns.empty() ? 0 : percentile(write_ns, 0.99) / 1000.0,
+		       r.lags_ns.size(),
+		       empty ? 0 : median(r.lags_ns) / 1000.0,
+		       empty ? 0 : percentile(r.lags_ns, 0.99) / 1000.0,
+		       empty ? 0 : percentile(r.lags_ns, 0.999) / 1000.0,
+		       empty ? 0 : r.lags_ns.back() / 1000.0,
+		       budget == NULL ? "" : within(r) ? "      yes" : "       no");
+	}
+	printf("Latencies are in μs.\n");
+
+	/* The highest rate within the budget per batch size. */
+	std::vector<size_t> max_rates;
+	for (size_t i = 0; budget != NULL && i < settings.batches.size(); i++) {
+		size_t max_rate = 0;
+		for (size_t j = 0; j < settings.rates.size(); j++) {
+			const auto &r = results_list[i * settings.rates.size() + j];
+			if (within(r))
+				max_rate = std::max(max_rate, size_t(r.write_rps));
+		}
+		max_rates.push_back(max_rate);
+		printf("Batch %lu, highest write RPS within the budget: ",
+		       settings.batches[i]);
+		if (max_rate != 0)
+			printf("%lu\n", max_rate);
+		else
+			printf("none\n");
+	}
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("master");
+		json.value(master.name());
+		json.key("replica");
+		json.value(replica.name());
+		json.key("writes_per_run");
+		json.value(uint64_t(write_count));
+		if (budget != NULL) {
+			json.key("budget");
+			json.begin_object();
+			json.key("percentile");
+			json.value(budget->percentile);
+			json.key("lag_us");
+			json.value(budget->latency_us);
+			json.key("max_write_rps");
+			json.begin_array();
+			for (size_t rate: max_rates)
+				json.value(uint64_t(rate));
+			json.end_array();
+			json.end_object();
+		}
+		json.key("runs");
+		json.begin_array();
+		for (const auto &r: results_list) {
+			const bool empty = r.lags_ns.empty();
+			json.begin_object();
+			json.key("batch");
+			json.value(uint64_t(r.batch));
+			json.key("rate");
+			json.value(uint64_t(r.rate));
+			json.key("t");
+			json.value(double(r.start_ns - origin_ns) / 1e9);
+			json.key("duration_s");
+			json.value(double(r.end_ns - r.start_ns) / 1e9);
+			json.key("write_rps");
+			json.value(r.write_rps);
+			json.key("errors");
+			json.value(r.error_count);
+			json.key("samples");
+			json.value(uint64_t(r.lags_ns.size()));
+			json.key("polls");
+			json.value(r.poll_count);
+			json.key("lag_med_us");
+			json.value(empty ? 0 : median(r.lags_ns) / 1000.0);
+			json.key("lag_p99_us");
+			json.value(empty ? 0 : percentile(r.lags_ns, 0.99) / 1000.0);
+			json.key("lag_p999_us");
+			json.value(empty ? 0 : percentile(r.lags_ns, 0.999) / 1000.0);
+			json.key("lag_max_us");
+			json.value(empty ? 0 : r.lags_ns.back() / 1000.0);
+			json.end_object();
+		}
+		json.end_array();
+
+		/* box.info.replication of the replica during the runs. */
+		json.key("replica_info");
+		json.begin_array();
+		for (size_t i = 0; sampler && i < sampler->samples().size(); i++) {
+			const auto &sample = sampler->samples()[i];
+			const char *data = (const char *)sample.data.data();
+			json.begin_object();
+			json.key("t");
+			json.value(double(sample.time_ns - origin_ns) / 1e9);
+			json.key("replication");
+			json.msgpack(&data);
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Replication
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "Json.hpp"
+#include "Statistics.hpp"
+#include "Tarantool.hpp"
+
+/* The pieces of the output the benchmark modes share. */
+namespace Report {
+
+/*
+ * Print the count of the @a errors under the @a title and then each of
+ * the codes with the messages sampled. The share of the errors among
+ * the @a request_count is printed too unless it's zero.
+ */
+inline void
+print_errors(const Tarantool::ErrorStats &errors,
+	     const char *title = "Errors", const char *code_name = "Error",
+	     size_t request_count = 0)
+{
+	printf("%s: %lu", title, errors.count);
+	if (request_count != 0)
+		printf(" (%.2f%%)", 100.0 * errors.count / request_count);
+	printf("\n");
+	for (const auto &[code, c]: errors.codes) {
+		printf("%s %u: %lu\n", code_name, code, c.count);
+		for (const auto &message: c.samples)
+			printf("  %s\n", message.c_str());
+	}
+}
+
+/* Write the latencies of the sorted non-empty @a latencies_ns, in μs. */
+inline void
+write_latencies(Json::Writer &json, const std::vector<uint64_t> &latencies_ns)
+{
+	using namespace Statistics;
+	json.key("avg_us");
+	json.value(average(latencies_ns) / 1000.0);
+	json.key("med_us");
+	json.value(median(latencies_ns) / 1000.0);
+	json.key("p99_us");
+	json.value(percentile(latencies_ns, 0.99) / 1000.0);
+	json.key("p999_us");
+	json.value(percentile(latencies_ns, 0.999) / 1000.0);
+}
+
+/* Write the throughput and the latencies of a run @a r, e.g. a point. */
+template <class Result>
+void
+write_latencies(Json::Writer &json, const Result &r)
+{
+	json.key("rps");
+	json.value(r.rps);
+	json.key("errors");
+	json.value(r.error_count);
+	json.key("med_us");
+	json.value(r.med_us);
+	json.key("p99_us");
+	json.value(r.p99_us);
+	json.key("p999_us");
+	json.value(r.p999_us);
+}
+
+} // namespace Report
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+/*
+ * A bounded buffer the responses are received into and consumed from
+ * while the requests of the same transfer are still being sent. The
+ * unconsumed bytes are moved to the beginning when the space at the
+ * end runs out, so a response is always contiguous. The buffer only
+ * grows if a single response does not fit into it.
+ */
+class ResponseBuffer {
+	std::vector<uint8_t> m_data;
+	/* The unconsumed bytes are [m_head, m_tail). */
+	size_t m_head;
+	size_t m_tail;
+
+public:
+	ResponseBuffer(size_t capacity)
+	: m_data(capacity)
+	, m_head(0)
+	, m_tail(0)
+	{}
+
+	void
+	reset(size_t capacity)
+	{
+		m_data.resize(capacity);
+		m_data.shrink_to_fit();
+		clear();
+	}
+
+	void
+	clear()
+	{
+		m_head = 0;
+		m_tail = 0;
+	}
+
+	size_t
+	capacity() const
+	{
+		return m_data.size();
+	}
+
+	/* The free space to receive into. */
+	uint8_t *
+	tail()
+	{
+		return m_data.data() + m_tail;
+	}
+
+	size_t
+	available() const
+	{
+		return m_data.size() - m_tail;
+	}
+
+	void
+	produce(size_t size)
+	{
+		m_tail += size;
+	}
+
+	/* The received but not consumed bytes. */
+	const uint8_t *
+	head() const
+	{
+		return m_data.data() + m_head;
+	}
+
+	size_t
+	used() const
+	{
+		return m_tail - m_head;
+	}
+
+	void
+	consume(size_t size)
+	{
+		m_head += size;
+		if (m_head == m_tail)
+			clear();
+	}
+
+	/*
+	 * Make room for the unconsumed bytes to be followed by at least
+	 * @a size contiguous bytes in total.
+	 */
+	void
+	reserve(size_t size)
+	{
+		if (m_head != 0) {
+			memmove(m_data.data(), m_data.data() + m_head, used());
+			m_tail -= m_head;
+			m_head = 0;
+		}
+		if (m_data.size() < size)
+			m_data.resize(size);
+	}
+};
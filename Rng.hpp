@@ -2,11 +2,95 @@
 
 namespace Rng {
 
+/* Each thread has its own generator state. */
+thread_local uint32_t state = 1;
+
+/* Seed the generator of the calling thread. */
+void
+seed(uint32_t value)
+{
+	/* The state must be within [1, 0x7ffffffe]. */
+	state = value % 0x7ffffffe + 1;
+}
+
 uint32_t
 u32()
 {
-	static uint32_t state = 1;
 	return state = (uint64_t)state * 48271 % 0x7fffffff;
 }
 
+/* A random 64-bit number. */
+uint64_t
+u64()
+{
+	return uint64_t(u32()) << 33 ^ uint64_t(u32()) << 16 ^ u32();
+}
+
+/*
+ * A random permutation of [0, size) computed value by value, so even a
+ * shuffle of billions takes no memory: a Feistel network permutes the
+ * smallest power of 4 covering the size, the values beyond the size are
+ * permuted again until they fall into it (cycle walking).
+ */
+class Permutation {
+public:
+	Permutation() = default;
+
+	explicit Permutation(uint64_t size)
+	: m_size(size)
+	{
+		while (m_half_bits < 32 &&
+		       uint64_t(1) << (2 * m_half_bits) < size)
+			m_half_bits++;
+		for (auto &key: m_keys)
+			key = u64();
+	}
+
+	uint64_t
+	size() const
+	{
+		return m_size;
+	}
+
+	/* The value at the position @a i. */
+	uint64_t
+	operator()(uint64_t i) const
+	{
+		assert(i < m_size);
+		do {
+			i = encrypt(i);
+		} while (i >= m_size);
+		return i;
+	}
+
+private:
+	uint64_t
+	encrypt(uint64_t value) const
+	{
+		const uint64_t mask = (uint64_t(1) << m_half_bits) - 1;
+		uint64_t left = value >> m_half_bits;
+		uint64_t right = value & mask;
+		for (uint64_t key: m_keys) {
+			const uint64_t next = left ^ (mix(right ^ key) & mask);
+			left = right;
+			right = next;
+		}
+		return left << m_half_bits | right;
+	}
+
+	/* The splitmix64 finalizer. */
+	static uint64_t
+	mix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+private:
+	uint64_t m_size = 0;
+	unsigned m_half_bits = 1;
+	uint64_t m_keys[4] = {};
+};
+
 } // namespace Rng
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Periodically evaluates an expression on the server using its own
+ * connection and thread, so the load path is never blocked by it.
+ */
+class Sampler {
+public:
+	/* The expression sampling the server-side metrics by default. */
+	static constexpr const char *SERVER_METRICS =
+		"return {stat = box.stat(), net = box.stat.net(), "
+		"slab = box.slab.info(), memory = box.info.memory()}";
+
+	struct Sample {
+		/* CLOCK_MONOTONIC time the sample was requested at. */
+		uint64_t time_ns;
+		/* The first value returned by the expression (MsgPack). */
+		std::vector<uint8_t> data;
+	};
+
+	Sampler(const Net::Endpoint &endpoint, uint64_t interval_ns,
+		const char *expression = SERVER_METRICS)
+	: m_tt(endpoint)
+	, m_interval_ns(interval_ns)
+	, m_stop(false)
+	{
+		Tarantool::write_eval_request(m_request, expression);
+	}
+
+	~Sampler()
+	{
+		stop();
+	}
+
+	void
+	start()
+	{
+		m_stop = false;
+		m_thread = std::thread(&Sampler::loop, this);
+	}
+
+	/* Stop sampling. Returns the error occurred while sampling. */
+	Error
+	stop()
+	{
+		if (!m_thread.joinable())
+			return {};
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_one();
+		m_thread.join();
+		return std::move(m_error);
+	}
+
+	const std::vector<Sample> &
+	samples() const
+	{
+		return m_samples;
+	}
+
+private:
+	void
+	loop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto deadline = std::chrono::steady_clock::now();
+		while (!m_stop) {
+			/* Don't hold the lock while talking to the server. */
+			lock.unlock();
+			Error error = sample();
+			lock.lock();
+			if (error) {
+				m_error = std::move(error);
+				return;
+			}
+			deadline += std::chrono::nanoseconds(m_interval_ns);
+			m_cond.wait_until(lock, deadline, [this] { return m_stop; });
+		}
+	}
+
+	Error
+	sample()
+	{
+		Sample sample;
+		sample.time_ns = Timer::now_ns();
+		if (Error error = m_tt.exchange(m_request, 1, m_buffer,
+						m_responses); error)
+			return error;
+		const Tarantool::Response &response = m_responses[0];
+		if (response.is_error())
+			return Error_ResponseError(response.error_code(),
+						   response.error_message());
+		const char *data = response.data();
+		if (data == NULL || mp_decode_array(&data) == 0)
+			return Error_ResponseBody();
+		const char *end = data;
+		mp_next(&end);
+		sample.data.assign(data, end);
+		m_samples.push_back(std::move(sample));
+		return {};
+	}
+
+private:
+	Tarantool m_tt;
+	uint64_t m_interval_ns;
+
+	/* The packed eval request reused by all the samples. */
+	std::vector<uint8_t> m_request;
+	std::vector<uint8_t> m_buffer;
+	std::vector<Tarantool::Response> m_responses;
+
+	std::vector<Sample> m_samples;
+	Error m_error;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_stop;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <ftw.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * A Tarantool instance launched locally: the script (script.lua) is run
+ * by the tarantool binary ($TARANTOOL or the one found in PATH) with the
+ * environment telling it where to listen, where to keep its files and
+ * which master to follow. The files are kept in a temporary directory,
+ * so a restarted instance recovers the same data, and the directory is
+ * removed with the server unless the instance failed to start, then its
+ * log is left there.
+ */
+class Server {
+public:
+	/* The time the instance is given to accept connections. */
+	static constexpr uint64_t START_TIMEOUT_NS = 600 * 1000000000ULL;
+
+	/*
+	 * The instance listening at the @a endpoint, a replica of the
+	 * @a master if it's given.
+	 */
+	Server(const char *script, const Net::Endpoint &endpoint,
+	       const Net::Endpoint *master = NULL)
+	: m_script(script)
+	, m_endpoint(endpoint)
+	, m_master(master != NULL ? uri(*master) : "")
+	, m_pid(-1)
+	, m_keep(false)
+	{
+		const char *tmp = getenv("TMPDIR");
+		std::string dir = std::string(tmp != NULL ? tmp : "/tmp") +
+				  "/ttbench-XXXXXX";
+		if (mkdtemp(dir.data()) == NULL)
+			Log::fatal_error("Couldn't create a directory for "
+					 "the instance at %s", dir.c_str());
+		m_dir = std::move(dir);
+	}
+
+	~Server()
+	{
+		stop(SIGKILL);
+		if (!m_keep) {
+			nftw(m_dir.c_str(), [](const char *path,
+					       const struct stat *, int,
+					       struct FTW *) {
+				return remove(path);
+			}, 16, FTW_DEPTH | FTW_PHYS);
+		}
+	}
+
+	Server(const Server &) = delete;
+	Server &operator=(const Server &) = delete;
+
+	const Net::Endpoint &
+	endpoint() const
+	{
+		return m_endpoint;
+	}
+
+	/* Pass the variable to the script, e.g. to configure the instance. */
+	void
+	set_env(const char *name, const std::string &value)
+	{
+		m_env.emplace_back(name, value);
+	}
+
+	/* The directory the instance keeps its files (and log) in. */
+	const std::string &
+	dir() const
+	{
+		return m_dir;
+	}
+
+	/*
+	 * Start the instance and wait until it sends the greeting. The
+	 * time it took is stored into @a elapsed_ns if it's given.
+	 */
+	Error
+	start(uint64_t *elapsed_ns = NULL)
+	{
+		assert(m_pid < 0);
+		const uint64_t start_ns = Timer::now_ns();
+		const std::string log = m_dir + "/tarantool.log";
+		const char *binary = getenv("TARANTOOL");
+		if (binary == NULL)
+			binary = "tarantool";
+		m_pid = fork();
+		if (m_pid < 0)
+			return Error_System("Can't fork the instance.");
+		if (m_pid == 0) {
+			/* The shell-specified socket is for the main instance. */
+			unsetenv("TTBENCH_SOCKET");
+			setenv("TTBENCH_LISTEN", uri(m_endpoint).c_str(), 1);
+			setenv("TTBENCH_DIR", m_dir.c_str(), 1);
+			if (!m_master.empty())
+				setenv("TTBENCH_REPLICATION", m_master.c_str(), 1);
+			for (const auto &[name, value]: m_env)
+				setenv(name.c_str(), value.c_str(), 1);
+			const int fd = open(log.c_str(),
+					    O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if (fd >= 0) {
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+				close(fd);
+			}
+			execlp(binary, binary, m_script.c_str(), (char *)NULL);
+			perror("Couldn't run tarantool");
+			_exit(127);
+		}
+
+		/* Wait for the greeting, the instance may exit instead. */
+		const Net::Address address = Net::resolve(m_endpoint);
+		while (true) {
+			int status;
+			if (waitpid(m_pid, &status, WNOHANG) == m_pid) {
+				m_pid = -1;
+				m_keep = true;
+				return Error_Server(m_script.c_str(), "exited",
+						    log.c_str());
+			}
+			const int fd = Net::try_connect(address);
+			if (fd >= 0) {
+				Tarantool tt(fd);
+				if (!tt.read_greeting())
+					break;
+			}
+			if (Timer::now_ns() - start_ns > START_TIMEOUT_NS) {
+				stop(SIGKILL);
+				m_keep = true;
+				return Error_Server(m_script.c_str(), "timed out",
+						    log.c_str());
+			}
+			const struct timespec pause = {0, 1000000};
+			nanosleep(&pause, NULL);
+		}
+		if (elapsed_ns != NULL)
+			*elapsed_ns = Timer::now_ns() - start_ns;
+		return {};
+	}
+
+	/*
+	 * Stop the instance with the @a signal and wait for it to exit,
+	 * SIGKILL makes a crash.
+	 */
+	void
+	stop(int signal = SIGTERM)
+	{
+		if (m_pid < 0)
+			return;
+		kill(m_pid, signal);
+		waitpid(m_pid, NULL, 0);
+		m_pid = -1;
+	}
+
+private:
+	/* The URI of the endpoint as box.cfg takes it. */
+	static std::string
+	uri(const Net::Endpoint &endpoint)
+	{
+		if (endpoint.is_unix())
+			return "unix/:" + endpoint.host;
+		return endpoint.host + ":" + std::to_string(endpoint.port);
+	}
+
+private:
+	std::string m_script;
+	Net::Endpoint m_endpoint;
+	/* The URI of the master to follow, empty for a master. */
+	std::string m_master;
+	std::string m_dir;
+	/* The variables set for the script besides the ones above. */
+	std::vector<std::pair<std::string, std::string>> m_env;
+	pid_t m_pid;
+	/* Keep the directory for the log of a failed start. */
+	bool m_keep;
+};
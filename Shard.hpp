@@ -0,0 +1,465 @@
+#pragma once
+
+#include <barrier>
+#include <memory>
+#include <thread>
+
+#include "Data.hpp"
+#include "Payload.hpp"
+#include "Report.hpp"
+#include "Statistics.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Client-side sharding: each generated request is routed to one of the
+ * instances by the bucket of its key, computed the way the default
+ * bucket_id_strcrc32() of vshard does. The buckets are split between
+ * the instances in contiguous ranges, as vshard bootstraps them, and
+ * each instance has its own connections sending the requests routed to
+ * it within their own in-flight windows.
+ */
+namespace Shard {
+
+/* The default bucket count of vshard. */
+constexpr size_t BUCKET_COUNT = 3000;
+
+/*
+ * Append tostring() of the MsgPack @a value as Lua shows it: numbers
+ * exactly representable by a double are formatted by "%.14g", larger
+ * integers are 64-bit cdata with a suffix. Returns false if the type
+ * of the value isn't supported as a key.
+ */
+inline bool
+append_tostring(const char **value, std::string &out)
+{
+	char buffer[32];
+	switch (mp_typeof(**value)) {
+	case MP_UINT: {
+		const uint64_t u = mp_decode_uint(value);
+		if (u < (1ULL << 53))
+			snprintf(buffer, sizeof(buffer), "%.14g", (double)u);
+		else
+			snprintf(buffer, sizeof(buffer), "%luULL", u);
+		break;
+	}
+	case MP_INT: {
+		const int64_t i = mp_decode_int(value);
+		if (i >= -(1LL << 53))
+			snprintf(buffer, sizeof(buffer), "%.14g", (double)i);
+		else
+			snprintf(buffer, sizeof(buffer), "%ldLL", i);
+		break;
+	}
+	case MP_FLOAT:
+		snprintf(buffer, sizeof(buffer), "%.14g", mp_decode_float(value));
+		break;
+	case MP_DOUBLE:
+		snprintf(buffer, sizeof(buffer), "%.14g", mp_decode_double(value));
+		break;
+	case MP_BOOL:
+		snprintf(buffer, sizeof(buffer), "%s",
+			 mp_decode_bool(value) ? "true" : "false");
+		break;
+	case MP_STR: {
+		uint32_t len;
+		const char *str = mp_decode_str(value, &len);
+		out.append(str, len);
+		return true;
+	}
+	default:
+		return false;
+	}
+	out.append(buffer);
+	return true;
+}
+
+/*
+ * The bucket of the first part of the key or of the tuple of the packed
+ * @a request, 1-based as in vshard. Zero if the request has no key or
+ * the key isn't supported.
+ */
+inline size_t
+bucket_id(const uint8_t *request, size_t bucket_count)
+{
+	const char *data = Tarantool::first_key_part(request);
+	std::string key_string;
+	if (data == NULL || !append_tostring(&data, key_string))
+		return 0;
+	const uint32_t crc = Data::update_crc32c(0xFFFFFFFF, key_string.data(),
+						 key_string.size());
+	return crc % bucket_count + 1;
+}
+
+/* The measurements of the requests routed to an instance. */
+struct InstanceResult {
+	Net::Endpoint endpoint;
+	size_t bucket_count = 0;
+	size_t request_count = 0;
+	double rps = 0;
+	uint64_t error_count = 0;
+	double med_us = 0;
+	double p99_us = 0;
+	double p999_us = 0;
+};
+
+/* The measurements of a run over a number of the instances. */
+struct Result {
+	size_t instance_count = 0;
+	double rps = 0;
+	uint64_t error_count = 0;
+	double med_us = 0;
+	double p99_us = 0;
+	double p999_us = 0;
+	/* The most loaded instance against the average one by requests. */
+	double imbalance = 0;
+	std::vector<InstanceResult> instances;
+};
+
+/* The instances, their connections and the routed requests. */
+class Cluster {
+public:
+	Cluster(const std::vector<Net::Endpoint> &endpoints,
+		size_t connection_count, size_t response_buffer_size)
+	: m_endpoints(endpoints)
+	{
+		for (const auto &endpoint: endpoints) {
+			auto &connections = m_connections.emplace_back();
+			for (size_t i = 0; i < connection_count; i++) {
+				connections.push_back(
+					std::make_unique<Tarantool>(endpoint));
+				connections.back()->set_response_buffer_size(
+					response_buffer_size);
+			}
+		}
+	}
+
+	Error
+	set_busy_poll(int usec)
+	{
+		for (auto &connections: m_connections) {
+			for (auto &tt: connections) {
+				if (Error error = tt->set_busy_poll(usec); error)
+					return error;
+			}
+		}
+		return {};
+	}
+
+	size_t
+	instance_count() const
+	{
+		return m_endpoints.size();
+	}
+
+	/*
+	 * Generate the @a request_count requests and find the bucket of
+	 * each one among the @a bucket_count buckets.
+	 */
+	Error
+	generate(Payload &payload, const char *request_name,
+		 size_t request_count, size_t bucket_count)
+	{
+		Tarantool::TransferGenerator tg(*m_connections[0][0], payload,
+						request_name, request_count);
+		auto transfer = tg.next();
+		if (!transfer)
+			return Error_BatchBuild(transfer.error(), 0UL);
+		m_requests = std::move(transfer->request_batch);
+		m_response_sizes = std::move(transfer->response_sizes);
+		m_bucket_count = bucket_count;
+		m_offsets.resize(request_count + 1);
+		m_buckets.resize(request_count);
+		for (size_t i = 0; i < request_count; i++) {
+			const uint8_t *request = &m_requests[m_offsets[i]];
+			m_offsets[i + 1] = m_offsets[i] + 5 +
+					   Data::get_uint32_be(request + 1);
+			m_buckets[i] = bucket_id(request, bucket_count);
+			if (m_buckets[i] == 0)
+				return Error_ShardKey(request_name);
+		}
+		return {};
+	}
+
+	/*
+	 * Send all the requests routed to the first @a instance_count
+	 * instances in groups of @a batch with up to @a depth of them in
+	 * flight per connection.
+	 */
+	Error
+	run(size_t instance_count, size_t batch, size_t depth, Result &result)
+	{
+		assert(instance_count <= m_endpoints.size());
+		/* Route the requests and split them between the connections. */
+		std::vector<std::vector<size_t>> routed(instance_count);
+		for (size_t i = 0; i < m_buckets.size(); i++)
+			routed[instance(m_buckets[i], instance_count)].push_back(i);
+		struct Job {
+			size_t instance;
+			Tarantool *tt;
+			Tarantool::Transfer transfer;
+		};
+		std::vector<Job> jobs;
+		for (size_t i = 0; i < instance_count; i++) {
+			const auto &requests = routed[i];
+			const size_t count = m_connections[i].size();
+			for (size_t j = 0, first = 0; j < count; j++) {
+				const size_t n = requests.size() / count +
+						 (j < requests.size() % count);
+				if (n != 0) {
+					jobs.push_back({i, m_connections[i][j].get(),
+							gather(requests, first, n)});
+				}
+				first += n;
+			}
+		}
+
+		uint64_t start_ns = 0;
+		std::barrier ready(jobs.size(), [&start_ns]() noexcept {
+			start_ns = Timer::now_ns();
+		});
+		std::vector<std::vector<uint64_t>> latencies_ns(jobs.size());
+		std::vector<uint64_t> end_ns(jobs.size());
+		std::vector<uint64_t> error_counts(jobs.size());
+		std::vector<Error> errors(jobs.size());
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			threads.emplace_back([&, i] {
+				Tarantool &tt = *jobs[i].tt;
+				const uint64_t error_count = tt.errors().count;
+				ready.arrive_and_wait();
+				errors[i] = tt.execute_window(jobs[i].transfer,
+							      batch, depth,
+							      start_ns, 0,
+							      latencies_ns[i]);
+				end_ns[i] = Timer::now_ns();
+				error_counts[i] = tt.errors().count - error_count;
+			});
+		}
+		for (auto &thread: threads)
+			thread.join();
+
+		/* Sum up each instance and then the whole cluster. */
+		result = {};
+		result.instance_count = instance_count;
+		result.instances.resize(instance_count);
+		std::vector<std::vector<uint64_t>> instance_ns(instance_count);
+		std::vector<uint64_t> instance_end_ns(instance_count, start_ns);
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (errors[i])
+				return std::move(errors[i]);
+			const size_t k = jobs[i].instance;
+			instance_ns[k].insert(instance_ns[k].end(),
+					      latencies_ns[i].begin(),
+					      latencies_ns[i].end());
+			instance_end_ns[k] = std::max(instance_end_ns[k], end_ns[i]);
+			result.instances[k].error_count += error_counts[i];
+		}
+		std::vector<uint64_t> all_ns;
+		uint64_t cluster_end_ns = start_ns;
+		size_t max_request_count = 0;
+		for (size_t k = 0; k < instance_count; k++) {
+			auto &r = result.instances[k];
+			r.endpoint = m_endpoints[k];
+			r.bucket_count = first_bucket(k + 1, instance_count) -
+					 first_bucket(k, instance_count);
+			r.request_count = instance_ns[k].size();
+			summarize(instance_ns[k], instance_end_ns[k] - start_ns, r);
+			all_ns.insert(all_ns.end(), instance_ns[k].begin(),
+				      instance_ns[k].end());
+			cluster_end_ns = std::max(cluster_end_ns,
+						  instance_end_ns[k]);
+			max_request_count = std::max(max_request_count,
+						     r.request_count);
+			result.error_count += r.error_count;
+		}
+		summarize(all_ns, cluster_end_ns - start_ns, result);
+		result.imbalance = (double)max_request_count * instance_count /
+				   all_ns.size();
+		return {};
+	}
+
+private:
+	/*
+	 * The first bucket of the @a k-th of the @a instance_count
+	 * instances, the remainder goes to the first ones.
+	 */
+	size_t
+	first_bucket(size_t k, size_t instance_count) const
+	{
+		return 1 + k * (m_bucket_count / instance_count) +
+		       std::min(k, m_bucket_count % instance_count);
+	}
+
+	/* The instance owning the @a bucket. */
+	size_t
+	instance(size_t bucket, size_t instance_count) const
+	{
+		size_t k = (bucket - 1) * instance_count / m_bucket_count;
+		while (bucket >= first_bucket(k + 1, instance_count))
+			k++;
+		while (bucket < first_bucket(k, instance_count))
+			k--;
+		return k;
+	}
+
+	/* A copy of @a count of the @a requests from the @a first one. */
+	Tarantool::Transfer
+	gather(const std::vector<size_t> &requests, size_t first,
+	       size_t count) const
+	{
+		std::vector<uint8_t> batch;
+		std::vector<size_t> response_sizes;
+		for (size_t i = first; i < first + count; i++) {
+			const size_t r = requests[i];
+			batch.insert(batch.end(), m_requests.begin() + m_offsets[r],
+				     m_requests.begin() + m_offsets[r + 1]);
+			if (!m_response_sizes.empty())
+				response_sizes.push_back(m_response_sizes[r]);
+		}
+		if (m_response_sizes.empty())
+			return Tarantool::Transfer(std::move(batch), count);
+		return Tarantool::Transfer(std::move(batch),
+					   std::move(response_sizes));
+	}
+
+	/* Sort the latencies and fill the statistics of the @a result. */
+	template<class Summary>
+	static void
+	summarize(std::vector<uint64_t> &latencies_ns, uint64_t duration_ns,
+		  Summary &result)
+	{
+		if (latencies_ns.empty())
+			return;
+		std::sort(latencies_ns.begin(), latencies_ns.end());
+		using namespace Statistics;
+		result.rps = latencies_ns.size() / (duration_ns / 1000000000.0);
+		result.med_us = median(latencies_ns) / 1000.0;
+		result.p99_us = percentile(latencies_ns, 0.99) / 1000.0;
+		result.p999_us = percentile(latencies_ns, 0.999) / 1000.0;
+	}
+
+private:
+	std::vector<Net::Endpoint> m_endpoints;
+	/* The connections to each of the instances. */
+	std::vector<std::vector<std::unique_ptr<Tarantool>>> m_connections;
+	/* The packed requests and the offset of each one. */
+	std::vector<uint8_t> m_requests;
+	std::vector<size_t> m_offsets;
+	/* Empty if the response sizes are unknown. */
+	std::vector<size_t> m_response_sizes;
+	/* The bucket of each request. */
+	std::vector<uint32_t> m_buckets;
+	size_t m_bucket_count = BUCKET_COUNT;
+};
+
+/*
+ * Route the requests to the @a endpoints by the buckets and report each
+ * of the instances, with the instances added one by one if @a scaling.
+ */
+inline Error
+benchmark(const std::vector<Net::Endpoint> &endpoints, Payload &payload,
+	  const char *request_name, size_t request_count, size_t batch,
+	  size_t depth, size_t connection_count, size_t bucket_count,
+	  bool scaling, int busy_poll_us, size_t response_buffer_size,
+	  const char *results)
+{
+	Shard::Cluster cluster(endpoints, connection_count,
+			       response_buffer_size);
+	if (busy_poll_us != 0) {
+		if (Error error = cluster.set_busy_poll(busy_poll_us); error)
+			return error;
+	}
+	if (Error error = cluster.generate(payload, request_name,
+					   request_count, bucket_count); error)
+		return error;
+
+	/* The scaling curve adds the instances one by one. */
+	std::vector<Shard::Result> runs;
+	for (size_t n = scaling ? 1 : endpoints.size(); n <= endpoints.size();
+	     n++) {
+		Shard::Result result;
+		if (Error error = cluster.run(n, batch, depth, result); error)
+			return error;
+		runs.push_back(std::move(result));
+	}
+	const Shard::Result &all = runs.back();
+
+	printf("Request: %s\n", request_name);
+	printf("Instances: %lu\n", endpoints.size());
+	printf("Buckets: %lu\n", bucket_count);
+	printf("Batch size: %lu\n", batch);
+	printf("Depth: %lu\n", depth);
+	printf("Connections per instance: %lu\n", connection_count);
+	printf("%-24s %8s %10s %10s %8s %10s %10s %10s\n",
+	       "Instance", "Buckets", "Requests", "RPS", "Errors",
+	       "Med (μs)", "99% (μs)", "99.9% (μs)");
+	for (const auto &r: all.instances) {
+		printf("%-24s %8lu %10lu %10.0f %8lu %10.3f %10.3f %10.3f\n",
+		       r.endpoint.name().c_str(), r.bucket_count,
+		       r.request_count, r.rps, r.error_count, r.med_us,
+		       r.p99_us, r.p999_us);
+	}
+	printf("%-24s %8lu %10lu %10.0f %8lu %10.3f %10.3f %10.3f\n",
+	       "total", bucket_count, request_count, all.rps,
+	       all.error_count, all.med_us, all.p99_us, all.p999_us);
+	printf("Imbalance: %.3f\n", all.imbalance);
+	if (scaling) {
+		printf("%10s %10s %10s %10s %10s %10s\n", "Instances", "RPS",
+		       "Speedup", "Imbalance", "Med (μs)", "99% (μs)");
+		for (const auto &r: runs) {
+			printf("%10lu %10.0f %10.2f %10.3f %10.3f %10.3f\n",
+			       r.instance_count, r.rps, r.rps / runs[0].rps,
+			       r.imbalance, r.med_us, r.p99_us);
+		}
+	}
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("request");
+		json.value(request_name);
+		json.key("requests");
+		json.value(uint64_t(request_count));
+		json.key("buckets");
+		json.value(uint64_t(bucket_count));
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("depth");
+		json.value(uint64_t(depth));
+		json.key("connections_per_instance");
+		json.value(uint64_t(connection_count));
+		json.key("runs");
+		json.begin_array();
+		for (const auto &r: runs) {
+			json.begin_object();
+			json.key("instance_count");
+			json.value(uint64_t(r.instance_count));
+			Report::write_latencies(json, r);
+			json.key("imbalance");
+			json.value(r.imbalance);
+			json.key("instances");
+			json.begin_array();
+			for (const auto &s: r.instances) {
+				json.begin_object();
+				json.key("endpoint");
+				json.value(s.endpoint.name());
+				json.key("buckets");
+				json.value(uint64_t(s.bucket_count));
+				json.key("requests");
+				json.value(uint64_t(s.request_count));
+				Report::write_latencies(json, s);
+				json.end_object();
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Shard
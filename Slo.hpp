@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Report.hpp"
+#include "Sweep.hpp"
+
+/*
+ * Search for the highest offered rate the server sustains while the
+ * latency at a percentile stays within the SLO. The bound is the
+ * throughput of the requests sent at will, then the rate is searched
+ * by bisection. Each step is run several times and only passes if all
+ * of the runs keep within the SLO, so a step passing by chance doesn't
+ * move the search up.
+ */
+namespace Slo {
+
+/* The share of the offered rate a passing run must achieve. */
+constexpr double KEEP_UP = 0.95;
+
+/* The search stops once the range is within this share of the bound. */
+constexpr double PRECISION = 0.02;
+
+constexpr size_t MAX_STEP_COUNT = 20;
+
+struct Target {
+	/* E.g. 0.99 for the 99th percentile. */
+	double percentile = 0;
+	double latency_us = 0;
+	/* Runs of each step. */
+	size_t run_count = 3;
+	/* Error responses a passing run may get. */
+	uint64_t error_budget = 0;
+};
+
+/* A rate tried and the runs made at it. */
+struct Step {
+	/* Zero for the requests sent at will. */
+	size_t rate;
+	std::vector<Sweep::Result> runs;
+	bool pass;
+};
+
+struct Outcome {
+	std::vector<Step> steps;
+	/* The highest rate passed, zero if none did. */
+	size_t rate = 0;
+	/* The step that passed at the rate. */
+	const Step *step = NULL;
+};
+
+/*
+ * Does the run keep within the SLO? At a set rate it also has to keep
+ * up with the rate, otherwise the requests are queued in the client.
+ * The errors are answered fast, so they fail the run beyond the budget.
+ */
+inline bool
+passes(const Sweep::Result &result, const Target &target)
+{
+	return result.percentile_us <= target.latency_us &&
+	       result.rps >= result.point.rate * KEEP_UP &&
+	       result.error_count <= target.error_budget;
+}
+
+/*
+ * Find the sustainable rate for the batch size and the connection
+ * count of the @a point. The window is unbounded, so the requests
+ * are sent at the rate whatever the latency is.
+ */
+Error
+search(Sweep::Runner &runner, const Sweep::Point &point,
+       const Target &target, Outcome &outcome)
+{
+	auto step = [&](size_t rate) -> Error {
+		Step s = {rate, {}, true};
+		for (size_t i = 0; i < target.run_count; i++) {
+			const Sweep::Point p = {point.batch,
+						point.connection_count,
+						Sweep::UNBOUNDED, rate};
+			Sweep::Result result;
+			if (Error error = runner.run(p, result,
+						     target.percentile); error)
+				return error;
+			s.pass = s.pass && passes(result, target);
+			s.runs.push_back(result);
+		}
+		outcome.steps.push_back(std::move(s));
+		return {};
+	};
+
+	/* The throughput of the requests sent at will bounds the rate. */
+	if (Error error = step(0); error)
+		return error;
+	double bound = outcome.steps.back().runs[0].rps;
+	for (const auto &run: outcome.steps.back().runs)
+		bound = std::min(bound, run.rps);
+	size_t low = 0;
+	size_t high = bound;
+	if (outcome.steps.back().pass)
+		low = high;
+
+	while (high - low > PRECISION * bound &&
+	       outcome.steps.size() < MAX_STEP_COUNT) {
+		const size_t rate = low + (high - low) / 2;
+		if (rate == 0)
+			break;
+		if (Error error = step(rate); error)
+			return error;
+		if (outcome.steps.back().pass)
+			low = rate;
+		else
+			high = rate;
+	}
+
+	outcome.rate = low;
+	for (const auto &s: outcome.steps) {
+		if (s.pass && (s.rate == low || (s.rate == 0 && low == high)))
+			outcome.step = &s;
+	}
+	return {};
+}
+
+/*
+ * Search for the sustainable rate of the requests and report the steps
+ * tried.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, Payload &payload,
+	  const char *request_name, const Slo::Target &target,
+	  size_t request_count, size_t batch, size_t connection_count,
+	  int busy_poll_us, size_t response_buffer_size, const char *results)
+{
+	if (!Sweep::is_repeatable(request_name))
+		return Error_SloRequest(request_name);
+	Sweep::Runner runner(endpoint, connection_count, response_buffer_size);
+	if (busy_poll_us != 0) {
+		if (Error error = runner.set_busy_poll(busy_poll_us); error)
+			return error;
+	}
+	if (Error error = runner.generate(payload, request_name,
+					  request_count); error)
+		return error;
+
+	printf("Request: %s\n", request_name);
+	printf("Batch size: %lu\n", batch);
+	printf("Connections: %lu\n", connection_count);
+	printf("Requests per run: %lu\n", request_count);
+	printf("SLO: %g%% under %.3f μs, %lu errors at most\n",
+	       target.percentile * 100, target.latency_us,
+	       target.error_budget);
+	Slo::Outcome outcome;
+	const Sweep::Point point = {batch, connection_count, 0, 0};
+	if (Error error = Slo::search(runner, point, target,
+				      outcome); error)
+		return error;
+
+	/* The worst of the runs of each step. */
+	printf("%10s %10s %12s %8s %6s\n", "Rate", "RPS", "Latency (μs)",
+	       "Errors", "Pass");
+	for (const auto &step: outcome.steps) {
+		char rate[32] = "-";
+		if (step.rate != 0)
+			snprintf(rate, sizeof(rate), "%lu", step.rate);
+		double rps = step.runs[0].rps;
+		double latency_us = 0;
+		uint64_t error_count = 0;
+		for (const auto &run: step.runs) {
+			rps = std::min(rps, run.rps);
+			latency_us = std::max(latency_us, run.percentile_us);
+			error_count = std::max(error_count, run.error_count);
+		}
+		printf("%10s %10.0f %12.3f %8lu %6s\n", rate, rps, latency_us,
+		       error_count, step.pass ? "yes" : "no");
+	}
+	if (outcome.step != NULL)
+		printf("Sustainable RPS: %lu\n", outcome.rate);
+	else
+		printf("Sustainable RPS: none, the SLO isn't met at any rate\n");
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("request");
+		json.value(request_name);
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("connections");
+		json.value(uint64_t(connection_count));
+		json.key("requests_per_run");
+		json.value(uint64_t(request_count));
+		json.key("slo");
+		json.begin_object();
+		{
+			json.key("percentile");
+			json.value(target.percentile);
+			json.key("latency_us");
+			json.value(target.latency_us);
+			json.key("error_budget");
+			json.value(target.error_budget);
+		}
+		json.end_object();
+		json.key("steps");
+		json.begin_array();
+		for (const auto &step: outcome.steps) {
+			json.begin_object();
+			json.key("rate");
+			json.value(uint64_t(step.rate));
+			json.key("pass");
+			json.value(step.pass);
+			json.key("runs");
+			json.begin_array();
+			for (const auto &run: step.runs) {
+				json.begin_object();
+				json.key("rps");
+				json.value(run.rps);
+				json.key("errors");
+				json.value(run.error_count);
+				json.key("latency_us");
+				json.value(run.percentile_us);
+				json.end_object();
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+		json.key("sustainable_rps");
+		json.value(uint64_t(outcome.rate));
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Slo
@@ -32,4 +32,27 @@ percentile(const Data &data, double p)
 	return data[(size_t)((data.size() - 1) * p)];
 }
 
+/*
+ * Split the latencies into consecutive intervals by the respective
+ * completion times counted from @a origin_ns. Latencies of each of
+ * the intervals are sorted.
+ */
+std::vector<std::vector<uint64_t>>
+split_intervals(const std::vector<uint64_t> &latencies_ns,
+		const std::vector<uint64_t> &timestamps_ns,
+		uint64_t origin_ns, uint64_t interval_ns)
+{
+	std::vector<std::vector<uint64_t>> result;
+	for (size_t i = 0; i < latencies_ns.size(); i++) {
+		const size_t interval = (timestamps_ns[i] - origin_ns) /
+					interval_ns;
+		if (interval >= result.size())
+			result.resize(interval + 1);
+		result[interval].push_back(latencies_ns[i]);
+	}
+	for (auto &latencies: result)
+		std::sort(latencies.begin(), latencies.end());
+	return result;
+}
+
 } // namespace Statistics
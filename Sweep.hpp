@@ -0,0 +1,439 @@
+#pragma once
+
+#include <barrier>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+#include "Payload.hpp"
+#include "Report.hpp"
+#include "Statistics.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Parameter sweep: the same pre-generated requests are sent over the
+ * same connections with each combination of the batch size, the
+ * connection count, the in-flight depth and the offered rate, giving
+ * the throughput and the latency percentiles of each of them.
+ */
+namespace Sweep {
+
+/* The unbounded in-flight window. */
+constexpr size_t UNBOUNDED = SIZE_MAX;
+
+/* A combination of the swept parameters. */
+struct Point {
+	/* Requests sent at once. */
+	size_t batch;
+	size_t connection_count;
+	/* Requests in flight per connection, at least the batch. */
+	size_t depth;
+	/* Offered requests per second overall, 0 to send at will. */
+	size_t rate;
+};
+
+/*
+ * Make a point, the depth of 0 is the batch size if the rate isn't set
+ * and unbounded otherwise.
+ */
+inline Point
+make_point(size_t batch, size_t connection_count, size_t depth, size_t rate)
+{
+	const size_t window = depth != 0 ? depth :
+			      rate == 0 ? batch : UNBOUNDED;
+	return {batch, connection_count, std::max(window, batch), rate};
+}
+
+/* The values of the parameters to sweep, in the order of nesting. */
+struct Settings {
+	std::vector<size_t> batches;
+	std::vector<size_t> depths;
+	std::vector<size_t> connection_counts;
+	std::vector<size_t> rates;
+
+	/* All the combinations, the last parameter varying first. */
+	std::vector<Point>
+	points() const
+	{
+		std::vector<Point> result;
+		for (size_t batch: batches)
+		for (size_t depth: depths)
+		for (size_t connection_count: connection_counts)
+		for (size_t rate: rates) {
+			result.push_back(make_point(batch, connection_count,
+						    depth, rate));
+		}
+		return result;
+	}
+
+	/* The amount of values of the innermost swept parameter. */
+	size_t
+	series_size() const
+	{
+		for (const auto *values: {&rates, &connection_counts, &depths,
+					  &batches}) {
+			if (values->size() > 1)
+				return values->size();
+		}
+		return 1;
+	}
+};
+
+/* The measurements of a point. */
+struct Result {
+	Point point;
+	double rps = 0;
+	uint64_t error_count = 0;
+	double med_us = 0;
+	double p99_us = 0;
+	double p999_us = 0;
+	/* The latency at the percentile asked for. */
+	double percentile_us = 0;
+	/* Is it the knee of its series? */
+	bool knee = false;
+};
+
+/*
+ * The runs re-send the same requests, so they must be idempotent: the
+ * inserts would fail with duplicates from the second run on.
+ */
+inline bool
+is_repeatable(std::string_view request_name)
+{
+	return request_name != "insert";
+}
+
+/*
+ * The connections and the requests shared by all the points. The
+ * requests of a point are split between its connections evenly.
+ */
+class Runner {
+public:
+	Runner(const Net::Endpoint &endpoint, size_t connection_count,
+	       size_t response_buffer_size)
+	: m_endpoint(endpoint)
+	, m_response_buffer_size(response_buffer_size)
+	{
+		m_connections.resize(connection_count);
+		reconnect();
+	}
+
+	/* Make the connections anew, e.g. after the server restarted. */
+	void
+	reconnect()
+	{
+		for (auto &tt: m_connections) {
+			tt = std::make_unique<Tarantool>(m_endpoint);
+			tt->set_response_buffer_size(m_response_buffer_size);
+		}
+	}
+
+	Error
+	set_busy_poll(int usec)
+	{
+		for (auto &tt: m_connections) {
+			if (Error error = tt->set_busy_poll(usec); error)
+				return error;
+		}
+		return {};
+	}
+
+	/*
+	 * Generate the @a request_count requests sent at each point. The
+	 * generator sends one more request of its own to learn the
+	 * response size, so a zero count only sends that one.
+	 */
+	Error
+	generate(Payload &payload, const char *request_name,
+		 size_t request_count)
+	{
+		Tarantool::TransferGenerator tg(*m_connections[0], payload,
+						request_name, request_count);
+		if (request_count == 0) {
+			assign({}, 0);
+			m_probe = tg.probe();
+			return {};
+		}
+		auto transfer = tg.next();
+		if (!transfer)
+			return Error_BatchBuild(transfer.error(), 0UL);
+		m_requests = std::move(transfer->request_batch);
+		m_response_sizes = std::move(transfer->response_sizes);
+		m_probe = tg.probe();
+		set_range(0, request_count);
+		m_offsets.resize(request_count + 1);
+		for (size_t i = 0; i < request_count; i++) {
+			m_offsets[i + 1] = m_offsets[i] + 5 +
+				Data::get_uint32_be(&m_requests[m_offsets[i] + 1]);
+		}
+		return {};
+	}
+
+	/*
+	 * Take the @a request_count packed @a requests made elsewhere, the
+	 * sizes of their responses are unknown.
+	 */
+	void
+	assign(std::vector<uint8_t> &&requests, size_t request_count)
+	{
+		m_requests = std::move(requests);
+		m_response_sizes.clear();
+		m_probe.clear();
+		set_range(0, request_count);
+		m_offsets.resize(request_count + 1);
+		for (size_t i = 0; i < request_count; i++) {
+			m_offsets[i + 1] = m_offsets[i] + 5 +
+				Data::get_uint32_be(&m_requests[m_offsets[i] + 1]);
+		}
+	}
+
+	size_t
+	request_count() const
+	{
+		return m_offsets.size() - 1;
+	}
+
+	/* Send only the @a count requests from the @a first one. */
+	void
+	set_range(size_t first, size_t count)
+	{
+		m_range_first = first;
+		m_range_count = count;
+	}
+
+	/* The request sent by the generator to learn the response size. */
+	const std::vector<uint8_t> &
+	probe() const
+	{
+		return m_probe;
+	}
+
+	/* The @a i-th packed request. */
+	const uint8_t *
+	request(size_t i) const
+	{
+		return &m_requests[m_offsets[i]];
+	}
+
+	/*
+	 * Send all the requests (of the range if it's set) with the
+	 * parameters of the @a point. The latency at the @a percentile is
+	 * reported besides the fixed ones.
+	 */
+	Error
+	run(const Point &point, Result &result, double percentile = 0.99)
+	{
+		assert(point.connection_count <= m_connections.size());
+		if (m_range_count == 0)
+			return Error_NoRequests();
+		const size_t count = point.connection_count;
+		std::vector<Tarantool::Transfer> transfers;
+		for (size_t i = 0, first = m_range_first; i < count; i++) {
+			const size_t n = m_range_count / count +
+					 (i < m_range_count % count);
+			transfers.push_back(slice(first, n));
+			first += n;
+		}
+		/* The rate is split between the connections evenly. */
+		const uint64_t interval_ns = point.rate == 0 ? 0 :
+			point.batch * count * 1000000000 / point.rate;
+
+		uint64_t start_ns = 0;
+		std::barrier ready(count, [&start_ns]() noexcept {
+			start_ns = Timer::now_ns();
+		});
+		std::vector<std::vector<uint64_t>> latencies_ns(count);
+		std::vector<uint64_t> end_ns(count);
+		std::vector<uint64_t> error_counts(count);
+		std::vector<Error> errors(count);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < count; i++) {
+			threads.emplace_back([&, i] {
+				Tarantool &tt = *m_connections[i];
+				const uint64_t error_count = tt.errors().count;
+				ready.arrive_and_wait();
+				errors[i] = tt.execute_window(transfers[i],
+							      point.batch,
+							      point.depth,
+							      start_ns,
+							      interval_ns,
+							      latencies_ns[i]);
+				end_ns[i] = Timer::now_ns();
+				error_counts[i] = tt.errors().count - error_count;
+			});
+		}
+		for (auto &thread: threads)
+			thread.join();
+
+		std::vector<uint64_t> all_ns;
+		result = {point};
+		for (size_t i = 0; i < count; i++) {
+			if (errors[i])
+				return std::move(errors[i]);
+			all_ns.insert(all_ns.end(), latencies_ns[i].begin(),
+				      latencies_ns[i].end());
+			result.error_count += error_counts[i];
+		}
+		std::sort(all_ns.begin(), all_ns.end());
+		const uint64_t duration_ns = *std::max_element(end_ns.begin(),
+							       end_ns.end()) -
+					     start_ns;
+		using namespace Statistics;
+		result.rps = all_ns.size() / (duration_ns / 1000000000.0);
+		result.med_us = median(all_ns) / 1000.0;
+		result.p99_us = Statistics::percentile(all_ns, 0.99) / 1000.0;
+		result.p999_us = Statistics::percentile(all_ns, 0.999) / 1000.0;
+		result.percentile_us = Statistics::percentile(all_ns, percentile) /
+				       1000.0;
+		return {};
+	}
+
+private:
+	/* A copy of @a count requests from the @a first one. */
+	Tarantool::Transfer
+	slice(size_t first, size_t count) const
+	{
+		std::vector<uint8_t> requests(
+			m_requests.begin() + m_offsets[first],
+			m_requests.begin() + m_offsets[first + count]);
+		if (m_response_sizes.empty())
+			return Tarantool::Transfer(std::move(requests), count);
+		std::vector<size_t> response_sizes(
+			m_response_sizes.begin() + first,
+			m_response_sizes.begin() + first + count);
+		return Tarantool::Transfer(std::move(requests),
+					   std::move(response_sizes));
+	}
+
+private:
+	Net::Endpoint m_endpoint;
+	size_t m_response_buffer_size;
+	std::vector<std::unique_ptr<Tarantool>> m_connections;
+	/* The packed requests and the offset of each one. */
+	std::vector<uint8_t> m_requests;
+	std::vector<size_t> m_offsets;
+	/* Empty if the response sizes are unknown. */
+	std::vector<size_t> m_response_sizes;
+	/* The request of the generator, empty if they're assigned. */
+	std::vector<uint8_t> m_probe;
+	/* The requests sent by run(). */
+	size_t m_range_first = 0;
+	size_t m_range_count = 0;
+};
+
+/*
+ * Mark the knee of each series of the results (the points differing
+ * in the innermost swept parameter only, @a series_size of them): the
+ * point with the highest throughput per unit of the 99th percentile
+ * latency, beyond which the latency grows faster than the throughput.
+ */
+void
+mark_knees(std::vector<Result> &results, size_t series_size)
+{
+	for (size_t first = 0; first < results.size(); first += series_size) {
+		Result *knee = NULL;
+		double best = 0;
+		for (size_t i = first; i < first + series_size; i++) {
+			Result &r = results[i];
+			if (r.p99_us <= 0)
+				continue;
+			const double power = r.rps / r.p99_us;
+			if (power > best) {
+				best = power;
+				knee = &r;
+			}
+		}
+		if (knee != NULL)
+			knee->knee = true;
+	}
+}
+
+/*
+ * Run the @a request_count requests at each point of the @a settings
+ * and report the points with the knees marked.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, Payload &payload,
+	  const char *request_name, const Sweep::Settings &settings,
+	  size_t request_count, int busy_poll_us, size_t response_buffer_size,
+	  const char *results)
+{
+	if (!Sweep::is_repeatable(request_name))
+		return Error_SweepRequest(request_name);
+	/* The connections and the requests are reused by all the points. */
+	const size_t connection_count =
+		*std::max_element(settings.connection_counts.begin(),
+				  settings.connection_counts.end());
+	Sweep::Runner runner(endpoint, connection_count, response_buffer_size);
+	if (busy_poll_us != 0) {
+		if (Error error = runner.set_busy_poll(busy_poll_us); error)
+			return error;
+	}
+	if (Error error = runner.generate(payload, request_name,
+					  request_count); error)
+		return error;
+
+	std::vector<Sweep::Result> results_list;
+	for (const Sweep::Point &point: settings.points()) {
+		Sweep::Result result;
+		if (Error error = runner.run(point, result); error)
+			return error;
+		results_list.push_back(result);
+	}
+	Sweep::mark_knees(results_list, settings.series_size());
+
+	printf("Request: %s\n", request_name);
+	printf("Requests per point: %lu\n", request_count);
+	printf("%8s %8s %8s %10s %10s %8s %10s %10s %10s %5s\n",
+	       "Batch", "Conns", "Depth", "Rate", "RPS", "Errors",
+	       "Med (μs)", "99% (μs)", "99.9% (μs)", "Knee");
+	for (const auto &r: results_list) {
+		const auto &p = r.point;
+		char depth[32] = "-";
+		char rate[32] = "-";
+		if (p.depth != Sweep::UNBOUNDED)
+			snprintf(depth, sizeof(depth), "%lu", p.depth);
+		if (p.rate != 0)
+			snprintf(rate, sizeof(rate), "%lu", p.rate);
+		printf("%8lu %8lu %8s %10s %10.0f %8lu %10.3f %10.3f %10.3f "
+		       "%5s\n", p.batch, p.connection_count, depth, rate,
+		       r.rps, r.error_count, r.med_us, r.p99_us, r.p999_us,
+		       r.knee ? "*" : "");
+	}
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("request");
+		json.value(request_name);
+		json.key("requests_per_point");
+		json.value(uint64_t(request_count));
+		json.key("sweep");
+		json.begin_array();
+		for (const auto &r: results_list) {
+			const auto &p = r.point;
+			json.begin_object();
+			json.key("batch");
+			json.value(uint64_t(p.batch));
+			json.key("connections");
+			json.value(uint64_t(p.connection_count));
+			json.key("depth");
+			json.value(uint64_t(p.depth == Sweep::UNBOUNDED ? 0 :
+					    p.depth));
+			json.key("rate");
+			json.value(uint64_t(p.rate));
+			Report::write_latencies(json, r);
+			json.key("knee");
+			json.value(r.knee);
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Sweep
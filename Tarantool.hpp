@@ -1,14 +1,30 @@
 #pragma once
 
 #include <climits>
-
+#ifdef TTBENCH_HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+#include <poll.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+
+#include <bit>
+#include <map>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <numeric>
 #include <expected>
+#include <initializer_list>
 
+#include "Columnar.hpp"
 #include "Data.hpp"
+#include "Dataset.hpp"
 #include "Net.hpp"
 #include "Payload.hpp"
+#include "Phases.hpp"
+#include "ResponseBuffer.hpp"
+#include "Timer.hpp"
 
 #include "MsgPack.hpp"
 
@@ -17,51 +33,533 @@ public:
 	struct Transfer {
 		/* Amount of requests in the transfer. */
 		size_t request_count;
-		/* Packed sequence of requests. */
+		/*
+		 * Packed sequence of requests. If the transfer is scattered,
+		 * it's the packed tuples followed by the request headers not
+		 * shared by the generator, both referenced by request_iov.
+		 */
 		std::vector<uint8_t> request_batch;
-		/* Size of each respective packed request. */
+		/*
+		 * Size of each respective packed request. Empty if the sizes
+		 * are unknown, then only the framing of responses is checked.
+		 */
 		std::vector<size_t> response_sizes;
-		/* The buffer to write response into. */
-		std::vector<uint8_t> &response_buffer;
+		/*
+		 * The requests as a sequence of the headers and the tuples
+		 * in request_batch and the slices of the pools in between.
+		 * Empty if the transfer is not scattered.
+		 */
+		std::vector<struct iovec> request_iov;
+		/* Overall size of the requests. */
+		size_t request_size;
 
 		Transfer(std::vector<uint8_t> &&request_batch_arg,
-			 std::vector<size_t> &&response_sizes_arg,
-			 std::vector<uint8_t> &response_buffer)
+			 std::vector<size_t> &&response_sizes_arg)
 		: request_count(response_sizes_arg.size())
 		, request_batch(std::move(request_batch_arg))
 		, response_sizes(std::move(response_sizes_arg))
-		, response_buffer(response_buffer)
+		, request_size(request_batch.size())
 		{}
 
-		Transfer() {}
+		Transfer(std::vector<uint8_t> &&request_batch_arg,
+			 size_t request_count)
+		: request_count(request_count)
+		, request_batch(std::move(request_batch_arg))
+		, request_size(request_batch.size())
+		{}
+
+		Transfer(std::vector<uint8_t> &&tuples_arg,
+			 std::vector<struct iovec> &&request_iov_arg,
+			 std::vector<size_t> &&response_sizes_arg)
+		: request_count(response_sizes_arg.size())
+		, request_batch(std::move(tuples_arg))
+		, response_sizes(std::move(response_sizes_arg))
+		, request_iov(std::move(request_iov_arg))
+		, request_size(0)
+		{
+			for (const auto &iov: request_iov)
+				request_size += iov.iov_len;
+		}
+	};
+
+	/* A response located in a receive buffer. */
+	struct Response {
+		/* IPROTO_REQUEST_TYPE of the response, 0 on success. */
+		uint32_t code;
+		/* IPROTO_SYNC of the request responded. */
+		uint64_t sync;
+		/* The response body (MsgPack map) bounds. */
+		const uint8_t *body;
+		const uint8_t *body_end;
+
+		bool
+		is_error() const
+		{
+			return (code & 0x8000) != 0;
+		}
+
+		uint32_t
+		error_code() const
+		{
+			return code & 0x7FFF;
+		}
+
+		/*
+		 * The IPROTO_ERROR_24 message, the message of the first error
+		 * of the IPROTO_ERROR stack if there's no one, or an empty
+		 * string.
+		 */
+		std::string_view
+		error_message() const
+		{
+			const char *data = (const char *)body;
+			if (body == body_end || mp_typeof(*data) != MP_MAP)
+				return {};
+			std::string_view message;
+			uint32_t size = mp_decode_map(&data);
+			for (uint32_t i = 0; i < size; i++) {
+				if (mp_typeof(*data) != MP_UINT)
+					return message;
+				uint64_t key = mp_decode_uint(&data);
+				if (key == 0x31 /* IPROTO_ERROR_24 */ &&
+				    mp_typeof(*data) == MP_STR) {
+					uint32_t len;
+					const char *str = mp_decode_str(&data, &len);
+					return std::string_view(str, len);
+				}
+				if (key == 0x52 /* IPROTO_ERROR */ && message.empty())
+					message = stack_message(data);
+				mp_next(&data);
+			}
+			return message;
+		}
+
+		/*
+		 * Find the IPROTO_DATA array in the body. Returns NULL if
+		 * there's no one.
+		 */
+		const char *
+		data() const
+		{
+			const char *data = (const char *)body;
+			if (body == body_end || mp_typeof(*data) != MP_MAP)
+				return NULL;
+			uint32_t size = mp_decode_map(&data);
+			for (uint32_t i = 0; i < size; i++) {
+				if (mp_typeof(*data) != MP_UINT)
+					return NULL;
+				if (mp_decode_uint(&data) == 0x30 /* IPROTO_DATA */)
+					return mp_typeof(*data) == MP_ARRAY ? data : NULL;
+				mp_next(&data);
+			}
+			return NULL;
+		}
+
+	private:
+		/* MP_ERROR_MESSAGE of the first error of the MP_ERROR_STACK. */
+		static std::string_view
+		stack_message(const char *data)
+		{
+			if (mp_typeof(*data) != MP_MAP)
+				return {};
+			uint32_t size = mp_decode_map(&data);
+			for (uint32_t i = 0; i < size; i++) {
+				if (mp_typeof(*data) != MP_UINT)
+					return {};
+				if (mp_decode_uint(&data) != 0x00 /* MP_ERROR_STACK */ ||
+				    mp_typeof(*data) != MP_ARRAY) {
+					mp_next(&data);
+					continue;
+				}
+				if (mp_decode_array(&data) == 0 ||
+				    mp_typeof(*data) != MP_MAP)
+					return {};
+				uint32_t fields = mp_decode_map(&data);
+				for (uint32_t j = 0; j < fields; j++) {
+					if (mp_typeof(*data) != MP_UINT)
+						return {};
+					if (mp_decode_uint(&data) == 0x03 /* MP_ERROR_MESSAGE */ &&
+					    mp_typeof(*data) == MP_STR) {
+						uint32_t len;
+						const char *str = mp_decode_str(&data, &len);
+						return std::string_view(str, len);
+					}
+					mp_next(&data);
+				}
+				return {};
+			}
+			return {};
+		}
+	};
+
+	/*
+	 * Error responses counted per error code along with a few samples
+	 * of the distinct messages of each code.
+	 */
+	struct ErrorStats {
+		static constexpr size_t SAMPLE_COUNT = 3;
+
+		struct Code {
+			uint64_t count = 0;
+			std::vector<std::string> samples;
+		};
+
+		uint64_t count = 0;
+		std::map<uint32_t, Code> codes;
+
+		void
+		add(uint32_t code, std::string_view message)
+		{
+			count++;
+			Code &c = codes[code];
+			c.count++;
+			sample(c, message);
+		}
+
+		void
+		merge(const ErrorStats &other)
+		{
+			count += other.count;
+			for (const auto &[code, other_code]: other.codes) {
+				Code &c = codes[code];
+				c.count += other_code.count;
+				for (const auto &message: other_code.samples)
+					sample(c, message);
+			}
+		}
+
+	private:
+		static void
+		sample(Code &c, std::string_view message)
+		{
+			if (c.samples.size() >= SAMPLE_COUNT ||
+			    std::find(c.samples.begin(), c.samples.end(),
+				      message) != c.samples.end())
+				return;
+			c.samples.emplace_back(message);
+		}
+	};
+
+	/*
+	 * Bytes of a data pool referenced instead of being copied. They
+	 * go at the @a offset of the generated tuples.
+	 */
+	struct Slice {
+		size_t offset;
+		const uint8_t *data;
+		size_t size;
 	};
 
 	class TupleGenerator {
 	public:
 		TupleGenerator(Payload &payload)
 		: m_payload(payload)
-		{}
+		, m_columnar(!payload.parts.empty())
+		, m_vector(Columnar::has_avx2())
+		{
+			for (const auto &part: payload.parts) {
+				m_columnar = m_columnar &&
+					     part.type == Payload::Part::Type::UINT64 &&
+					     part.column == Payload::Part::NO_COLUMN;
+			}
+		}
+
+		/*
+		 * Are the tuples made of unsigned integers only, so they
+		 * can be generated in batches column by column?
+		 */
+		bool
+		columnar() const
+		{
+			return m_columnar;
+		}
+
+		/*
+		 * Generate the values of @a count tuples column by column
+		 * and encode them. The tuples are then written one by one
+		 * with write_batch_tuple().
+		 */
+		void
+		next_batch(size_t count)
+		{
+			assert(m_columnar);
+			const size_t part_count = m_payload.parts.size();
+			m_columns.resize(part_count);
+			m_column_values.resize(count);
+			m_batch_sizes.assign(count, mp_sizeof_array(part_count));
+			for (size_t p = 0; p < part_count; p++) {
+				Payload::Part &part = m_payload.parts[p];
+				for (size_t i = 0; i < count; i++)
+					m_column_values[i] = part.next().value.uint64;
+				m_columns[p].encode(m_column_values.data(), count,
+						    m_vector);
+				for (size_t i = 0; i < count; i++)
+					m_batch_sizes[i] += m_columns[p].size(i);
+			}
+		}
+
+		size_t
+		batch_tuple_size(size_t i) const
+		{
+			return m_batch_sizes[i];
+		}
+
+		/*
+		 * Write the tuple @a i of the batch. Writes up to
+		 * Columnar::SLACK bytes past the tuple.
+		 */
+		char *
+		write_batch_tuple(char *data, size_t i) const
+		{
+			data = mp_encode_array(data, m_columns.size());
+			for (const auto &column: m_columns)
+				data = column.write(data, i);
+			return data;
+		}
 
+		/*
+		 * Append a tuple to @a output. The field lengths are drawn
+		 * first, so the exact tuple size is known prior to encoding.
+		 * If @a slices are given, the bytes of the pools are not
+		 * copied but referenced by slices. The returned size includes
+		 * the referenced bytes.
+		 */
 		size_t
-		next(std::vector<uint8_t> &output)
+		next(std::vector<uint8_t> &output,
+		     std::vector<Slice> *slices = NULL)
 		{
-			const size_t output_original_size = output.size();
 			m_values.clear();
 			m_payload.next(m_values);
+			const auto &parts = m_payload.parts;
 			const size_t part_count = m_values.size();
-			const size_t extent = MsgPack::sizeof_array(part_count);
-			output.resize(output.size() + extent);
-			MsgPack::encode_array(&output[output.size() - extent], part_count);
-			for (auto value: m_values) {
-				if (value.type == Payload::Part::Type::UINT64) {
-					const size_t extent = MsgPack::sizeof_uint(value.value.uint64);
-					output.resize(output.size() + extent);
-					MsgPack::encode_uint(&output[output.size() - extent], value.value.uint64);
-				} else {
-					/* TODO: Error. */
+
+			size_t size = mp_sizeof_array(part_count);
+			if (m_payload.dataset != NULL)
+				convert_cells();
+			m_lengths.resize(part_count);
+			/* The pooled bytes referenced by the slices. */
+			size_t referenced = 0;
+			for (size_t i = 0; i < part_count; i++) {
+				if (parts[i].column != Payload::Part::NO_COLUMN) {
+					size += m_fields[i].second;
+					continue;
 				}
+				m_lengths[i] = m_payload.parts[i].next_length();
+				size += sizeof_field(parts[i], m_values[i].value.uint64,
+						     m_lengths[i]);
+				if (parts[i].pool && slices != NULL)
+					referenced += m_lengths[i];
 			}
-			return output.size() - output_original_size;
+
+			const size_t offset = output.size();
+			output.resize(offset + size - referenced);
+			char *const begin = (char *)output.data();
+			char *data = begin + offset;
+			data = mp_encode_array(data, part_count);
+			for (size_t i = 0; i < part_count; i++) {
+				if (parts[i].column != Payload::Part::NO_COLUMN) {
+					memcpy(data, &m_converted[m_fields[i].first],
+					       m_fields[i].second);
+					data += m_fields[i].second;
+					continue;
+				}
+				if (parts[i].pool) {
+					data = encode_pooled(data, parts[i], m_lengths[i],
+							     slices, begin);
+					continue;
+				}
+				data = encode_field(data, parts[i],
+						    m_values[i].value.uint64,
+						    m_lengths[i]);
+			}
+			/* The referenced bytes are not in the output. */
+			assert(data == begin + output.size());
+			return size;
+		}
+
+	private:
+		/*
+		 * Convert the cells of the dataset record into the fields of
+		 * the column parts. All of them hold the same record number.
+		 */
+		void
+		convert_cells()
+		{
+			const Dataset &dataset = *m_payload.dataset;
+			const auto &parts = m_payload.parts;
+			m_converted.clear();
+			m_fields.resize(parts.size());
+			bool split = false;
+			for (size_t i = 0; i < parts.size(); i++) {
+				if (parts[i].column == Payload::Part::NO_COLUMN)
+					continue;
+				if (!split) {
+					dataset.split(m_values[i].value.uint64 %
+						      dataset.record_count(),
+						      m_cells, m_scratch);
+					split = true;
+				}
+				const Dataset::Cell &cell = m_cells[parts[i].column];
+				const size_t offset = m_converted.size();
+				m_converted.resize(offset + Dataset::max_sizeof_field(cell));
+				char *const end = dataset.encode_field(&m_converted[offset],
+								       parts[i], cell);
+				/* The cells have been checked on load. */
+				assert(end != NULL);
+				m_fields[i] = {offset, end - &m_converted[offset]};
+				m_converted.resize(end - m_converted.data());
+			}
+		}
+
+		/* Filler of the strings. */
+		static constexpr char ALPHABET[] =
+			"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			"0123456789_-";
+
+		static double
+		scaled(uint64_t number, uint32_t scale)
+		{
+			double value = number;
+			for (uint32_t i = 0; i < scale; i++)
+				value /= 10;
+			return value;
+		}
+
+		static size_t
+		sizeof_field(const Payload::Part &part, uint64_t number,
+			     size_t length)
+		{
+			using Type = Payload::Part::Type;
+			size_t size = 0;
+			switch (part.type) {
+			case Type::UINT64:
+				return mp_sizeof_uint(number);
+			case Type::STRING:
+				return mp_sizeof_str(length);
+			case Type::BINARY:
+				return mp_sizeof_bin(length);
+			case Type::DOUBLE:
+				return mp_sizeof_double(0);
+			case Type::UUID:
+				return MsgPack::sizeof_uuid();
+			case Type::DECIMAL:
+				return MsgPack::sizeof_decimal(number, part.scale);
+			case Type::DATETIME:
+				return MsgPack::sizeof_datetime();
+			case Type::BOOLEAN:
+				return mp_sizeof_bool(false);
+			case Type::NIL:
+				return mp_sizeof_nil();
+			case Type::ARRAY:
+				size = mp_sizeof_array(length);
+				for (size_t i = 0; i < length; i++)
+					size += mp_sizeof_uint(number + i);
+				return size;
+			case Type::MAP:
+				size = mp_sizeof_map(length);
+				for (size_t i = 0; i < length; i++) {
+					size += mp_sizeof_uint(i) +
+						mp_sizeof_uint(number + i);
+				}
+				return size;
+			}
+			std::unreachable();
+		}
+
+		static char *
+		encode_field(char *data, const Payload::Part &part,
+			     uint64_t number, size_t length)
+		{
+			using Type = Payload::Part::Type;
+			switch (part.type) {
+			case Type::UINT64:
+				return mp_encode_uint(data, number);
+			case Type::STRING:
+				return encode_string(data, number, length);
+			case Type::DOUBLE:
+				return mp_encode_double(data, scaled(number, part.scale));
+			case Type::UUID:
+				return encode_uuid(data, number);
+			case Type::DECIMAL:
+				return MsgPack::encode_decimal(data, number, part.scale);
+			case Type::DATETIME:
+				return MsgPack::encode_datetime(data, number);
+			case Type::BOOLEAN:
+				return mp_encode_bool(data, number & 1);
+			case Type::NIL:
+				return mp_encode_nil(data);
+			case Type::ARRAY:
+				data = mp_encode_array(data, length);
+				for (size_t i = 0; i < length; i++)
+					data = mp_encode_uint(data, number + i);
+				return data;
+			case Type::MAP:
+				data = mp_encode_map(data, length);
+				for (size_t i = 0; i < length; i++) {
+					data = mp_encode_uint(data, i);
+					data = mp_encode_uint(data, number + i);
+				}
+				return data;
+			case Type::BINARY:
+				/* Binaries always come from a pool. */
+				break;
+			}
+			std::unreachable();
+		}
+
+		/* A string or a binary taking its bytes from the pool. */
+		static char *
+		encode_pooled(char *data, const Payload::Part &part, size_t length,
+			      std::vector<Slice> *slices, const char *begin)
+		{
+			if (part.type == Payload::Part::Type::STRING)
+				data = mp_encode_strl(data, length);
+			else
+				data = mp_encode_binl(data, length);
+			const uint8_t *bytes = part.pool_slice(length);
+			if (slices == NULL) {
+				memcpy(data, bytes, length);
+				return data + length;
+			}
+			if (length != 0)
+				slices->push_back({size_t(data - begin), bytes, length});
+			return data;
+		}
+
+		/*
+		 * The filler followed by the decimal digits of the number, so
+		 * the strings are as unique as the numbers if long enough.
+		 */
+		static char *
+		encode_string(char *data, uint64_t number, size_t length)
+		{
+			data = mp_encode_strl(data, length);
+			for (size_t i = 0; i < length; i++)
+				data[i] = ALPHABET[(number + i) % (sizeof(ALPHABET) - 1)];
+			for (size_t i = length; i > 0 && (number != 0 || i == length);
+			     i--, number /= 10)
+				data[i - 1] = '0' + number % 10;
+			return data + length;
+		}
+
+		/* A version 4 UUID with the low 48 bits of the number at the end. */
+		static char *
+		encode_uuid(char *data, uint64_t number)
+		{
+			uint8_t uuid[16];
+			const uint32_t a = Rng::u32();
+			const uint32_t b = Rng::u32();
+			for (int i = 0; i < 4; i++)
+				uuid[i] = a >> (i * 8);
+			uuid[4] = b;
+			uuid[5] = b >> 8;
+			uuid[6] = 0x40 | ((b >> 16) & 0x0F);
+			uuid[7] = b >> 20;
+			uuid[8] = 0x80 | ((a >> 4) & 0x3F);
+			uuid[9] = a >> 12;
+			for (int i = 0; i < 6; i++)
+				uuid[15 - i] = number >> (i * 8);
+			return MsgPack::encode_uuid(data, uuid);
 		}
 
 	private:
@@ -69,18 +567,33 @@ public:
 
 		/* A local variable made object field. */
 		std::vector<Payload::Part::Value> m_values;
+		std::vector<size_t> m_lengths;
+		/* The encoded columns of the batch and the tuple sizes. */
+		bool m_columnar;
+		bool m_vector;
+		std::vector<Columnar::UintColumn> m_columns;
+		std::vector<uint64_t> m_column_values;
+		std::vector<size_t> m_batch_sizes;
+		/* The cells of the record and the fields converted from them. */
+		std::vector<Dataset::Cell> m_cells;
+		std::string m_scratch;
+		std::vector<char> m_converted;
+		std::vector<std::pair<size_t, size_t>> m_fields;
 	};
 
 	class TransferGenerator {
 	public:
 		TransferGenerator(Tarantool &tt, Payload &payload,
 				  const char *request_name,
-				  size_t request_count_per_transfer)
+				  size_t request_count_per_transfer,
+				  bool scatter = false)
 		: m_tt(tt)
 		, m_tuple_generator(payload)
 		, m_request_name(request_name)
 		, m_request_count_per_transfer(request_count_per_transfer)
+		, m_scatter(scatter)
 		, m_append_tuple(false)
+		, m_response_sizes_known(true)
 		, m_invalid_request_name(false)
 		{
 			std::string_view request_name_sv(request_name);
@@ -137,11 +650,28 @@ public:
 			const size_t old_header_and_body_size = Data::get_uint32_be(&first_request[1]);
 			Data::set_uint32_be(&first_request[1], old_header_and_body_size + tuple_size);
 
-			/* Execute the first request to get response size. */
+			/*
+			 * Execute the first request to get response size. If
+			 * it fails (e.g. the key exists), the sizes are unknown
+			 * and only the framing of the responses is checked.
+			 */
 			const size_t first_response_size = m_tt.discover_response_size(first_request.size(),
 										       first_request.data());
+			m_response_sizes_known = first_response_size != 0;
 			/* Compute the raw response size for this request. */
-			m_raw_response_size = first_response_size - tuple_size;
+			m_raw_response_size = m_response_sizes_known ?
+					      first_response_size - tuple_size : 0;
+			m_probe = std::move(first_request);
+		}
+
+		/*
+		 * The first request, sent on construction to learn the
+		 * response size. Empty if the request name is unknown.
+		 */
+		const std::vector<uint8_t> &
+		probe() const
+		{
+			return m_probe;
 		}
 
 		std::expected<Transfer, Error>
@@ -149,6 +679,10 @@ public:
 		{
 			if (m_invalid_request_name)
 				return std::unexpected(unknown_request());
+			if (m_append_tuple && m_tuple_generator.columnar())
+				return next_columnar();
+			if (m_scatter)
+				return next_scattered();
 
 			std::vector<uint8_t> request_batch;
 			std::vector<size_t> response_sizes;
@@ -179,15 +713,211 @@ public:
 				response_sizes.push_back(response_size);
 			}
 
-			m_common_response_buffer.resize(std:accumulate(response_sizes.begin(),
-								       response_sizes.end(), 0ULL));
-
-			return Transfer(std::move(request_batch),
-					std::move(response_sizes),
-					m_common_response_buffer);
+			return known_sizes(Transfer(std::move(request_batch),
+						    std::move(response_sizes)));
 		}
 
 	private:
+		/*
+		 * Generate the tuples of the whole transfer column by column,
+		 * then write the requests into the buffer sized once.
+		 */
+		Transfer
+		next_columnar()
+		{
+			const size_t count = m_request_count_per_transfer;
+			m_tuple_generator.next_batch(count);
+			const size_t header_size = m_scatter ? 0 : m_first_bytes.size();
+			std::vector<size_t> response_sizes(count);
+			size_t size = 0;
+			for (size_t i = 0; i < count; i++) {
+				const size_t tuple_size =
+					m_tuple_generator.batch_tuple_size(i);
+				response_sizes[i] = m_raw_response_size + tuple_size;
+				size += header_size + tuple_size;
+			}
+
+			/* The scattered headers not shared go after the tuples. */
+			size_t headers_size = 0;
+			if (m_scatter) {
+				m_headers.clear();
+				for (size_t i = 0; i < count; i++) {
+					m_headers.push_back(shared_header(
+						response_sizes[i] -
+						m_raw_response_size));
+					if (m_headers.back() == NULL)
+						headers_size += m_first_bytes.size();
+				}
+			}
+			std::vector<uint8_t> data(size + headers_size +
+						  Columnar::SLACK);
+			char *p = (char *)data.data();
+			for (size_t i = 0; i < count; i++) {
+				const size_t tuple_size = response_sizes[i] -
+							  m_raw_response_size;
+				if (!m_scatter) {
+					write_header((uint8_t *)p, tuple_size);
+					p += header_size;
+				}
+				p = m_tuple_generator.write_batch_tuple(p, i);
+			}
+			assert(p == (char *)data.data() + size);
+			data.resize(size + headers_size);
+			if (!m_scatter) {
+				return known_sizes(Transfer(std::move(data),
+							    std::move(response_sizes)));
+			}
+
+			std::vector<struct iovec> iov;
+			iov.reserve(count * 2);
+			uint8_t *tuple = data.data();
+			uint8_t *header = data.data() + size;
+			for (size_t i = 0; i < count; i++) {
+				const size_t tuple_size = response_sizes[i] -
+							  m_raw_response_size;
+				push_header(iov, i, header, tuple_size);
+				iov.push_back({tuple, tuple_size});
+				tuple += tuple_size;
+			}
+			return known_sizes(Transfer(std::move(data), std::move(iov),
+						    std::move(response_sizes)));
+		}
+
+		/* Drop the response sizes if they're not actually known. */
+		Transfer
+		known_sizes(Transfer &&t) const
+		{
+			if (!m_response_sizes_known)
+				t.response_sizes.clear();
+			return std::move(t);
+		}
+
+		/*
+		 * Only generate the tuples and the headers not shared, the
+		 * requests are composed of them and of the pool slices when
+		 * sent.
+		 */
+		Transfer
+		next_scattered()
+		{
+			std::vector<uint8_t> tuples;
+			std::vector<size_t> response_sizes;
+			tuples.reserve(m_tuples_capacity);
+			m_slices.clear();
+			m_tuple_ends.clear();
+
+			for (size_t i = 0; i < m_request_count_per_transfer; i++) {
+				const size_t tuple_size = m_append_tuple ?
+							  m_tuple_generator.next(tuples, &m_slices) : 0;
+				response_sizes.push_back(m_raw_response_size + tuple_size);
+				m_tuple_ends.push_back(tuples.size());
+			}
+
+			/* The headers not shared go after the tuples. */
+			const size_t tuples_size = tuples.size();
+			size_t headers_size = 0;
+			m_headers.clear();
+			for (size_t response_size: response_sizes) {
+				m_headers.push_back(shared_header(
+					response_size - m_raw_response_size));
+				if (m_headers.back() == NULL)
+					headers_size += m_first_bytes.size();
+			}
+			tuples.resize(tuples_size + headers_size);
+			m_tuples_capacity = std::max(m_tuples_capacity, tuples.size());
+
+			/*
+			 * The tuples don't move anymore, reference them along
+			 * with the slices of pools in between.
+			 */
+			std::vector<struct iovec> iov;
+			iov.reserve(m_request_count_per_transfer * 2 +
+				    m_slices.size() * 2);
+			size_t pos = 0;
+			size_t slice = 0;
+			uint8_t *header = tuples.data() + tuples_size;
+			for (size_t i = 0; i < response_sizes.size(); i++) {
+				const size_t tuple_size = response_sizes[i] -
+							  m_raw_response_size;
+				push_header(iov, i, header, tuple_size);
+				const size_t end = m_tuple_ends[i];
+				for (; slice < m_slices.size() &&
+				       m_slices[slice].offset <= end; slice++) {
+					const Slice &s = m_slices[slice];
+					if (s.offset > pos)
+						iov.push_back({&tuples[pos], s.offset - pos});
+					iov.push_back({(void *)s.data, s.size});
+					pos = s.offset;
+				}
+				if (end > pos)
+					iov.push_back({&tuples[pos], end - pos});
+				pos = end;
+			}
+
+			return known_sizes(Transfer(std::move(tuples), std::move(iov),
+						    std::move(response_sizes)));
+		}
+
+		/*
+		 * Write the request header at @a data, with the size fixed-up
+		 * for the given tuple size.
+		 */
+		void
+		write_header(uint8_t *data, size_t tuple_size) const
+		{
+			memcpy(data, m_first_bytes.data(), m_first_bytes.size());
+			/* FIXME: MP_UINT32 expected. */
+			const size_t old_header_and_body_size =
+				Data::get_uint32_be(&m_first_bytes[1]);
+			Data::set_uint32_be(&data[1], old_header_and_body_size +
+						      tuple_size);
+		}
+
+		/*
+		 * The header shared by the requests with the tuple size. A
+		 * slot of the table is taken by the first size hashed to it
+		 * for good, so the headers referenced stay intact, and NULL
+		 * is returned for the other sizes of the slot.
+		 */
+		const uint8_t *
+		shared_header(size_t tuple_size)
+		{
+			if (m_shared_headers.empty()) {
+				m_shared_headers.resize(SHARED_HEADER_COUNT *
+							m_first_bytes.size());
+				m_shared_header_sizes.assign(SHARED_HEADER_COUNT,
+							     SIZE_MAX);
+			}
+			const size_t slot = tuple_size % SHARED_HEADER_COUNT;
+			uint8_t *header = &m_shared_headers[slot *
+							    m_first_bytes.size()];
+			if (m_shared_header_sizes[slot] == SIZE_MAX) {
+				m_shared_header_sizes[slot] = tuple_size;
+				write_header(header, tuple_size);
+			}
+			return m_shared_header_sizes[slot] == tuple_size ?
+			       header : NULL;
+		}
+
+		/*
+		 * Reference the header of the @a i-th request, the shared one
+		 * or a copy written at @a header in the transfer, which is
+		 * moved past it then.
+		 */
+		void
+		push_header(std::vector<struct iovec> &iov, size_t i,
+			    uint8_t *&header, size_t tuple_size)
+		{
+			if (m_headers[i] != NULL) {
+				iov.push_back({(void *)m_headers[i],
+					       m_first_bytes.size()});
+				return;
+			}
+			write_header(header, tuple_size);
+			iov.push_back({header, m_first_bytes.size()});
+			header += m_first_bytes.size();
+		}
+
 		void
 		write_ping_request(std::vector<uint8_t> &data)
 		{
@@ -352,7 +1082,7 @@ public:
 			builder.append_raw(0x82, "header");
 			{
 				builder.append_raw(0x00, "IPROTO_REQUEST_TYPE");
-				builder.append_raw(0x05, "IPROTO_REPLACE");
+				builder.append_raw(0x01, "IPROTO_SELECT");
 				builder.append_raw(0x01, "IPROTO_SYNC");
 				builder.append_raw(0x00, "unchecked sync value");
 			}
@@ -392,8 +1122,32 @@ public:
 		/* First bytes of a request are always almost the same. */
 		std::vector<uint8_t> m_first_bytes;
 
-		/* The response buffer reused by all transfers. */
-		std::vector<uint8_t> m_common_response_buffer;
+		/* The first request, it's sent prior to the transfers. */
+		std::vector<uint8_t> m_probe;
+
+		/* Send the requests as the headers and the tuples apart. */
+		bool m_scatter;
+
+		/*
+		 * The headers shared by the scattered requests, a table of
+		 * the tuple sizes bounded to keep the memory fixed however
+		 * many sizes there are, and the size each slot is taken by.
+		 */
+		static constexpr size_t SHARED_HEADER_COUNT = 1024;
+		std::vector<uint8_t> m_shared_headers;
+		std::vector<size_t> m_shared_header_sizes;
+		/* The shared header of each request being made, if any. */
+		std::vector<const uint8_t *> m_headers;
+
+		/* The largest size of the tuples of a scattered transfer. */
+		size_t m_tuples_capacity = 0;
+
+		/*
+		 * The pool slices and the ends of the tuples of a scattered
+		 * transfer being made.
+		 */
+		std::vector<Slice> m_slices;
+		std::vector<size_t> m_tuple_ends;
 
 		/* Does the request include a generated tuple? */
 		bool m_append_tuple;
@@ -403,76 +1157,686 @@ public:
 		 * of the tuples sent.
 		 */
 		size_t m_raw_response_size;
+		bool m_response_sizes_known;
 
 		/* Error in the constructor. */
 		bool m_invalid_request_name;
 	};
 
 public:
-	Tarantool(const char *hostname, int port)
+	/*
+	 * The requests below are complete (they are not appended with a
+	 * generated tuple) and may be bound to an IPROTO stream, which is
+	 * required to run interactive transactions. Zero stream ID means
+	 * the request is sent outside of any stream.
+	 */
+
+	static void
+	write_txn_request(std::vector<uint8_t> &data, uint8_t type,
+			  const char *type_name, uint64_t stream_id)
+	{
+		size_t estimated_size = 5 /* Header and body size field. */ +
+					sizeof_stream_header(stream_id) +
+					1 /* Body map. */;
+
+		MsgPack::Builder builder(estimated_size);
+
+		builder.append_uint32(estimated_size - 5, "header and body size");
+		append_stream_header(builder, type, type_name, stream_id);
+		builder.append_raw(0x80, "body");
+
+		/* Check & write. */
+		builder.check();
+		builder.build_into(data);
+	}
+
+	static void
+	write_get_request(std::vector<uint8_t> &data, uint32_t space_id,
+			  uint64_t key, uint64_t stream_id)
+	{
+		size_t estimated_size = 5 /* Header and body size field. */ +
+					sizeof_stream_header(stream_id) +
+					1 /* Body map. */ +
+					1 + MsgPack::sizeof_uint(space_id) +
+					1 + 1 /* Index ID. */ +
+					1 + 1 /* Limit. */ +
+					1 + 1 /* Offset. */ +
+					1 + 1 /* Iterator. */ +
+					1 + 1 + MsgPack::sizeof_uint(key);
+
+		MsgPack::Builder builder(estimated_size);
+
+		builder.append_uint32(estimated_size - 5, "header and body size");
+		append_stream_header(builder, 0x01, "IPROTO_SELECT", stream_id);
+
+		builder.append_raw(0x86, "body");
+		{
+			builder.append_raw(0x10, "IPROTO_SPACE_ID");
+			builder.append_uint(space_id, "space ID");
+			builder.append_raw(0x11, "IPROTO_INDEX_ID");
+			builder.append_raw(0x00, "primary index ID");
+			builder.append_raw(0x12, "IPROTO_LIMIT");
+			builder.append_raw(0x01, "limit");
+			builder.append_raw(0x13, "IPROTO_OFFSET");
+			builder.append_raw(0x00, "offset");
+			builder.append_raw(0x14, "IPROTO_ITERATOR");
+			builder.append_raw(0x00, "ITER_EQ");
+			builder.append_raw(0x20, "IPROTO_KEY");
+			builder.append_raw(0x91, "key");
+			builder.append_uint(key, "key part");
+		}
+
+		/* Check & write. */
+		builder.check();
+		builder.build_into(data);
+	}
+
+	static void
+	write_put_request(std::vector<uint8_t> &data, uint32_t space_id,
+			  uint64_t key, uint64_t value, uint64_t stream_id)
 	{
-		/* Connect to the server. */
-		m_fd = Net::connect(hostname, port);
+		size_t estimated_size = 5 /* Header and body size field. */ +
+					sizeof_stream_header(stream_id) +
+					1 /* Body map. */ +
+					1 + MsgPack::sizeof_uint(space_id) +
+					1 + 1 + MsgPack::sizeof_uint(key) +
+					MsgPack::sizeof_uint(value);
+
+		MsgPack::Builder builder(estimated_size);
+
+		builder.append_uint32(estimated_size - 5, "header and body size");
+		append_stream_header(builder, 0x03, "IPROTO_REPLACE", stream_id);
+
+		builder.append_raw(0x82, "body");
+		{
+			builder.append_raw(0x10, "IPROTO_SPACE_ID");
+			builder.append_uint(space_id, "space ID");
+			builder.append_raw(0x21, "IPROTO_TUPLE");
+			builder.append_raw(0x92, "tuple");
+			builder.append_uint(key, "key");
+			builder.append_uint(value, "value");
+		}
+
+		/* Check & write. */
+		builder.check();
+		builder.build_into(data);
+	}
+
+	static void
+	write_auth_request(std::vector<uint8_t> &data, std::string_view user,
+			   std::string_view scramble)
+	{
+		size_t estimated_size = 5 /* Header and body size field. */ +
+					sizeof_stream_header(0) +
+					1 /* Body map. */ +
+					1 + mp_sizeof_str(user.size()) +
+					1 + 1 /* IPROTO_TUPLE. */ +
+					mp_sizeof_str(9) +
+					mp_sizeof_str(scramble.size());
+
+		MsgPack::Builder builder(estimated_size);
+
+		builder.append_uint32(estimated_size - 5, "header and body size");
+		append_stream_header(builder, 0x07, "IPROTO_AUTH", 0);
+
+		builder.append_raw(0x82, "body");
+		{
+			builder.append_raw(0x23, "IPROTO_USER_NAME");
+			builder.append_str(user, "user name");
+			builder.append_raw(0x21, "IPROTO_TUPLE");
+			builder.append_raw(0x92, "auth");
+			builder.append_str("chap-sha1", "auth method");
+			builder.append_str(scramble, "scramble");
+		}
+
+		/* Check & write. */
+		builder.check();
+		builder.build_into(data);
+	}
+
+	static void
+	write_eval_request(std::vector<uint8_t> &data, std::string_view expression)
+	{
+		size_t estimated_size = 5 /* Header and body size field. */ +
+					sizeof_stream_header(0) +
+					1 /* Body map. */ +
+					1 + mp_sizeof_str(expression.size()) +
+					1 + 1 /* Empty IPROTO_TUPLE. */;
+
+		MsgPack::Builder builder(estimated_size);
+
+		builder.append_uint32(estimated_size - 5, "header and body size");
+		append_stream_header(builder, 0x08, "IPROTO_EVAL", 0);
+
+		builder.append_raw(0x82, "body");
+		{
+			builder.append_raw(0x27, "IPROTO_EXPR");
+			builder.append_str(expression, "expression");
+			builder.append_raw(0x21, "IPROTO_TUPLE");
+			builder.append_raw(0x90, "no arguments");
+		}
+
+		/* Check & write. */
+		builder.check();
+		builder.build_into(data);
+	}
+
+public:
+	/* The size of the chap-sha1 scramble and of the salt used. */
+	static constexpr size_t SCRAMBLE_SIZE = 20;
 
-		/* Read the greeting. */
-		char greeting[128] = {};
-		read(m_fd, greeting, sizeof(greeting));
+	/* The default bound of the response buffer. */
+	static constexpr size_t RESPONSE_BUFFER_SIZE = 1024 * 1024;
+
+	Tarantool(const Net::Endpoint &endpoint)
+	: Tarantool(Net::connect(endpoint))
+	{
+		if (Error error = read_greeting(); error) {
+			error.report();
+			Log::fatal_error("Couldn't connect to Tarantool");
+		}
 	}
 
+	/*
+	 * Take over the connected socket. The greeting is to be read with
+	 * read_greeting() then.
+	 */
+	explicit Tarantool(int fd)
+	: m_fd(fd)
+	{}
+
+	Tarantool(const char *hostname, int port)
+	: Tarantool(Net::Endpoint{hostname, uint16_t(port)})
+	{}
+
+	Tarantool(const Tarantool &other) = delete;
+
+	/*
+	 * Make the kernel busy-poll the device queue for up to @a usec
+	 * microseconds on receive and spin in non-blocking receive
+	 * instead of sleeping in a blocking one.
+	 */
 	Error
-	execute(struct Transfer &t)
+	set_busy_poll(int usec)
+	{
+		if (setsockopt(m_fd, SOL_SOCKET, SO_BUSY_POLL,
+			       &usec, sizeof(usec)) != 0)
+			return Error_System("Can't set SO_BUSY_POLL");
+		m_spin = true;
+		return {};
+	}
+
+	~Tarantool()
 	{
-		/* Send the batch of requests. */
-		assert(t.request_batch.size() <= SSIZE_MAX);
-		const size_t bytes_sent = write(m_fd, t.request_batch.data(),
-						t.request_batch.size());
-		if (bytes_sent != t.request_batch.size())
-			return Error_System("Can't send the request batch.");
-
-		/* Read the responses. */
-		assert(t.response_buffer.size() <= SSIZE_MAX);
-		const size_t bytes_read = recv(m_fd, &t.response_buffer[0],
-					       t.response_buffer.size(),
-					       MSG_WAITALL);
-		if (bytes_read != t.response_buffer.size())
-			return Error_System("Can't recv the response.");
+		if (m_fd >= 0)
+			close(m_fd);
+	}
 
+	/*
+	 * Read and check the greeting: two 64-byte lines, the first one
+	 * is "Tarantool <version> ...", the second one is the base64 salt
+	 * used to authenticate.
+	 */
+	Error
+	read_greeting()
+	{
+		char greeting[128];
+		const ssize_t received = receive((uint8_t *)greeting,
+						 sizeof(greeting), true);
+		if (received < 0)
+			return Error_System("Can't read the greeting");
+		if (size_t(received) != sizeof(greeting))
+			return Error_Greeting("it's truncated");
+		if (memcmp(greeting, "Tarantool ", 10) != 0 ||
+		    greeting[63] != '\n' || greeting[127] != '\n')
+			return Error_Greeting("it's not a Tarantool one");
+		m_version.assign(greeting + 10, strcspn(greeting + 10, " \n"));
+		m_salt_size = Data::decode_base64(greeting + 64, 63, m_salt,
+						  sizeof(m_salt));
+		if (m_salt_size < SCRAMBLE_SIZE)
+			return Error_Greeting("the salt is too short");
 		return {};
 	}
 
+	/* The server version from the greeting. */
+	const std::string &
+	version() const
+	{
+		return m_version;
+	}
+
+	/*
+	 * Authenticate with chap-sha1: the scramble of the password with
+	 * the salt of the greeting is sent instead of the password.
+	 */
 	Error
-	check(const struct Transfer &t)
+	authenticate(std::string_view user, std::string_view password)
 	{
-		const uint8_t *data = t.response_buffer.data();
-		const uint8_t *const end = data + t.response_buffer.size();
-		for (size_t i = 0; i < t.request_count; i++) {
-			/*
-			 * Get the size of header and body. This value is
-			 * expected to be encoded in a 5-byte MessagePack
-			 * unsigned integer.
-			 */
-			assert(data + 5 < end);
+#ifdef TTBENCH_HAVE_OPENSSL
+		/* sha1(password) ^ sha1(salt, sha1(sha1(password))) */
+		uint8_t hash1[SCRAMBLE_SIZE];
+		uint8_t salted[SCRAMBLE_SIZE * 2];
+		uint8_t scramble[SCRAMBLE_SIZE];
+		EVP_Digest(password.data(), password.size(), hash1, NULL,
+			   EVP_sha1(), NULL);
+		memcpy(salted, m_salt, SCRAMBLE_SIZE);
+		EVP_Digest(hash1, sizeof(hash1), salted + SCRAMBLE_SIZE, NULL,
+			   EVP_sha1(), NULL);
+		EVP_Digest(salted, sizeof(salted), scramble, NULL, EVP_sha1(),
+			   NULL);
+		for (size_t i = 0; i < SCRAMBLE_SIZE; i++)
+			scramble[i] ^= hash1[i];
+
+		std::vector<uint8_t> request;
+		write_auth_request(request, user,
+				   std::string_view((const char *)scramble,
+						    sizeof(scramble)));
+		std::vector<uint8_t> buffer;
+		std::vector<Response> responses;
+		if (Error error = exchange(request, 1, buffer, responses); error)
+			return error;
+		if (responses[0].is_error()) {
+			return Error_ResponseError(responses[0].error_code(),
+						   responses[0].error_message());
+		}
+		return {};
+#else
+		(void)user;
+		(void)password;
+		return Error_NoOpenssl();
+#endif
+	}
 
-			if (data[0] != 0xCE)
+	/*
+	 * Send the packed requests and receive @a response_count
+	 * responses into @a buffer. The responses are then described
+	 * by @a responses pointing into the buffer.
+	 */
+	Error
+	exchange(const std::vector<uint8_t> &requests, size_t response_count,
+		 std::vector<uint8_t> &buffer, std::vector<Response> &responses)
+	{
+		assert(requests.size() <= SSIZE_MAX);
+		const size_t bytes_sent = write(m_fd, requests.data(),
+						requests.size());
+		if (bytes_sent != requests.size())
+			return Error_System("Can't send the requests.");
+
+		/* Read the responses one by one, they are size-prefixed. */
+		buffer.clear();
+		for (size_t i = 0; i < response_count; i++) {
+			const size_t offset = buffer.size();
+			buffer.resize(offset + 5);
+			if (size_t(receive(&buffer[offset], 5, true)) != 5)
+				return Error_System("Can't recv the response size.");
+			if (buffer[offset] != 0xCE)
 				return Error_ResponseSize();
+			const char *size_ptr = (const char *)&buffer[offset];
+			const size_t size = mp_decode_uint(&size_ptr);
+			buffer.resize(offset + 5 + size);
+			if (size_t(receive(&buffer[offset + 5], size,
+					   true)) != size)
+				return Error_System("Can't recv the response.");
+		}
 
-			/* FIXME: MP_UINT32 expected. */
-			const size_t header_and_body_size = Data::get_uint32_be(&data[1]);
+		/* Decode the response headers. */
+		responses.clear();
+		const char *data = (const char *)buffer.data();
+		const char *const end = data + buffer.size();
+		while (data < end) {
+			/* Step over the 0xCE byte of the size specifier. */
+			data++;
+			const uint32_t size = mp_load_u32(&data);
+			const char *const next = data + size;
+			Response response;
+			if (!decode_response(data, next, response))
+				return Error_ResponseBody();
+			responses.push_back(response);
+			data = next;
+		}
+		return {};
+	}
 
-			/* 5 is the size of the size specifier itself. */
-			if (header_and_body_size != t.response_sizes[i] - 5) {
-				fprintf(stderr, "Error: Response size mismatch,"
-					" expected %lu, got %lu. Response:\n\n",
-					header_and_body_size,
-					t.response_sizes[i] - 5);
-				Log::data(t.response_sizes[i], data);
-				return {}; // TODO
+	/*
+	 * Evaluate the Lua @a expression, @a value is set to the first
+	 * value returned, pointing into @a buffer, or to NULL if none is.
+	 */
+	Error
+	evaluate(const char *expression, std::vector<uint8_t> &buffer,
+		 const char **value)
+	{
+		std::vector<uint8_t> request;
+		std::vector<Response> responses;
+		write_eval_request(request, expression);
+		if (Error error = exchange(request, 1, buffer, responses); error)
+			return error;
+		if (responses[0].is_error())
+			return Error_ResponseError(responses[0].error_code(),
+						   responses[0].error_message());
+		const char *data = responses[0].data();
+		if (data == NULL)
+			return Error_ResponseBody();
+		*value = mp_decode_array(&data) != 0 ? data : NULL;
+		return {};
+	}
+
+	/* The error responses received by the transfers so far. */
+	const ErrorStats &
+	errors() const
+	{
+		return m_errors;
+	}
+
+	/*
+	 * Decode IPROTO_REQUEST_TYPE and IPROTO_SYNC from the header of
+	 * the response in [@a data, @a end) and locate the body.
+	 */
+	static bool
+	decode_response(const char *data, const char *end, Response &response)
+	{
+		response = {};
+		const char *header_end = data;
+		if (data == end || mp_typeof(*data) != MP_MAP ||
+		    mp_check(&header_end, end) != 0)
+			return false;
+		uint32_t header_size = mp_decode_map(&data);
+		for (uint32_t i = 0; i < header_size; i++) {
+			if (mp_typeof(*data) != MP_UINT)
+				return false;
+			uint64_t key = mp_decode_uint(&data);
+			if (key == 0x00 /* IPROTO_REQUEST_TYPE */ &&
+			    mp_typeof(*data) == MP_UINT)
+				response.code = mp_decode_uint(&data);
+			else if (key == 0x01 /* IPROTO_SYNC */ &&
+				 mp_typeof(*data) == MP_UINT)
+				response.sync = mp_decode_uint(&data);
+			else
+				mp_next(&data);
+		}
+		response.body = (const uint8_t *)data;
+		response.body_end = (const uint8_t *)end;
+		return true;
+	}
+
+	/*
+	 * Find the first part of IPROTO_KEY or IPROTO_TUPLE in the body of
+	 * the packed @a request. Returns NULL if there's no one.
+	 */
+	static const char *
+	first_key_part(const uint8_t *request)
+	{
+		/* Skip the size and the header. */
+		const char *data = (const char *)request + 5;
+		mp_next(&data);
+		const uint32_t size = mp_decode_map(&data);
+		for (uint32_t i = 0; i < size; i++) {
+			const uint64_t key = mp_decode_uint(&data);
+			if (key != 0x20 /* IPROTO_KEY */ &&
+			    key != 0x21 /* IPROTO_TUPLE */) {
+				mp_next(&data);
+				continue;
+			}
+			if (mp_typeof(*data) != MP_ARRAY ||
+			    mp_decode_array(&data) == 0)
+				return NULL;
+			return data;
+		}
+		return NULL;
+	}
+
+	/*
+	 * Find the unsigned value at the @a path of the nested maps in the
+	 * MsgPack @a data, e.g. of an evaluated expression. Missing values
+	 * are left intact.
+	 */
+	static void
+	lookup(const char *data, std::initializer_list<std::string_view> path,
+	       uint64_t &value)
+	{
+		for (std::string_view name: path) {
+			if (mp_typeof(*data) != MP_MAP)
+				return;
+			const uint32_t size = mp_decode_map(&data);
+			bool found = false;
+			for (uint32_t i = 0; i < size && !found; i++) {
+				if (mp_typeof(*data) == MP_STR) {
+					uint32_t len;
+					const char *str = mp_decode_str(&data, &len);
+					found = std::string_view(str, len) == name;
+				} else {
+					mp_next(&data);
+				}
+				if (!found)
+					mp_next(&data);
+			}
+			if (!found)
+				return;
+		}
+		if (mp_typeof(*data) == MP_UINT)
+			value = mp_decode_uint(&data);
+		else if (mp_typeof(*data) == MP_DOUBLE)
+			value = mp_decode_double(&data);
+	}
+
+	/*
+	 * Send the requests of the transfer and receive the responses at
+	 * the same time, so the transfer may be larger than the socket
+	 * buffers of both sides. The responses are checked as they come
+	 * into the bounded response buffer.
+	 */
+	Error
+	execute(struct Transfer &t, Phases &phases)
+	{
+		const uint64_t start_ns = Timer::now_ns();
+		uint64_t send_ns = 0;
+		uint64_t validate_ns = 0;
+		uint64_t first_byte_ns = 0;
+		/* Time spent sending before the first byte of responses. */
+		uint64_t send_before_first_byte_ns = 0;
+
+		const bool zerocopy = !t.request_iov.empty() &&
+				      m_zerocopy_threshold != 0 &&
+				      t.request_size >= m_zerocopy_threshold;
+		size_t bytes_left = t.request_size;
+		/* Progress of sending the batch or the iovecs. */
+		size_t batch_pos = 0;
+		size_t iov_pos = 0;
+		size_t response_count = 0;
+		m_mismatch_reported = false;
+		m_responses.clear();
+
+		while (response_count < t.request_count) {
+			if (!m_spin) {
+				struct pollfd pfd = {m_fd, POLLIN, 0};
+				if (bytes_left != 0)
+					pfd.events |= POLLOUT;
+				if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+					return Error_System("Can't poll the connection.");
+				/* Zero-copy completions come as POLLERR. */
+				if ((pfd.revents & POLLERR) != 0 && zerocopy) {
+					if (Error error = reap_zerocopy(false); error)
+						return error;
+				}
+			}
+
+			if (bytes_left != 0) {
+				const uint64_t send_start_ns = Timer::now_ns();
+				const ssize_t sent = send_some(t, batch_pos, iov_pos,
+							       zerocopy);
+				if (sent < 0)
+					return Error_System("Can't send the request batch.");
+				bytes_left -= sent;
+				send_ns += Timer::now_ns() - send_start_ns;
+			}
+
+			const ssize_t received = recv(m_fd, m_responses.tail(),
+						      m_responses.available(),
+						      MSG_DONTWAIT);
+			if (received == 0)
+				return Error_ConnectionClosed();
+			if (received < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK &&
+				    errno != EINTR)
+					return Error_System("Can't recv the response.");
+				continue;
+			}
+			const uint64_t received_ns = Timer::now_ns();
+			if (first_byte_ns == 0) {
+				first_byte_ns = received_ns;
+				send_before_first_byte_ns = send_ns;
+			}
+			m_responses.produce(received);
+
+			if (Error error = consume_responses(t, response_count); error)
+				return error;
+			validate_ns += Timer::now_ns() - received_ns;
+		}
+
+		/*
+		 * The requests buffers may be reused once the transfer is
+		 * over, so the zero-copy sends must be completed.
+		 */
+		if (m_zerocopy_sent != m_zerocopy_completed) {
+			const uint64_t wait_start_ns = Timer::now_ns();
+			if (Error error = reap_zerocopy(true); error)
+				return error;
+			send_ns += Timer::now_ns() - wait_start_ns;
+		}
+
+		/*
+		 * The phases overlap now: the time spent waiting is split into
+		 * waiting for the first byte and draining the rest, the time
+		 * spent in the syscalls and checks is accounted separately.
+		 */
+		const uint64_t total_ns = Timer::now_ns() - start_ns;
+		const uint64_t first_byte_wait_ns = first_byte_ns - start_ns -
+						    send_before_first_byte_ns;
+		phases.ns[Phases::SEND] += send_ns;
+		phases.ns[Phases::VALIDATE] += validate_ns;
+		phases.ns[Phases::FIRST_BYTE] += first_byte_wait_ns;
+		phases.ns[Phases::DRAIN] += total_ns - send_ns - validate_ns -
+					    first_byte_wait_ns;
+		return {};
+	}
+
+	/*
+	 * Set the size the response buffer is bounded by. It only grows
+	 * if a single response does not fit into it.
+	 */
+	void
+	set_response_buffer_size(size_t size)
+	{
+		m_responses.reset(size);
+	}
+
+	/*
+	 * Send scattered transfers of at least @a threshold bytes with
+	 * MSG_ZEROCOPY, so the kernel pins the pages instead of copying.
+	 */
+	Error
+	set_zerocopy(size_t threshold)
+	{
+		const int one = 1;
+		if (setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY,
+			       &one, sizeof(one)) != 0)
+			return Error_System("Can't set SO_ZEROCOPY");
+		m_zerocopy_threshold = threshold;
+		return {};
+	}
+
+	/*
+	 * Send the requests of the transfer keeping up to @a depth of them
+	 * in flight instead of sending the whole transfer at once: they go
+	 * in groups of @a batch, each group is sent once the responses to
+	 * the previous ones leave room for it in the window. If
+	 * @a interval_ns is set, the groups are also sent on a schedule of
+	 * one per interval from @a start_ns, and the latency of a request
+	 * is counted from the moment its group was due rather than sent,
+	 * so the time a late group waited is not hidden. The latency of
+	 * each request is stored into @a latencies_ns. The transfer must
+	 * not be scattered.
+	 */
+	Error
+	execute_window(const struct Transfer &t, size_t batch, size_t depth,
+		       uint64_t start_ns, uint64_t interval_ns,
+		       std::vector<uint64_t> &latencies_ns)
+	{
+		assert(t.request_iov.empty());
+		assert(batch != 0 && depth >= batch);
+		const uint8_t *const requests = t.request_batch.data();
+		const size_t group_count = (t.request_count + batch - 1) / batch;
+		/* The moment each of the groups was sent or due. */
+		std::vector<uint64_t> group_ns(group_count);
+		size_t group = 0;
+		size_t request_count_sent = 0;
+		/* The bytes of the group being sent. */
+		size_t pos = 0;
+		size_t end = 0;
+		size_t response_count = 0;
+		m_mismatch_reported = false;
+		m_responses.clear();
+		latencies_ns.resize(t.request_count);
+
+		while (response_count < t.request_count) {
+			/* Start the next group if it's due and fits the window. */
+			struct timespec timeout;
+			struct timespec *wait = NULL;
+			if (pos == end && group < group_count) {
+				const uint64_t now_ns = Timer::now_ns();
+				const uint64_t due_ns = start_ns + group * interval_ns;
+				const size_t count = std::min(batch, t.request_count -
+								     request_count_sent);
+				if (request_count_sent + count - response_count > depth) {
+					/* Wait for the responses. */
+				} else if (interval_ns != 0 && now_ns < due_ns) {
+					timeout.tv_sec = (due_ns - now_ns) / 1000000000;
+					timeout.tv_nsec = (due_ns - now_ns) % 1000000000;
+					wait = &timeout;
+				} else {
+					group_ns[group++] = interval_ns != 0 ? due_ns : now_ns;
+					for (size_t i = 0; i < count; i++)
+						end += 5 + Data::get_uint32_be(&requests[end + 1]);
+					request_count_sent += count;
+				}
 			}
 
-			/* TODO: Check if no error. */
+			if (!m_spin) {
+				struct pollfd pfd = {m_fd, POLLIN, 0};
+				if (pos != end)
+					pfd.events |= POLLOUT;
+				if (ppoll(&pfd, 1, wait, NULL) < 0 && errno != EINTR)
+					return Error_System("Can't poll the connection.");
+			}
+
+			if (pos != end) {
+				const ssize_t sent = send(m_fd, requests + pos, end - pos,
+							  MSG_DONTWAIT);
+				if (sent > 0)
+					pos += sent;
+				else if (sent < 0 && errno != EAGAIN &&
+					 errno != EWOULDBLOCK && errno != EINTR)
+					return Error_System("Can't send the requests.");
+			}
 
-			/* Step over the response. */
-			data += t.response_sizes[i];
+			const ssize_t received = recv(m_fd, m_responses.tail(),
+						      m_responses.available(),
+						      MSG_DONTWAIT);
+			if (received == 0)
+				return Error_ConnectionClosed();
+			if (received < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK &&
+				    errno != EINTR)
+					return Error_System("Can't recv the response.");
+				continue;
+			}
+			const uint64_t received_ns = Timer::now_ns();
+			m_responses.produce(received);
+
+			const size_t first = response_count;
+			if (Error error = consume_responses(t, response_count); error)
+				return error;
+			for (size_t i = first; i < response_count; i++)
+				latencies_ns[i] = received_ns - group_ns[i / batch];
 		}
 		return {};
 	}
@@ -489,7 +1853,8 @@ private:
 
 		/* Read the size of response header and body. */
 		uint8_t res_size_buf[5];
-		read(m_fd, res_size_buf, 5);
+		if (receive(res_size_buf, 5, true) != 5)
+			Log::fatal_error("Couldn't get request response size");
 
 		/* Parse the size of response header and body. */
 		if (res_size_buf[0] != 0xCE) {
@@ -510,12 +1875,257 @@ private:
 					 "bytes for response body",
 					 res_header_and_body_size);
 		}
-		read(m_fd, res_header_and_body_buf, res_header_and_body_size);
+		/* Large responses don't come in a single read. */
+		const ssize_t received = receive(res_header_and_body_buf,
+						 res_header_and_body_size, true);
+		Response response;
+		const bool decoded = size_t(received) == res_header_and_body_size &&
+			decode_response((const char *)res_header_and_body_buf,
+					(const char *)res_header_and_body_buf +
+					res_header_and_body_size, response);
 		delete[] res_header_and_body_buf;
+		if (!decoded)
+			Log::fatal_error("Couldn't get request response size");
 
+		/* The size of a successful response is unknown then. */
+		if (response.is_error())
+			return 0;
 		return sizeof(res_size_buf) + res_header_and_body_size;
 	}
 
+private:
+	/*
+	 * Send as much of the rest of the transfer as the socket takes
+	 * without blocking. Returns the amount of bytes sent.
+	 */
+	ssize_t
+	send_some(struct Transfer &t, size_t &batch_pos, size_t &iov_pos,
+		  bool zerocopy)
+	{
+		ssize_t sent;
+		if (t.request_iov.empty()) {
+			sent = send(m_fd, t.request_batch.data() + batch_pos,
+				    t.request_batch.size() - batch_pos,
+				    MSG_DONTWAIT);
+			if (sent > 0)
+				batch_pos += sent;
+		} else {
+			std::vector<struct iovec> &iov = t.request_iov;
+			struct msghdr msg = {};
+			msg.msg_iov = &iov[iov_pos];
+			msg.msg_iovlen = std::min(iov.size() - iov_pos,
+						  size_t(IOV_MAX));
+			sent = sendmsg(m_fd, &msg, MSG_DONTWAIT |
+				       (zerocopy ? MSG_ZEROCOPY : 0));
+			if (sent > 0 && zerocopy)
+				m_zerocopy_sent++;
+			/* Step over the sent iovecs, a partial one is adjusted. */
+			for (ssize_t left = sent; left > 0; ) {
+				if (size_t(left) >= iov[iov_pos].iov_len) {
+					left -= iov[iov_pos].iov_len;
+					iov_pos++;
+				} else {
+					iov[iov_pos].iov_base =
+						(uint8_t *)iov[iov_pos].iov_base + left;
+					iov[iov_pos].iov_len -= left;
+					left = 0;
+				}
+			}
+		}
+		if (sent >= 0)
+			return sent;
+		/* The pages pinned by zero-copy sends are out of limit. */
+		if (errno == ENOBUFS && zerocopy)
+			return reap_zerocopy(true) ? -1 : 0;
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 0;
+		return -1;
+	}
+
+	/*
+	 * The fast path of the successful responses: the size prefix and
+	 * the zero IPROTO_REQUEST_TYPE going first in the header map are
+	 * checked with a single 8-byte load, the @a size is taken from it.
+	 */
+	static bool
+	is_ok_response(const uint8_t *data, size_t &size)
+	{
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		if constexpr (std::endian::native == std::endian::big)
+			word = __builtin_bswap64(word);
+		/* 0xCE, the size, a fixmap, the key 0x00 and the value 0x00. */
+		if ((word & 0xFFFFF000000000FFULL) != 0x00008000000000CEULL)
+			return false;
+		size = 5 + __builtin_bswap32(uint32_t(word >> 8));
+		return true;
+	}
+
+	/*
+	 * Check the complete responses in the response buffer and consume
+	 * them. @a response_count is the number of responses of the
+	 * transfer checked so far. The error responses are counted per
+	 * error code.
+	 */
+	Error
+	consume_responses(const struct Transfer &t, size_t &response_count)
+	{
+		/* 5 is the size of the size specifier itself. */
+		size_t size = 5;
+		while (response_count < t.request_count &&
+		       m_responses.used() >= 5) {
+			const uint8_t *data = m_responses.head();
+			if (m_responses.used() >= 8 && is_ok_response(data, size)) {
+				if (m_responses.used() < size)
+					break;
+			} else {
+				/*
+				 * Get the size of header and body. This value
+				 * is expected to be encoded in a 5-byte
+				 * MessagePack unsigned integer.
+				 */
+				if (data[0] != 0xCE)
+					return Error_ResponseSize();
+				const char *size_ptr = (const char *)&data[1];
+				size = 5 + mp_load_u32(&size_ptr);
+				if (m_responses.used() < size)
+					break;
+				Response response;
+				if (!decode_response(size_ptr, (const char *)data + size,
+						     response))
+					return Error_ResponseBody();
+				/* The size of an error response isn't expected. */
+				if (response.is_error()) {
+					m_errors.add(response.error_code(),
+						     response.error_message());
+					m_responses.consume(size);
+					response_count++;
+					size = 5;
+					continue;
+				}
+			}
+
+			if (!t.response_sizes.empty() &&
+			    size != t.response_sizes[response_count] &&
+			    !m_mismatch_reported) {
+				fprintf(stderr, "Error: Response size mismatch,"
+					" expected %lu, got %lu. Response:\n\n",
+					t.response_sizes[response_count] - 5,
+					size - 5);
+				Log::data(size, data);
+				m_mismatch_reported = true;
+			}
+
+			m_responses.consume(size);
+			response_count++;
+			size = 5;
+		}
+		/* Make room for the rest of the incomplete response. */
+		if (m_responses.available() == 0)
+			m_responses.reserve(std::max(size, m_responses.capacity()));
+		return {};
+	}
+
+	/*
+	 * Collect the completion notifications of zero-copy sends. Waits
+	 * for all of them if @a wait_all is set.
+	 */
+	Error
+	reap_zerocopy(bool wait_all)
+	{
+		while (m_zerocopy_completed != m_zerocopy_sent) {
+			char control[128];
+			struct msghdr msg = {};
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			if (recvmsg(m_fd, &msg, MSG_ERRQUEUE) < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					return Error_System("Can't read the error queue.");
+				if (!wait_all)
+					break;
+				/* POLLERR is reported with no events requested. */
+				struct pollfd pfd = {m_fd, 0, 0};
+				poll(&pfd, 1, -1);
+				continue;
+			}
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+			     cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				const struct sock_extended_err *err =
+					(const struct sock_extended_err *)CMSG_DATA(cmsg);
+				if (err->ee_errno != 0 ||
+				    err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+					continue;
+				/* The notification covers a range of sends. */
+				m_zerocopy_completed += err->ee_data - err->ee_info + 1;
+			}
+		}
+		return {};
+	}
+
+	/*
+	 * Receive @a size bytes if @a wait_all is set or at least one
+	 * byte otherwise. Spins if busy-polling is enabled.
+	 */
+	ssize_t
+	receive(uint8_t *buf, size_t size, bool wait_all)
+	{
+		if (!m_spin)
+			return recv(m_fd, buf, size, wait_all ? MSG_WAITALL : 0);
+		size_t received = 0;
+		do {
+			const ssize_t rc = recv(m_fd, buf + received,
+						size - received, MSG_DONTWAIT);
+			if (rc > 0)
+				received += rc;
+			else if (rc == 0)
+				break;
+			else if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+		} while (received < size && (wait_all || received == 0));
+		return received;
+	}
+
+	static size_t
+	sizeof_stream_header(uint64_t stream_id)
+	{
+		/* Header map, IPROTO_REQUEST_TYPE and IPROTO_SYNC. */
+		size_t size = 5;
+		if (stream_id != 0)
+			size += 1 + MsgPack::sizeof_uint(stream_id);
+		return size;
+	}
+
+	static void
+	append_stream_header(MsgPack::Builder &builder, uint8_t type,
+			     const char *type_name, uint64_t stream_id)
+	{
+		builder.append_raw(stream_id != 0 ? 0x83 : 0x82, "header");
+		builder.append_raw(0x00, "IPROTO_REQUEST_TYPE");
+		builder.append_raw(type, type_name);
+		builder.append_raw(0x01, "IPROTO_SYNC");
+		builder.append_raw(0x00, "unchecked sync value");
+		if (stream_id != 0) {
+			builder.append_raw(0x0A, "IPROTO_STREAM_ID");
+			builder.append_uint(stream_id, "stream ID");
+		}
+	}
+
 private:
 	int m_fd = -1;
+	/* Spin in non-blocking receive instead of blocking. */
+	bool m_spin = false;
+	/* Minimal transfer size to send with MSG_ZEROCOPY, 0 to never. */
+	size_t m_zerocopy_threshold = 0;
+	/* Zero-copy sendmsg() calls made and completed. */
+	uint64_t m_zerocopy_sent = 0;
+	uint64_t m_zerocopy_completed = 0;
+	/* The responses being received and checked. */
+	ResponseBuffer m_responses{RESPONSE_BUFFER_SIZE};
+	/* Has a response size mismatch of the transfer been reported? */
+	bool m_mismatch_reported = false;
+	ErrorStats m_errors;
+	/* The server version and the salt from the greeting. */
+	std::string m_version;
+	uint8_t m_salt[32] = {};
+	size_t m_salt_size = 0;
 };
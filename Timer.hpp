@@ -1,21 +1,165 @@
 #pragma once
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TIMER_HAS_TSC 1
+#endif
+
+/*
+ * A monotonic nanosecond timer. It reads the invariant TSC if the
+ * CPU has one and converts ticks into nanoseconds of CLOCK_MONOTONIC
+ * using the factor measured by calibrate(). Falls back to the plain
+ * clock_gettime() otherwise (or until calibrated).
+ */
 class Timer {
-	struct timespec m_t0;
+	__extension__ typedef unsigned __int128 uint128_t;
+
+	uint64_t m_t0;
+
+	/* Fixed point nanoseconds per tick, 32 fractional bits. */
+	static inline uint64_t s_mult = 0;
+	/* The TSC and CLOCK_MONOTONIC values matching each other. */
+	static inline uint64_t s_tsc_base = 0;
+	static inline uint64_t s_clock_base = 0;
+	/* The average cost of a now_ns() call. */
+	static inline double s_overhead_ns = 0.0;
 
 public:
 	Timer()
-	{
-		clock_gettime(CLOCK_MONOTONIC, &m_t0);
-	}
+	: m_t0(now_ns())
+	{}
 
 	uint64_t
 	ns()
 	{
-		struct timespec t1;
-		clock_gettime(CLOCK_MONOTONIC, &t1);
-		/* TODO: Fix this comparison. */
-		return (t1.tv_sec * 1000000000llu + t1.tv_nsec) -
-		       (m_t0.tv_sec * 1000000000llu + m_t0.tv_nsec);
+		return now_ns() - m_t0;
+	}
+
+	/* Current CLOCK_MONOTONIC time in nanoseconds. */
+	static uint64_t
+	now_ns()
+	{
+#ifdef TIMER_HAS_TSC
+		if (s_mult != 0) {
+			const uint64_t ticks = tsc() - s_tsc_base;
+			return s_clock_base +
+			       uint64_t(((uint128_t)ticks * s_mult) >> 32);
+		}
+#endif
+		return clock_ns();
+	}
+
+	/*
+	 * Check if the TSC is invariant and measure its frequency
+	 * against CLOCK_MONOTONIC. Then measure the timer overhead.
+	 */
+	static void
+	calibrate()
+	{
+#ifdef TIMER_HAS_TSC
+		if (has_invariant_tsc()) {
+			uint64_t tsc0 = 0, clock0 = 0, tsc1 = 0, clock1 = 0;
+			sample(tsc0, clock0);
+			/* Long enough to make the error negligible. */
+			const struct timespec duration = {0, 50000000};
+			nanosleep(&duration, NULL);
+			sample(tsc1, clock1);
+			if (tsc1 > tsc0 && clock1 > clock0) {
+				s_tsc_base = tsc0;
+				s_clock_base = clock0;
+				s_mult = uint64_t(((uint128_t)(clock1 - clock0)
+						   << 32) /
+						  (tsc1 - tsc0));
+			}
+		}
+#endif
+		/* Measure the cost of reading the timer. */
+		const size_t count = 1000000;
+		const uint64_t start = clock_ns();
+		uint64_t sink = 0;
+		for (size_t i = 0; i < count; i++)
+			sink += now_ns();
+		s_overhead_ns = double(clock_ns() - start) / count;
+		asm volatile("" : : "r"(sink));
+	}
+
+	/* The name of the time source in use. */
+	static const char *
+	source()
+	{
+		return s_mult != 0 ? "tsc" : "clock_gettime";
+	}
+
+	/* The TSC frequency in GHz or zero if it's not used. */
+	static double
+	tsc_ghz()
+	{
+		return s_mult != 0 ? 4294967296.0 / s_mult : 0.0;
+	}
+
+	static double
+	overhead_ns()
+	{
+		return s_overhead_ns;
+	}
+
+private:
+	static uint64_t
+	clock_ns()
+	{
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec * 1000000000llu + t.tv_nsec;
+	}
+
+#ifdef TIMER_HAS_TSC
+	/*
+	 * RDTSCP waits for the preceding instructions to complete and
+	 * LFENCE keeps the following ones from starting before the read.
+	 */
+	static uint64_t
+	tsc()
+	{
+		unsigned int aux;
+		const uint64_t result = __rdtscp(&aux);
+		_mm_lfence();
+		return result;
+	}
+
+	static bool
+	has_invariant_tsc()
+	{
+		unsigned int eax, ebx, ecx, edx;
+		/* RDTSCP support. */
+		if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) ||
+		    (edx & (1u << 27)) == 0)
+			return false;
+		/* Invariant TSC: constant rate in all the C/P-states. */
+		if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+			return false;
+		return (edx & (1u << 8)) != 0;
+	}
+
+	/*
+	 * Read the TSC and the clock as close to each other as possible:
+	 * take the clock between two TSC reads and retry a few times to
+	 * get the closest pair.
+	 */
+	static void
+	sample(uint64_t &tsc_value, uint64_t &clock_value)
+	{
+		uint64_t best = UINT64_MAX;
+		for (int i = 0; i < 16; i++) {
+			const uint64_t before = tsc();
+			const uint64_t clock = clock_ns();
+			const uint64_t after = tsc();
+			if (after - before < best) {
+				best = after - before;
+				tsc_value = before + (after - before) / 2;
+				clock_value = clock;
+			}
+		}
 	}
+#endif
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <string>
+#include <vector>
+
+/* Placement of the client workers on CPUs and NUMA nodes. */
+namespace Topology {
+
+/*
+ * Split per-worker CPU lists separated by colons, e.g. "0-3:4-7"
+ * pins the first worker to CPUs 0-3 and the second one to 4-7. If
+ * there are more workers than lists, the lists are reused in order.
+ */
+std::vector<std::string>
+split_cpu_lists(const char *spec)
+{
+	std::vector<std::string> result;
+	std::string current;
+	for (const char *p = spec; ; p++) {
+		if (*p == ':' || *p == '\0') {
+			result.push_back(current);
+			current.clear();
+			if (*p == '\0')
+				break;
+		} else {
+			current.push_back(*p);
+		}
+	}
+	return result;
+}
+
+/* Parse a CPU list like "0,2,4-7". */
+Error
+parse_cpu_list(const std::string &list, cpu_set_t &cpus)
+{
+	CPU_ZERO(&cpus);
+	const char *p = list.c_str();
+	while (*p != '\0') {
+		char *end;
+		const unsigned long first = strtoul(p, &end, 10);
+		unsigned long last = first;
+		if (end == p)
+			return Error_CpuList(list.c_str());
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first)
+				return Error_CpuList(list.c_str());
+		}
+		if (last >= CPU_SETSIZE)
+			return Error_CpuList(list.c_str());
+		for (unsigned long cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, &cpus);
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return Error_CpuList(list.c_str());
+		p = end;
+	}
+	return {};
+}
+
+/* Pin the calling thread to the CPUs of the list. */
+Error
+pin(const std::string &list)
+{
+	cpu_set_t cpus;
+	if (Error error = parse_cpu_list(list, cpus); error)
+		return error;
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+		return Error_System("Can't set the CPU affinity");
+	return {};
+}
+
+/*
+ * Make the memory allocated by the calling thread come from the
+ * NUMA node the thread is running on.
+ */
+Error
+use_local_memory()
+{
+	if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) != 0)
+		return Error_System("Can't set the NUMA memory policy");
+	return {};
+}
+
+/* The CPU and the NUMA node the calling thread is running on. */
+void
+where(int &cpu, int &node)
+{
+	unsigned int cpu_id = 0, node_id = 0;
+	if (getcpu(&cpu_id, &node_id) != 0) {
+		cpu = -1;
+		node = -1;
+		return;
+	}
+	cpu = cpu_id;
+	node = node_id;
+}
+
+} // namespace Topology
@@ -0,0 +1,682 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <cmath>
+#include <coroutine>
+#include <queue>
+
+#include "Net.hpp"
+#include "Report.hpp"
+#include "Rng.hpp"
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+/*
+ * Virtual users: each user is a coroutine running a short script of
+ * requests (e.g. a get and an update of the same key) in a loop with
+ * a think time between the iterations. Any number of users share a
+ * pool of non-blocking connections driven by a single epoll loop, so
+ * each of them costs a suspended coroutine. A user has at most one
+ * request in flight, its IPROTO_SYNC is the user number, so the
+ * responses are matched to the users in whatever order they come.
+ */
+namespace Users {
+
+/* The space the users work with, the key is the first field. */
+constexpr uint32_t SPACE_ID = 512;
+
+/* The requests a script is made of. */
+enum Step {
+	PING,
+	GET,    /* Select the key. */
+	PUT,    /* Replace the key with a counter. */
+	UPDATE, /* Increment the counter of the key. */
+	STEP_COUNT,
+};
+
+static constexpr const char *step_names[] = {
+	"ping", "get", "put", "update",
+};
+
+/* The time a user waits between the iterations of the script. */
+struct ThinkTime {
+	enum Distribution {
+		CONSTANT,
+		UNIFORM,     /* From zero to twice the mean. */
+		EXPONENTIAL, /* The times between the arrivals of a Poisson flow. */
+	};
+
+	static constexpr const char *distribution_names[] = {
+		"constant", "uniform", "exponential",
+	};
+
+	Distribution distribution = CONSTANT;
+	uint64_t mean_ns = 0;
+
+	uint64_t
+	next() const
+	{
+		/* Rng::u32() is within [1, 0x7ffffffe]. */
+		const double x = (Rng::u32() - 1) / double(0x7ffffffe);
+		switch (distribution) {
+		case CONSTANT:
+			return mean_ns;
+		case UNIFORM:
+			return 2 * mean_ns * x;
+		case EXPONENTIAL:
+			return -std::log(1 - x) * mean_ns;
+		}
+		std::unreachable();
+	}
+};
+
+struct Settings {
+	size_t user_count;
+	size_t connection_count;
+	std::vector<Step> script;
+	ThinkTime think_time;
+	/* The requests to make overall. */
+	size_t request_count;
+};
+
+struct Result {
+	uint64_t duration_ns = 0;
+	size_t iteration_count = 0;
+	/* Latencies of the requests of each step. */
+	std::vector<uint64_t> latencies_ns[STEP_COUNT];
+	/* Latencies of the script iterations excluding the think time. */
+	std::vector<uint64_t> iteration_latencies_ns;
+	Tarantool::ErrorStats errors;
+};
+
+/* A user coroutine, started and destroyed by the engine. */
+struct Task {
+	struct promise_type {
+		Task
+		get_return_object()
+		{
+			return {std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+
+		std::suspend_always
+		initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_always
+		final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void
+		return_void()
+		{}
+
+		void
+		unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+class Engine {
+public:
+	Engine(const Settings &settings, Result &result)
+	: m_settings(settings)
+	, m_result(result)
+	, m_users(settings.user_count)
+	, m_iterations_left(std::max(settings.request_count /
+				     settings.script.size(), size_t(1)))
+	{}
+
+	Engine(const Engine &other) = delete;
+
+	~Engine()
+	{
+		for (auto &user: m_users) {
+			if (user.task)
+				user.task.destroy();
+		}
+		for (auto &c: m_connections)
+			close(c.fd);
+		if (m_timer_fd >= 0)
+			close(m_timer_fd);
+		if (m_epoll_fd >= 0)
+			close(m_epoll_fd);
+	}
+
+	/* Connect and skip the greetings prior to the run. */
+	Error
+	connect(const Net::Endpoint &endpoint)
+	{
+		m_epoll_fd = epoll_create1(0);
+		m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+		if (m_epoll_fd < 0 || m_timer_fd < 0)
+			return Error_System("Can't create the event loop");
+		if (Error error = watch(m_timer_fd, TIMER, EPOLLIN); error)
+			return error;
+		m_connections.resize(m_settings.connection_count);
+		for (size_t i = 0; i < m_connections.size(); i++) {
+			Connection &c = m_connections[i];
+			c.fd = Net::connect(endpoint);
+			char greeting[128];
+			if (recv(c.fd, greeting, sizeof(greeting),
+				 MSG_WAITALL) != sizeof(greeting))
+				return Error_System("Can't read the greeting");
+			fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+			if (Error error = watch(c.fd, i, EPOLLIN); error)
+				return error;
+		}
+		return {};
+	}
+
+	/* Run the users until the requests are all made. */
+	Error
+	run()
+	{
+		const uint64_t start_ns = Timer::now_ns();
+		m_active_user_count = m_users.size();
+		for (size_t i = 0; i < m_users.size(); i++) {
+			m_users[i].task = user(i).handle;
+			m_users[i].task.resume();
+		}
+
+		std::vector<struct epoll_event> events(256);
+		while (m_active_user_count != 0 && !m_error) {
+			/* Wake up the users whose think time is over. */
+			const uint64_t now_ns = Timer::now_ns();
+			while (!m_timers.empty() && m_timers.top().ns <= now_ns) {
+				const auto handle = m_timers.top().handle;
+				m_timers.pop();
+				handle.resume();
+			}
+			flush();
+			if (m_active_user_count == 0 || m_error)
+				break;
+			if (Error error = arm_timer(); error)
+				return error;
+
+			const int count = epoll_wait(m_epoll_fd, events.data(),
+						     events.size(), -1);
+			if (count < 0 && errno != EINTR)
+				return Error_System("Can't wait for the events");
+			for (int i = 0; i < count && !m_error; i++) {
+				const uint32_t id = events[i].data.u32;
+				if (id == TIMER) {
+					uint64_t expirations;
+					(void)!read(m_timer_fd, &expirations,
+						    sizeof(expirations));
+					m_armed_ns = 0;
+					continue;
+				}
+				if ((events[i].events & EPOLLOUT) != 0)
+					send_some(m_connections[id]);
+				if ((events[i].events & (EPOLLIN | EPOLLERR |
+							 EPOLLHUP)) != 0)
+					receive(m_connections[id]);
+			}
+		}
+		m_result.duration_ns = Timer::now_ns() - start_ns;
+		return std::move(m_error);
+	}
+
+private:
+	/* What a user resumed by a response gets. */
+	struct Reply {
+		uint32_t code;
+	};
+
+	struct Call {
+		Engine &engine;
+		size_t user;
+		Step step;
+		uint64_t key;
+
+		bool
+		await_ready()
+		{
+			return false;
+		}
+
+		void
+		await_suspend(std::coroutine_handle<> handle)
+		{
+			engine.call(user, step, key, handle);
+		}
+
+		Reply
+		await_resume()
+		{
+			return {engine.m_users[user].code};
+		}
+	};
+
+	struct Sleep {
+		Engine &engine;
+		uint64_t ns;
+
+		bool
+		await_ready()
+		{
+			return ns == 0;
+		}
+
+		void
+		await_suspend(std::coroutine_handle<> handle)
+		{
+			engine.m_timers.push({Timer::now_ns() + ns, handle});
+		}
+
+		void
+		await_resume()
+		{}
+	};
+
+	/* The script of a user. */
+	Task
+	user(size_t id)
+	{
+		const ThinkTime &think_time = m_settings.think_time;
+		/* Spread the start of the users over the think time. */
+		co_await Sleep{*this, think_time.next()};
+		for (uint64_t counter = 0; m_iterations_left != 0; counter++) {
+			m_iterations_left--;
+			const uint64_t key = Rng::u32() % m_settings.user_count;
+			const uint64_t start_ns = Timer::now_ns();
+			for (Step step: m_settings.script) {
+				m_users[id].counter = counter;
+				co_await Call{*this, id, step, key};
+			}
+			m_result.iteration_latencies_ns.push_back(Timer::now_ns() -
+								  start_ns);
+			m_result.iteration_count++;
+			co_await Sleep{*this, think_time.next()};
+		}
+		m_active_user_count--;
+	}
+
+	/* Queue the request of the user, it's sent on the next flush. */
+	void
+	call(size_t id, Step step, uint64_t key, std::coroutine_handle<> handle)
+	{
+		User &user = m_users[id];
+		user.handle = handle;
+		user.step = step;
+		Connection &c = m_connections[id % m_connections.size()];
+		write_request(c.out, id, step, key, user.counter);
+		if (!c.dirty) {
+			c.dirty = true;
+			m_dirty.push_back(&c);
+		}
+		user.sent_ns = Timer::now_ns();
+	}
+
+	static void
+	write_request(std::vector<uint8_t> &out, uint64_t sync, Step step,
+		      uint64_t key, uint64_t counter)
+	{
+		const size_t offset = out.size();
+		out.resize(offset + 64);
+		char *const begin = (char *)&out[offset];
+		char *data = begin + 5;
+		static constexpr uint8_t types[] = {0x40, 0x01, 0x03, 0x04};
+		data = mp_encode_map(data, 2);
+		data = mp_encode_uint(data, 0x00); /* IPROTO_REQUEST_TYPE */
+		data = mp_encode_uint(data, types[step]);
+		data = mp_encode_uint(data, 0x01); /* IPROTO_SYNC */
+		data = mp_encode_uint(data, sync);
+		switch (step) {
+		case PING:
+			data = mp_encode_map(data, 0);
+			break;
+		case GET:
+			data = mp_encode_map(data, 6);
+			data = mp_encode_uint(data, 0x10); /* IPROTO_SPACE_ID */
+			data = mp_encode_uint(data, SPACE_ID);
+			data = mp_encode_uint(data, 0x11); /* IPROTO_INDEX_ID */
+			data = mp_encode_uint(data, 0);
+			data = mp_encode_uint(data, 0x12); /* IPROTO_LIMIT */
+			data = mp_encode_uint(data, 1);
+			data = mp_encode_uint(data, 0x13); /* IPROTO_OFFSET */
+			data = mp_encode_uint(data, 0);
+			data = mp_encode_uint(data, 0x14); /* IPROTO_ITERATOR */
+			data = mp_encode_uint(data, 0);    /* ITER_EQ */
+			data = mp_encode_uint(data, 0x20); /* IPROTO_KEY */
+			data = mp_encode_array(data, 1);
+			data = mp_encode_uint(data, key);
+			break;
+		case PUT:
+			data = mp_encode_map(data, 2);
+			data = mp_encode_uint(data, 0x10); /* IPROTO_SPACE_ID */
+			data = mp_encode_uint(data, SPACE_ID);
+			data = mp_encode_uint(data, 0x21); /* IPROTO_TUPLE */
+			data = mp_encode_array(data, 2);
+			data = mp_encode_uint(data, key);
+			data = mp_encode_uint(data, counter);
+			break;
+		case UPDATE:
+			data = mp_encode_map(data, 5);
+			data = mp_encode_uint(data, 0x10); /* IPROTO_SPACE_ID */
+			data = mp_encode_uint(data, SPACE_ID);
+			data = mp_encode_uint(data, 0x11); /* IPROTO_INDEX_ID */
+			data = mp_encode_uint(data, 0);
+			data = mp_encode_uint(data, 0x15); /* IPROTO_INDEX_BASE */
+			data = mp_encode_uint(data, 1);
+			data = mp_encode_uint(data, 0x20); /* IPROTO_KEY */
+			data = mp_encode_array(data, 1);
+			data = mp_encode_uint(data, key);
+			data = mp_encode_uint(data, 0x21); /* IPROTO_TUPLE */
+			data = mp_encode_array(data, 1);
+			data = mp_encode_array(data, 3);
+			data = mp_encode_str(data, "+", 1);
+			data = mp_encode_uint(data, 2);
+			data = mp_encode_uint(data, 1);
+			break;
+		case STEP_COUNT:
+			std::unreachable();
+		}
+		begin[0] = (char)0xCE;
+		Data::set_uint32_be((uint8_t *)begin + 1, data - begin - 5);
+		out.resize(data - (char *)out.data());
+	}
+
+	/* A connection shared by the users. */
+	struct Connection {
+		int fd = -1;
+		/* The requests queued and the part of them sent. */
+		std::vector<uint8_t> out;
+		size_t out_pos = 0;
+		/* Is EPOLLOUT being waited for? */
+		bool blocked = false;
+		/* Is it in the flush list? */
+		bool dirty = false;
+		ResponseBuffer in{64 * 1024};
+	};
+
+	/* Send the requests queued by the users resumed since last time. */
+	void
+	flush()
+	{
+		for (Connection *c: m_dirty) {
+			c->dirty = false;
+			if (!c->blocked)
+				send_some(*c);
+		}
+		m_dirty.clear();
+	}
+
+	void
+	send_some(Connection &c)
+	{
+		if (c.out_pos < c.out.size()) {
+			const ssize_t sent = send(c.fd, c.out.data() + c.out_pos,
+						  c.out.size() - c.out_pos,
+						  MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent > 0) {
+				c.out_pos += sent;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK &&
+				   errno != EINTR) {
+				m_error = Error_System("Can't send the requests");
+				return;
+			}
+		}
+		if (c.out_pos == c.out.size()) {
+			c.out.clear();
+			c.out_pos = 0;
+		}
+		/* Wait for the socket to take the rest. */
+		const bool blocked = !c.out.empty();
+		if (blocked != c.blocked) {
+			c.blocked = blocked;
+			struct epoll_event event = {};
+			event.events = EPOLLIN | (blocked ? uint32_t(EPOLLOUT) : 0);
+			event.data.u32 = &c - m_connections.data();
+			epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, c.fd, &event);
+		}
+	}
+
+	/* Receive the responses and resume the users they are for. */
+	void
+	receive(Connection &c)
+	{
+		const ssize_t received = recv(c.fd, c.in.tail(), c.in.available(),
+					      MSG_DONTWAIT);
+		if (received == 0) {
+			m_error = Error_ConnectionClosed();
+			return;
+		}
+		if (received < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR)
+				m_error = Error_System("Can't recv the responses");
+			return;
+		}
+		const uint64_t received_ns = Timer::now_ns();
+		c.in.produce(received);
+
+		size_t size = 5;
+		while (c.in.used() >= 5) {
+			const uint8_t *data = c.in.head();
+			if (data[0] != 0xCE) {
+				m_error = Error_ResponseSize();
+				return;
+			}
+			const char *header = (const char *)data + 1;
+			size = 5 + mp_load_u32(&header);
+			if (c.in.used() < size)
+				break;
+			Tarantool::Response response;
+			if (!Tarantool::decode_response(header, (const char *)data +
+							size, response) ||
+			    response.sync >= m_users.size()) {
+				m_error = Error_ResponseBody();
+				return;
+			}
+			User &user = m_users[response.sync];
+			if (response.is_error()) {
+				m_result.errors.add(response.error_code(),
+						    response.error_message());
+			}
+			m_result.latencies_ns[user.step].push_back(received_ns -
+								   user.sent_ns);
+			user.code = response.code;
+			c.in.consume(size);
+			size = 5;
+			user.handle.resume();
+		}
+		/* Make room for the rest of the incomplete response. */
+		if (c.in.available() == 0)
+			c.in.reserve(std::max(size, c.in.capacity()));
+	}
+
+	/* Make the timer fire at the earliest wake-up of the users. */
+	Error
+	arm_timer()
+	{
+		if (m_timers.empty() || m_timers.top().ns == m_armed_ns)
+			return {};
+		m_armed_ns = m_timers.top().ns;
+		const uint64_t now_ns = Timer::now_ns();
+		const uint64_t ns = m_armed_ns > now_ns ? m_armed_ns - now_ns : 1;
+		struct itimerspec spec = {};
+		spec.it_value.tv_sec = ns / 1000000000;
+		spec.it_value.tv_nsec = ns % 1000000000;
+		if (timerfd_settime(m_timer_fd, 0, &spec, NULL) != 0)
+			return Error_System("Can't arm the timer");
+		return {};
+	}
+
+	Error
+	watch(int fd, uint32_t id, uint32_t events)
+	{
+		struct epoll_event event = {};
+		event.events = events;
+		event.data.u32 = id;
+		if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+			return Error_System("Can't watch the descriptor");
+		return {};
+	}
+
+private:
+	/* The epoll data of the timer, the connections have their indexes. */
+	static constexpr uint32_t TIMER = UINT32_MAX;
+
+	struct User {
+		std::coroutine_handle<Task::promise_type> task;
+		/* The point the user is suspended at. */
+		std::coroutine_handle<> handle;
+		/* The request in flight. */
+		Step step = PING;
+		uint64_t sent_ns = 0;
+		uint32_t code = 0;
+		/* The value put by the user. */
+		uint64_t counter = 0;
+	};
+
+	/* A user waiting for the think time to pass. */
+	struct Wakeup {
+		uint64_t ns;
+		std::coroutine_handle<> handle;
+
+		bool
+		operator>(const Wakeup &other) const
+		{
+			return ns > other.ns;
+		}
+	};
+
+	const Settings &m_settings;
+	Result &m_result;
+	std::vector<User> m_users;
+	std::vector<Connection> m_connections;
+	/* The connections with the requests queued since the last flush. */
+	std::vector<Connection *> m_dirty;
+	std::priority_queue<Wakeup, std::vector<Wakeup>,
+			    std::greater<Wakeup>> m_timers;
+	/* The wake-up the timer is armed for, 0 if it isn't. */
+	uint64_t m_armed_ns = 0;
+	size_t m_iterations_left;
+	size_t m_active_user_count = 0;
+	int m_epoll_fd = -1;
+	int m_timer_fd = -1;
+	Error m_error;
+};
+
+/* Run the virtual users of the @a settings and report the steps. */
+Error
+benchmark(const Net::Endpoint &endpoint, const Users::Settings &settings,
+	  const char *results)
+{
+	Users::Result result;
+	Users::Engine engine(settings, result);
+	if (Error error = engine.connect(endpoint); error)
+		return error;
+	if (Error error = engine.run(); error)
+		return error;
+
+	using namespace Statistics;
+	size_t request_count = 0;
+	for (const auto &latencies_ns: result.latencies_ns)
+		request_count += latencies_ns.size();
+	const double seconds = result.duration_ns / 1000000000.0;
+	std::string script;
+	for (Users::Step step: settings.script) {
+		script += script.empty() ? "" : ",";
+		script += Users::step_names[step];
+	}
+
+	printf("Users: %lu\n", settings.user_count);
+	printf("Connections: %lu\n", settings.connection_count);
+	printf("Script: %s\n", script.c_str());
+	printf("Think time: %s, mean (μs): %.3f\n",
+	       Users::ThinkTime::distribution_names[
+		       settings.think_time.distribution],
+	       settings.think_time.mean_ns / 1000.0);
+	printf("Iterations: %lu\n", result.iteration_count);
+	printf("Iterations per second: %.0f\n",
+	       result.iteration_count / seconds);
+	printf("RPS: %.0f\n", request_count / seconds);
+	Report::print_errors(result.errors);
+	printf("%10s %10s %10s %10s %10s %10s\n", "Step", "Requests",
+	       "Avg (μs)", "Med (μs)", "99% (μs)", "99.9% (μs)");
+	auto print_row = [](const char *name, std::vector<uint64_t> &latencies_ns) {
+		if (latencies_ns.empty())
+			return;
+		std::sort(latencies_ns.begin(), latencies_ns.end());
+		printf("%10s %10lu %10.3f %10.3f %10.3f %10.3f\n", name,
+		       latencies_ns.size(), average(latencies_ns) / 1000.0,
+		       median(latencies_ns) / 1000.0,
+		       percentile(latencies_ns, 0.99) / 1000.0,
+		       percentile(latencies_ns, 0.999) / 1000.0);
+	};
+	for (size_t step = 0; step < Users::STEP_COUNT; step++)
+		print_row(Users::step_names[step], result.latencies_ns[step]);
+	print_row("iteration", result.iteration_latencies_ns);
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		auto write_latencies = [&json](const std::vector<uint64_t> &latencies_ns) {
+			json.begin_object();
+			json.key("requests");
+			json.value(uint64_t(latencies_ns.size()));
+			if (!latencies_ns.empty())
+				Report::write_latencies(json, latencies_ns);
+			json.end_object();
+		};
+		json.begin_object();
+		json.key("users");
+		json.value(uint64_t(settings.user_count));
+		json.key("connections");
+		json.value(uint64_t(settings.connection_count));
+		json.key("script");
+		json.value(script);
+		json.key("think_time");
+		json.begin_object();
+		{
+			json.key("distribution");
+			json.value(Users::ThinkTime::distribution_names[
+				settings.think_time.distribution]);
+			json.key("mean_us");
+			json.value(settings.think_time.mean_ns / 1000.0);
+		}
+		json.end_object();
+		json.key("summary");
+		json.begin_object();
+		{
+			json.key("iterations");
+			json.value(uint64_t(result.iteration_count));
+			json.key("iterations_per_second");
+			json.value(result.iteration_count / seconds);
+			json.key("rps");
+			json.value(request_count / seconds);
+			json.key("errors");
+			json.value(result.errors.count);
+			json.key("iteration");
+			write_latencies(result.iteration_latencies_ns);
+			json.key("steps");
+			json.begin_object();
+			for (size_t step = 0; step < Users::STEP_COUNT; step++) {
+				if (result.latencies_ns[step].empty())
+					continue;
+				json.key(Users::step_names[step]);
+				write_latencies(result.latencies_ns[step]);
+			}
+			json.end_object();
+		}
+		json.end_object();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Users
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "Report.hpp"
+#include "Rng.hpp"
+#include "Sampler.hpp"
+#include "Server.hpp"
+#include "Sweep.hpp"
+#include "Tarantool.hpp"
+
+/*
+ * Vinyl with a cold and a warm cache: the dataset is preloaded in chunks
+ * and dumped to disk, then the same keys are read twice in a random order,
+ * the first time with the cache cold (the server is restarted if it's
+ * launched by ttbench), the second time with it warmed up by the first
+ * pass. The dumps, the compaction and the cache of box.stat.vinyl() are
+ * compared around each phase.
+ */
+namespace Vinyl {
+
+/* The expression sampling the vinyl statistics. */
+constexpr const char *STAT = "return box.stat.vinyl()";
+
+/* The requests generated at once while preloading the dataset. */
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+/* The counters of box.stat.vinyl() compared around a phase. */
+struct Stat {
+	uint64_t dump_count = 0;
+	/* Bytes. */
+	uint64_t dump_input = 0;
+	uint64_t compaction_input = 0;
+	uint64_t tuple_cache = 0;
+	uint64_t disk_data = 0;
+};
+
+/* The measurements of a phase. */
+struct Phase {
+	const char *name;
+	Sweep::Result result;
+	Stat before;
+	Stat after;
+	uint64_t start_ns;
+	/* The box.stat.vinyl() samples taken during the phase. */
+	std::vector<Sampler::Sample> samples;
+};
+
+inline Error
+read_stat(Tarantool &tt, Stat &stat)
+{
+	std::vector<uint8_t> buffer;
+	const char *data;
+	if (Error error = tt.evaluate(STAT, buffer, &data); error)
+		return error;
+	if (data == NULL)
+		return Error_ResponseBody();
+	Tarantool::lookup(data, {"scheduler", "dump_count"}, stat.dump_count);
+	Tarantool::lookup(data, {"scheduler", "dump_input"}, stat.dump_input);
+	Tarantool::lookup(data, {"scheduler", "compaction_input"},
+			  stat.compaction_input);
+	Tarantool::lookup(data, {"memory", "tuple_cache"}, stat.tuple_cache);
+	Tarantool::lookup(data, {"disk", "data"}, stat.disk_data);
+	return {};
+}
+
+/* Is the space the requests go to a vinyl one? */
+inline Error
+check_engine(const Net::Endpoint &endpoint)
+{
+	Tarantool tt(endpoint);
+	std::vector<uint8_t> buffer;
+	const char *data;
+	if (Error error = tt.evaluate("return box.space.s.engine", buffer,
+				      &data); error)
+		return error;
+	if (data == NULL || mp_typeof(*data) != MP_STR)
+		return Error_ResponseBody();
+	uint32_t len;
+	const char *engine = mp_decode_str(&data, &len);
+	if (std::string_view(engine, len) != "vinyl")
+		return Error_VinylEngine(std::string_view(engine, len));
+	return {};
+}
+
+/* Append the key of the @a request to the @a keys, it must be unsigned. */
+inline Error
+append_key(const uint8_t *request, std::vector<uint64_t> &keys)
+{
+	const char *key = Tarantool::first_key_part(request);
+	if (key == NULL || mp_typeof(*key) != MP_UINT)
+		return Error_VinylKey();
+	keys.push_back(mp_decode_uint(&key));
+	return {};
+}
+
+/*
+ * Append the key of each of the requests of the @a runner, the one of
+ * the generator included, to the @a keys.
+ */
+inline Error
+append_keys(const Sweep::Runner &runner, std::vector<uint64_t> &keys)
+{
+	if (!runner.probe().empty()) {
+		if (Error error = append_key(runner.probe().data(), keys);
+		    error)
+			return error;
+	}
+	for (size_t i = 0; i < runner.request_count(); i++) {
+		if (Error error = append_key(runner.request(i), keys); error)
+			return error;
+	}
+	return {};
+}
+
+/* Make a select request for each of the @a keys, in a random order. */
+inline void
+make_reads(std::vector<uint64_t> &keys, uint32_t space_id,
+	   std::vector<uint8_t> &reads)
+{
+	for (size_t i = keys.size(); i > 1; i--)
+		std::swap(keys[i - 1], keys[Rng::u32() % i]);
+	reads.clear();
+	for (uint64_t key: keys)
+		Tarantool::write_get_request(reads, space_id, key, 0);
+}
+
+/*
+ * Replace @a key_count tuples of the @a payload in chunks, so only a
+ * chunk of the dataset is held at once, and collect their @a keys. The
+ * generator of each chunk replaces one more tuple on its own, it's
+ * counted but not timed. The throughput is of all the chunks, the
+ * latencies are the worst ones of a chunk.
+ */
+inline Error
+preload(const Net::Endpoint &endpoint, Payload &payload, size_t key_count,
+	const Sweep::Point &point, size_t response_buffer_size,
+	std::vector<uint64_t> &keys, Sweep::Result &result)
+{
+	Sweep::Runner writer(endpoint, point.connection_count,
+			     response_buffer_size);
+	result = {point};
+	size_t timed = 0;
+	double duration_s = 0;
+	for (size_t done = 0; done < key_count; ) {
+		/* The tuple replaced by the generator is counted too. */
+		const size_t n = std::min(CHUNK_SIZE, key_count - done - 1);
+		if (Error error = writer.generate(payload, "replace", n); error)
+			return error;
+		if (Error error = append_keys(writer, keys); error)
+			return error;
+		done += n + 1;
+		if (n == 0)
+			break;
+		Sweep::Result chunk;
+		if (Error error = writer.run(point, chunk); error)
+			return error;
+		timed += n;
+		duration_s += n / chunk.rps;
+		result.error_count += chunk.error_count;
+		result.med_us = std::max(result.med_us, chunk.med_us);
+		result.p99_us = std::max(result.p99_us, chunk.p99_us);
+		result.p999_us = std::max(result.p999_us, chunk.p999_us);
+	}
+	result.rps = timed != 0 ? timed / duration_s : 0;
+	return {};
+}
+
+/*
+ * Preload @a key_count keys into the vinyl space, then read them with
+ * the cache cold and warm, and report the phases.
+ */
+inline Error
+benchmark(const Net::Endpoint &endpoint, const char *script, Payload &payload,
+	  size_t key_count, size_t batch, size_t connection_count,
+	  size_t cache_mb, uint64_t sample_interval_ms,
+	  size_t response_buffer_size, const char *results)
+{
+	std::unique_ptr<Server> server;
+	if (script != NULL) {
+		server = std::make_unique<Server>(script, endpoint);
+		server->set_env("TTBENCH_ENGINE", "vinyl");
+		if (cache_mb != 0) {
+			server->set_env("TTBENCH_VINYL_CACHE",
+					std::to_string(cache_mb << 20));
+		}
+		if (Error error = server->start(); error)
+			return error;
+	} else if (Error error = Vinyl::check_engine(endpoint); error) {
+		return error;
+	}
+
+	std::vector<Vinyl::Phase> phases;
+	const Sweep::Point point = {batch, connection_count, batch, 0};
+	auto run = [&](const char *name, auto &&send) -> Error {
+		Vinyl::Phase phase = {name};
+		Tarantool tt(endpoint);
+		if (Error error = Vinyl::read_stat(tt, phase.before); error)
+			return error;
+		std::unique_ptr<Sampler> sampler;
+		phase.start_ns = Timer::now_ns();
+		if (sample_interval_ms != 0) {
+			sampler = std::make_unique<Sampler>(
+				endpoint, sample_interval_ms * 1000000,
+				Vinyl::STAT);
+			sampler->start();
+		}
+		if (Error error = send(phase.result); error)
+			return error;
+		if (sampler) {
+			if (Error error = sampler->stop(); error)
+				return Error_SamplerFailed(error);
+			phase.samples = sampler->samples();
+		}
+		/* The preloaded data is dumped to be read from the disk. */
+		if (phases.empty()) {
+			std::vector<uint8_t> buffer;
+			const char *value;
+			if (Error error = tt.evaluate("box.snapshot()", buffer,
+						      &value); error)
+				return error;
+		}
+		if (Error error = Vinyl::read_stat(tt, phase.after); error)
+			return error;
+		phases.push_back(std::move(phase));
+		return {};
+	};
+
+	/* Preload the dataset and make the reads of its keys. */
+	std::vector<uint8_t> reads;
+	{
+		std::vector<uint64_t> keys;
+		auto send = [&](Sweep::Result &result) {
+			return Vinyl::preload(endpoint, payload, key_count,
+					      point, response_buffer_size,
+					      keys, result);
+		};
+		if (Error error = run("preload", send); error)
+			return error;
+		Vinyl::make_reads(keys, 512, reads);
+	}
+
+	/* A restart leaves nothing in the cache. */
+	uint64_t restart_ns = 0;
+	if (server) {
+		server->stop();
+		if (Error error = server->start(&restart_ns); error)
+			return error;
+	}
+	Sweep::Runner reader(endpoint, connection_count, response_buffer_size);
+	reader.assign(std::move(reads), key_count);
+	auto read = [&](Sweep::Result &result) {
+		return reader.run(point, result);
+	};
+	if (Error error = run("cold", read); error)
+		return error;
+	if (Error error = run("warm", read); error)
+		return error;
+
+	printf("Keys: %lu\n", key_count);
+	printf("Batch size: %lu\n", batch);
+	printf("Connections: %lu\n", connection_count);
+	printf("Disk data (MB): %.1f\n",
+	       phases.front().after.disk_data / 1048576.0);
+	if (server) {
+		printf("Restart (s): %.3f\n", restart_ns / 1e9);
+		if (cache_mb != 0)
+			printf("Vinyl cache (MB): %lu\n", cache_mb);
+	}
+	printf("%8s %10s %8s %10s %10s %10s %6s %10s %12s %10s\n", "Phase",
+	       "RPS", "Errors", "Med (μs)", "99% (μs)", "99.9% (μs)",
+	       "Dumps", "Dump (MB)", "Compact (MB)", "Cache (MB)");
+	for (const auto &phase: phases) {
+		const auto &r = phase.result;
+		const auto &b = phase.before;
+		const auto &a = phase.after;
+		printf("%8s %10.0f %8lu %10.3f %10.3f %10.3f %6lu %10.1f "
+		       "%12.1f %10.1f\n", phase.name, r.rps, r.error_count,
+		       r.med_us, r.p99_us, r.p999_us,
+		       a.dump_count - b.dump_count,
+		       (a.dump_input - b.dump_input) / 1048576.0,
+		       (a.compaction_input - b.compaction_input) / 1048576.0,
+		       a.tuple_cache / 1048576.0);
+	}
+
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("keys");
+		json.value(uint64_t(key_count));
+		json.key("batch");
+		json.value(uint64_t(batch));
+		json.key("connections");
+		json.value(uint64_t(connection_count));
+		json.key("vinyl_cache_mb");
+		json.value(uint64_t(cache_mb));
+		json.key("restart_s");
+		json.value(restart_ns / 1e9);
+		json.key("phases");
+		json.begin_array();
+		for (const auto &phase: phases) {
+			const auto &r = phase.result;
+			const auto &b = phase.before;
+			const auto &a = phase.after;
+			json.begin_object();
+			json.key("phase");
+			json.value(phase.name);
+			Report::write_latencies(json, r);
+			json.key("dumps");
+			json.value(a.dump_count - b.dump_count);
+			json.key("dump_bytes");
+			json.value(a.dump_input - b.dump_input);
+			json.key("compaction_bytes");
+			json.value(a.compaction_input - b.compaction_input);
+			json.key("cache_bytes");
+			json.value(a.tuple_cache);
+			json.key("disk_bytes");
+			json.value(a.disk_data);
+			json.key("vinyl");
+			json.begin_array();
+			for (const auto &sample: phase.samples) {
+				const char *data = (const char *)sample.data.data();
+				json.begin_object();
+				json.key("t");
+				json.value(double(sample.time_ns - phase.start_ns) /
+					   1e9);
+				json.key("stat");
+				json.msgpack(&data);
+				json.end_object();
+			}
+			json.end_array();
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+	return {};
+}
+
+} // namespace Vinyl
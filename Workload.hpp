@@ -0,0 +1,263 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <expected>
+#include <mutex>
+#include <vector>
+
+#include "Tarantool.hpp"
+
+/*
+ * Workload files: the request stream of a run recorded to be replayed
+ * byte for byte later. The file consists of the header, the transfers
+ * and the index of transfers at the end. Each transfer is the expected
+ * response sizes of its requests (4 bytes each) followed by the framed
+ * IPROTO requests as they are sent.
+ */
+namespace Workload {
+
+static constexpr char MAGIC[8] = {'T', 'T', 'B', 'W', 'O', 'R', 'K', '1'};
+
+struct Header {
+	char magic[8];
+	/* The request name and the batch size of the recorded run. */
+	char request_name[32];
+	uint64_t request_count_per_transfer;
+	uint64_t transfer_count;
+	/* Offset of the index, zero until the recording is complete. */
+	uint64_t index_offset;
+};
+
+/* An index entry. */
+struct Entry {
+	/* Offset of the transfer in the file. */
+	uint64_t offset;
+	/* Size of the requests of the transfer. */
+	uint64_t request_size;
+};
+
+/*
+ * Records the transfers of all the workers into a single file. The
+ * transfers are written as soon as they are generated, so only the
+ * index is kept in memory.
+ */
+class Writer {
+public:
+	Writer() = default;
+	Writer(const Writer &other) = delete;
+
+	~Writer()
+	{
+		if (m_out != NULL)
+			fclose(m_out);
+	}
+
+	Error
+	open(const char *path, const char *request_name,
+	     size_t request_count_per_transfer)
+	{
+		m_out = fopen(path, "wb");
+		if (m_out == NULL)
+			return Error_System("Can't create the workload file");
+		memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+		strncpy(m_header.request_name, request_name,
+			sizeof(m_header.request_name) - 1);
+		m_header.request_count_per_transfer = request_count_per_transfer;
+		m_offset = sizeof(m_header);
+		/* The header is rewritten once the index is known. */
+		if (fwrite(&m_header, sizeof(m_header), 1, m_out) != 1)
+			return Error_System("Can't write the workload file");
+		return {};
+	}
+
+	/* Append the transfer. Must be called before it's executed. */
+	Error
+	write(const Tarantool::Transfer &t)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(t.request_count == m_header.request_count_per_transfer);
+		m_index.push_back({m_offset, t.request_size});
+		/* Zeros stand for the unknown response sizes. */
+		for (size_t i = 0; i < t.request_count; i++) {
+			const uint32_t size32 = t.response_sizes.empty() ? 0 :
+						t.response_sizes[i];
+			fwrite(&size32, sizeof(size32), 1, m_out);
+		}
+		if (t.request_iov.empty()) {
+			fwrite(t.request_batch.data(), 1, t.request_batch.size(),
+			       m_out);
+		} else {
+			for (const auto &iov: t.request_iov)
+				fwrite(iov.iov_base, 1, iov.iov_len, m_out);
+		}
+		if (ferror(m_out))
+			return Error_System("Can't write the workload file");
+		m_offset += t.request_count * sizeof(uint32_t) + t.request_size;
+		return {};
+	}
+
+	/* Write the index and complete the header. */
+	Error
+	close()
+	{
+		m_header.transfer_count = m_index.size();
+		m_header.index_offset = m_offset;
+		fwrite(m_index.data(), sizeof(m_index[0]), m_index.size(), m_out);
+		fseek(m_out, 0, SEEK_SET);
+		fwrite(&m_header, sizeof(m_header), 1, m_out);
+		const bool failed = ferror(m_out) || fclose(m_out) != 0;
+		m_out = NULL;
+		if (failed)
+			return Error_System("Can't write the workload file");
+		return {};
+	}
+
+private:
+	FILE *m_out = NULL;
+	Header m_header = {};
+	uint64_t m_offset = 0;
+	std::vector<Entry> m_index;
+	std::mutex m_mutex;
+};
+
+/*
+ * A recorded workload mapped into memory. The requests are sent right
+ * from the mapping, so the pages are only read in as they're sent.
+ */
+class Reader {
+public:
+	Reader() = default;
+	Reader(const Reader &other) = delete;
+
+	~Reader()
+	{
+		if (m_data != NULL)
+			munmap(m_data, m_size);
+	}
+
+	Error
+	open(const char *path)
+	{
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return Error_System("Can't open the workload file");
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return Error_System("Can't open the workload file");
+		}
+		m_size = st.st_size;
+		void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return Error_System("Can't map the workload file");
+		m_data = (uint8_t *)data;
+		madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+		/* Check the header and the index bounds. */
+		if (m_size < sizeof(Header))
+			return Error_WorkloadFile(path);
+		memcpy(&m_header, m_data, sizeof(m_header));
+		m_header.request_name[sizeof(m_header.request_name) - 1] = '\0';
+		if (memcmp(m_header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		    m_header.index_offset == 0 ||
+		    m_header.request_count_per_transfer == 0 ||
+		    m_header.index_offset > m_size ||
+		    (m_size - m_header.index_offset) / sizeof(Entry) <
+		    m_header.transfer_count)
+			return Error_WorkloadFile(path);
+		for (size_t i = 0; i < m_header.transfer_count; i++) {
+			const Entry e = entry(i);
+			if (e.offset > m_header.index_offset ||
+			    transfer_size(e) > m_header.index_offset - e.offset)
+				return Error_WorkloadFile(path);
+		}
+		return {};
+	}
+
+	const Header &
+	header() const
+	{
+		return m_header;
+	}
+
+	/* Make a transfer sending the recorded requests from the mapping. */
+	Tarantool::Transfer
+	transfer(size_t i) const
+	{
+		const Entry e = entry(i);
+		const size_t count = m_header.request_count_per_transfer;
+		const uint8_t *sizes = m_data + e.offset;
+		std::vector<size_t> response_sizes(count);
+		for (size_t j = 0; j < count; j++) {
+			uint32_t size;
+			memcpy(&size, sizes + j * sizeof(size), sizeof(size));
+			response_sizes[j] = size;
+		}
+		if (count != 0 && response_sizes[0] == 0)
+			response_sizes.clear();
+		std::vector<struct iovec> iov = {
+			{m_data + e.offset + count * sizeof(uint32_t),
+			 e.request_size},
+		};
+		Tarantool::Transfer t({}, std::move(iov),
+				      std::move(response_sizes));
+		t.request_count = count;
+		return t;
+	}
+
+private:
+	Entry
+	entry(size_t i) const
+	{
+		Entry e;
+		memcpy(&e, m_data + m_header.index_offset + i * sizeof(e),
+		       sizeof(e));
+		return e;
+	}
+
+	uint64_t
+	transfer_size(const Entry &e) const
+	{
+		return m_header.request_count_per_transfer * sizeof(uint32_t) +
+		       e.request_size;
+	}
+
+private:
+	uint8_t *m_data = NULL;
+	size_t m_size = 0;
+	Header m_header = {};
+};
+
+/*
+ * Replays every @a step-th transfer of the workload starting from the
+ * @a first one, so the workers share the recorded transfers.
+ */
+class Replay {
+public:
+	Replay(const Reader &reader, size_t first, size_t step)
+	: m_reader(reader)
+	, m_next(first)
+	, m_step(step)
+	{}
+
+	std::expected<Tarantool::Transfer, Error>
+	next()
+	{
+		assert(m_next < m_reader.header().transfer_count);
+		Tarantool::Transfer t = m_reader.transfer(m_next);
+		m_next += m_step;
+		return t;
+	}
+
+private:
+	const Reader &m_reader;
+	size_t m_next;
+	size_t m_step;
+};
+
+} // namespace Workload
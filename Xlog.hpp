@@ -0,0 +1,496 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <expected>
+#include <string_view>
+#include <vector>
+
+#ifdef TTBENCH_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "Tarantool.hpp"
+#include "Timer.hpp"
+
+#include "msgpuck/msgpuck.h"
+
+/*
+ * Tarantool write-ahead log (.xlog) and snapshot (.snap) files replayed
+ * as the benchmark workload. The file is a text meta block ended by an
+ * empty line followed by the blocks of rows. Each block starts with
+ * a 19-byte fixed header: the block marker, then the size of the rows
+ * and the checksums as MsgPack unsigned integers, padded to the size.
+ * Each row is a MsgPack map header followed by a MsgPack map body.
+ */
+namespace Xlog {
+
+static constexpr uint32_t ROW_MARKER = 0xd5ba0bab;
+static constexpr uint32_t ZROW_MARKER = 0xd5ba0bba;
+static constexpr uint32_t EOF_MARKER = 0xd510aded;
+static constexpr size_t FIXHEADER_SIZE = 19;
+
+/* The row header keys and types used by the replay. */
+static constexpr uint64_t IPROTO_REQUEST_TYPE = 0x00;
+static constexpr uint64_t IPROTO_TIMESTAMP = 0x04;
+static constexpr uint64_t IPROTO_SPACE_ID = 0x10;
+static constexpr uint32_t IPROTO_NOP = 0x0C;
+
+/* The spaces with smaller IDs are the system ones. */
+static constexpr uint64_t SYSTEM_SPACE_ID_MAX = 511;
+
+struct Row {
+	uint32_t type;
+	/* Seconds since the epoch, zero if the row has no timestamp. */
+	double timestamp;
+	/* The row body, empty if the row has no one. */
+	const char *body;
+	const char *body_end;
+};
+
+/* Is it a data change made by a user request to a user space? */
+bool
+is_user_dml(const Row &row)
+{
+	switch (row.type) {
+	case 0x02: /* IPROTO_INSERT */
+	case 0x03: /* IPROTO_REPLACE */
+	case 0x04: /* IPROTO_UPDATE */
+	case 0x05: /* IPROTO_DELETE */
+	case 0x09: /* IPROTO_UPSERT */
+		break;
+	default:
+		return false;
+	}
+	const char *data = row.body;
+	if (data == row.body_end || mp_typeof(*data) != MP_MAP)
+		return false;
+	const uint32_t size = mp_decode_map(&data);
+	for (uint32_t i = 0; i < size; i++) {
+		if (mp_typeof(*data) != MP_UINT)
+			return false;
+		if (mp_decode_uint(&data) == IPROTO_SPACE_ID) {
+			return mp_typeof(*data) == MP_UINT &&
+			       mp_decode_uint(&data) > SYSTEM_SPACE_ID_MAX;
+		}
+		mp_next(&data);
+	}
+	return false;
+}
+
+/* A log file mapped into memory. */
+class File {
+public:
+	File() = default;
+	File(const File &other) = delete;
+
+	~File()
+	{
+		if (m_data != NULL)
+			munmap((void *)m_data, m_size);
+	}
+
+	Error
+	open(const char *path)
+	{
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return Error_System("Can't open the xlog file");
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return Error_Xlog(path, "empty or inaccessible file");
+		}
+		m_size = st.st_size;
+		void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return Error_System("Can't map the xlog file");
+		m_data = (const char *)data;
+		madvise(data, m_size, MADV_SEQUENTIAL);
+
+		/* Step over the meta block. */
+		const std::string_view text(m_data, m_size);
+		if (!text.starts_with("XLOG\n") && !text.starts_with("SNAP\n"))
+			return Error_Xlog(path, "neither XLOG nor SNAP file");
+		const size_t meta_end = text.find("\n\n");
+		if (meta_end == std::string_view::npos)
+			return Error_Xlog(path, "no end of the meta block");
+		m_rows = meta_end + 2;
+		return {};
+	}
+
+	/* The blocks of rows following the meta block. */
+	const char *
+	begin() const
+	{
+		return m_data + m_rows;
+	}
+
+	const char *
+	end() const
+	{
+		return m_data + m_size;
+	}
+
+private:
+	const char *m_data = NULL;
+	size_t m_size = 0;
+	size_t m_rows = 0;
+};
+
+/*
+ * Where a row is in the log: the block (its fixed header in the file)
+ * and the offset of the row among the rows of the block, decompressed
+ * if the block is compressed.
+ */
+struct Position {
+	const char *block;
+	size_t offset;
+};
+
+/* Reads the rows of a log file one by one. */
+class Cursor {
+public:
+	Cursor(const File &file)
+	: m_pos(file.begin())
+	, m_end(file.end())
+	, m_block_start(NULL)
+	, m_rows(NULL)
+	, m_block(NULL)
+	, m_block_end(NULL)
+	{
+#ifdef TTBENCH_HAVE_ZSTD
+		m_zstd = ZSTD_createDCtx();
+#endif
+	}
+
+	Cursor(const Cursor &other) = delete;
+
+	~Cursor()
+	{
+#ifdef TTBENCH_HAVE_ZSTD
+		ZSTD_freeDCtx(m_zstd);
+#endif
+	}
+
+	/* The position of the row to be read next. */
+	Position
+	position() const
+	{
+		if (m_block == m_block_end)
+			return {m_pos, 0};
+		return {m_block_start, size_t(m_block - m_rows)};
+	}
+
+	/*
+	 * Go to the @a position taken by a cursor of the same file, only
+	 * the block of the position is read.
+	 */
+	Error
+	seek(const Position &position)
+	{
+		m_pos = position.block;
+		m_block = m_block_end = NULL;
+		if (position.offset == 0)
+			return {};
+		auto block = next_block();
+		if (!block)
+			return std::move(block.error());
+		if (!*block || position.offset > size_t(m_block_end - m_block))
+			return Error_XlogRow("position past the block");
+		m_block += position.offset;
+		return {};
+	}
+
+	/* Read the next row. Returns false at the end of the log. */
+	std::expected<bool, Error>
+	next(Row &row)
+	{
+		while (m_block == m_block_end) {
+			auto block = next_block();
+			if (!block || !*block)
+				return block;
+		}
+
+		/* Decode the header. */
+		const char *end = m_block;
+		if (mp_typeof(*m_block) != MP_MAP ||
+		    mp_check(&end, m_block_end) != 0)
+			return std::unexpected(Error_XlogRow("malformed header"));
+		row = {};
+		const uint32_t size = mp_decode_map(&m_block);
+		for (uint32_t i = 0; i < size; i++) {
+			if (mp_typeof(*m_block) != MP_UINT)
+				return std::unexpected(Error_XlogRow("malformed header"));
+			const uint64_t key = mp_decode_uint(&m_block);
+			if (key == IPROTO_REQUEST_TYPE &&
+			    mp_typeof(*m_block) == MP_UINT)
+				row.type = mp_decode_uint(&m_block);
+			else if (key == IPROTO_TIMESTAMP &&
+				 mp_typeof(*m_block) == MP_DOUBLE)
+				row.timestamp = mp_decode_double(&m_block);
+			else
+				mp_next(&m_block);
+		}
+
+		/* The body follows the header unless it's a NOP. */
+		row.body = row.body_end = m_block;
+		if (m_block < m_block_end && row.type != IPROTO_NOP) {
+			end = m_block;
+			if (mp_check(&end, m_block_end) != 0)
+				return std::unexpected(Error_XlogRow("malformed body"));
+			row.body_end = m_block = end;
+		}
+		return true;
+	}
+
+private:
+	/* Step to the next block. Returns false at the end of the log. */
+	std::expected<bool, Error>
+	next_block()
+	{
+		if (size_t(m_end - m_pos) < sizeof(uint32_t))
+			return false;
+		const char *data = m_pos;
+		const uint32_t marker = mp_load_u32(&data);
+		if (marker == EOF_MARKER)
+			return false;
+		if (marker != ROW_MARKER && marker != ZROW_MARKER)
+			return std::unexpected(Error_XlogRow("unknown block marker"));
+		if (size_t(m_end - m_pos) < FIXHEADER_SIZE)
+			return std::unexpected(Error_XlogRow("truncated block"));
+
+		/* The size of the rows, then the checksums we don't verify. */
+		const char *const fixheader_end = m_pos + FIXHEADER_SIZE;
+		uint64_t size = 0;
+		for (int i = 0; i < 3; i++) {
+			if (mp_typeof(*data) != MP_UINT)
+				return std::unexpected(Error_XlogRow("malformed block header"));
+			const uint64_t value = mp_decode_uint(&data);
+			if (i == 0)
+				size = value;
+		}
+		if (data > fixheader_end ||
+		    size > size_t(m_end - fixheader_end))
+			return std::unexpected(Error_XlogRow("truncated block"));
+		m_block_start = m_pos;
+		m_pos = fixheader_end + size;
+
+		if (marker == ROW_MARKER) {
+			m_rows = m_block = fixheader_end;
+			m_block_end = m_pos;
+			return true;
+		}
+		return decompress(fixheader_end, size);
+	}
+
+	/* The rows of a block are a single zstd frame if compressed. */
+	std::expected<bool, Error>
+	decompress(const char *data, size_t size)
+	{
+#ifdef TTBENCH_HAVE_ZSTD
+		ZSTD_DCtx_reset(m_zstd, ZSTD_reset_session_only);
+		ZSTD_inBuffer in = {data, size, 0};
+		size_t used = 0;
+		for (;;) {
+			if (m_decompressed.size() - used < ZSTD_DStreamOutSize())
+				m_decompressed.resize(used + ZSTD_DStreamOutSize());
+			ZSTD_outBuffer out = {m_decompressed.data() + used,
+					      m_decompressed.size() - used, 0};
+			const size_t rc = ZSTD_decompressStream(m_zstd, &out, &in);
+			if (ZSTD_isError(rc))
+				return std::unexpected(Error_XlogRow(ZSTD_getErrorName(rc)));
+			used += out.pos;
+			/* Zero means the frame is complete and flushed. */
+			if (rc == 0)
+				break;
+			if (in.pos == in.size && out.pos < out.size)
+				return std::unexpected(Error_XlogRow("truncated zstd frame"));
+		}
+		m_rows = m_block = m_decompressed.data();
+		m_block_end = m_block + used;
+		return true;
+#else
+		(void)data;
+		(void)size;
+		return std::unexpected(Error_XlogRow("compressed blocks require "
+						     "ttbench built with zstd"));
+#endif
+	}
+
+private:
+	/* The next block of the file. */
+	const char *m_pos;
+	const char *m_end;
+	/* The current block in the file and all of its rows. */
+	const char *m_block_start;
+	const char *m_rows;
+	/* The rows of the current block yet to be read. */
+	const char *m_block;
+	const char *m_block_end;
+	std::vector<char> m_decompressed;
+#ifdef TTBENCH_HAVE_ZSTD
+	ZSTD_DCtx *m_zstd;
+#endif
+};
+
+/* The user data changes of the log, counted prior to the replay. */
+struct Summary {
+	size_t row_count = 0;
+	double first_timestamp = 0;
+	double last_timestamp = 0;
+	/*
+	 * The first row of each transfer, so the workers only read their
+	 * own transfers rather than all the log.
+	 */
+	std::vector<Position> transfers;
+};
+
+/*
+ * Read the whole log once, the rows are split into transfers of
+ * @a request_count_per_transfer.
+ */
+std::expected<Summary, Error>
+summarize(const File &file, size_t request_count_per_transfer)
+{
+	Summary summary;
+	Cursor cursor(file);
+	Row row;
+	for (;;) {
+		const Position position = cursor.position();
+		auto has_row = cursor.next(row);
+		if (!has_row)
+			return std::unexpected(std::move(has_row.error()));
+		if (!*has_row)
+			break;
+		if (!is_user_dml(row))
+			continue;
+		if (summary.row_count % request_count_per_transfer == 0)
+			summary.transfers.push_back(position);
+		if (summary.row_count++ == 0)
+			summary.first_timestamp = row.timestamp;
+		summary.last_timestamp = row.timestamp;
+	}
+	return summary;
+}
+
+/*
+ * Turns the user data changes of the log into requests. Each row body
+ * is sent as is with the IPROTO header of the same request type. The
+ * workers replay every @a step-th transfer of rows starting from the
+ * @a first one, seeking to each of them by the summary. If @a paced,
+ * the transfers are sent at the moments the first of their rows were
+ * written relative to the start of the replay, otherwise as fast as
+ * possible.
+ */
+class Replay {
+public:
+	Replay(const File &file, const Summary &summary,
+	       size_t request_count_per_transfer, size_t first, size_t step,
+	       bool paced)
+	: m_cursor(file)
+	, m_summary(summary)
+	, m_request_count_per_transfer(request_count_per_transfer)
+	, m_next(first)
+	, m_step(step)
+	, m_paced(paced)
+	, m_timestamp(0)
+	{}
+
+	std::expected<Tarantool::Transfer, Error>
+	next()
+	{
+		/* Step over the transfers of the other workers. */
+		if (m_next >= m_summary.transfers.size())
+			return std::unexpected(Error_XlogRow("unexpected end of the log"));
+		if (Error error = m_cursor.seek(m_summary.transfers[m_next]); error)
+			return std::unexpected(std::move(error));
+		m_next += m_step;
+
+		Row row;
+		std::vector<uint8_t> batch;
+		for (size_t i = 0; i < m_request_count_per_transfer; i++) {
+			if (auto has_row = next_row(row); !has_row || !*has_row)
+				return std::unexpected(end_of_log(has_row));
+			if (i == 0)
+				m_timestamp = row.timestamp;
+			append_request(batch, row);
+		}
+		return Tarantool::Transfer(std::move(batch),
+					   m_request_count_per_transfer);
+	}
+
+	/* Wait for the moment to send the last transfer made. */
+	void
+	pace(uint64_t origin_ns)
+	{
+		if (!m_paced || m_timestamp < m_summary.first_timestamp)
+			return;
+		const double offset_s = m_timestamp - m_summary.first_timestamp;
+		const uint64_t due_ns = origin_ns +
+					uint64_t(std::llround(offset_s * 1e9));
+		const uint64_t now_ns = Timer::now_ns();
+		if (due_ns <= now_ns)
+			return;
+		const uint64_t delay_ns = due_ns - now_ns;
+		const struct timespec delay = {time_t(delay_ns / 1000000000),
+					       long(delay_ns % 1000000000)};
+		nanosleep(&delay, NULL);
+	}
+
+private:
+	/* The next user data change of the log. */
+	std::expected<bool, Error>
+	next_row(Row &row)
+	{
+		for (;;) {
+			auto has_row = m_cursor.next(row);
+			if (!has_row || !*has_row || is_user_dml(row))
+				return has_row;
+		}
+	}
+
+	Error
+	end_of_log(std::expected<bool, Error> &has_row)
+	{
+		if (!has_row)
+			return std::move(has_row.error());
+		return Error_XlogRow("unexpected end of the log");
+	}
+
+	static void
+	append_request(std::vector<uint8_t> &batch, const Row &row)
+	{
+		const size_t body_size = row.body_end - row.body;
+		const size_t header_and_body_size = 5 + body_size;
+		const size_t offset = batch.size();
+		batch.resize(offset + 5 + header_and_body_size);
+		uint8_t *data = &batch[offset];
+		data[0] = 0xCE;
+		mp_store_u32((char *)&data[1], header_and_body_size);
+		data[5] = 0x82; /* Header. */
+		data[6] = 0x00; /* IPROTO_REQUEST_TYPE. */
+		data[7] = row.type;
+		data[8] = 0x01; /* IPROTO_SYNC. */
+		data[9] = 0x00; /* Unchecked sync value. */
+		memcpy(&data[10], row.body, body_size);
+	}
+
+private:
+	Cursor m_cursor;
+	const Summary &m_summary;
+	size_t m_request_count_per_transfer;
+	/* The next transfer to make. */
+	size_t m_next;
+	size_t m_step;
+	bool m_paced;
+	/* The timestamp of the first row of the last transfer made. */
+	double m_timestamp;
+};
+
+} // namespace Xlog
@@ -1,17 +1,36 @@
+-- The instances launched by ttbench (-I) are told where to listen by
+-- TTBENCH_LISTEN, where to keep the files by TTBENCH_DIR and which master
+-- to follow, if any, by TTBENCH_REPLICATION. TTBENCH_ENGINE sets the
+-- engine of the space (memtx by default) and TTBENCH_VINYL_CACHE the size
+-- of the vinyl cache in bytes.
+local listen = os.getenv('TTBENCH_LISTEN') or 3301
+local master = os.getenv('TTBENCH_REPLICATION')
+
 box.cfg{
-    listen = 3301,
+    -- Set TTBENCH_SOCKET to also listen on a unix socket at the path.
+    listen = os.getenv('TTBENCH_SOCKET') ~= nil and
+             {listen, 'unix/:' .. os.getenv('TTBENCH_SOCKET')} or listen,
+    work_dir = os.getenv('TTBENCH_DIR'),
+    replication = master,
+    read_only = master ~= nil,
     memtx_memory = 1024 * 1024 * 1024 * 8,
-    net_msg_max = 2000000000,
-    readahead = 2000000000,
+    vinyl_cache = tonumber(os.getenv('TTBENCH_VINYL_CACHE')),
+    -- Required by the contention benchmark to run interactive transactions.
+    memtx_use_mvcc_engine = os.getenv('TTBENCH_MVCC') ~= nil,
 }
 
-s = box.schema.space.create('s')
-s:create_index('pk')
+-- The schema is created once, a replica or a restarted instance has it.
+box.once('ttbench', function()
+    local s = box.schema.space.create('s', {
+        engine = os.getenv('TTBENCH_ENGINE') or 'memtx',
+    })
+    s:create_index('pk')
+    box.schema.user.grant('guest','read,write,execute,create,drop','universe')
+end)
+s = box.space.s
 
 function bench_call() end
 function bench_insert(id) s:insert({id}) end
 function bench_replace(id) s:replace({id}) end
 function bench_select(id) s:select({id}) end
 function bench_delete(id) s:delete({id}) end
-
-box.schema.user.grant('guest','read,write,execute,create,drop','universe')
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <barrier>
 
 #include "Error.hpp"
 #include "Log.hpp"
@@ -18,40 +19,430 @@
 #include "Tarantool.hpp"
 #include "Timer.hpp"
 #include "Payload.hpp"
+#include "Churn.hpp"
+#include "Contention.hpp"
+#include "Growth.hpp"
+#include "Json.hpp"
+#include "Memory.hpp"
+#include "Recovery.hpp"
+#include "Report.hpp"
+#include "Replication.hpp"
+#include "Sampler.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "Slo.hpp"
+#include "Sweep.hpp"
+#include "Topology.hpp"
+#include "Users.hpp"
+#include "Vinyl.hpp"
+#include "Workload.hpp"
+#include "Xlog.hpp"
 
-template <class Tarantool>
+/* Everything measured during a benchmark run. */
+struct Measurements {
+	/* Latency and completion time of each transfer. */
+	std::vector<uint64_t> latencies_ns;
+	std::vector<uint64_t> timestamps_ns;
+	/* Client-side phase breakdown of each transfer. */
+	std::vector<Phases> phases;
+	/*
+	 * Process CPU time taken at the start, at the first transfer
+	 * completed in each next interval and at the end of the run, along
+	 * with the time taken. A transfer may span several intervals, then
+	 * the ones in between have no sample of their own.
+	 */
+	std::vector<std::pair<uint64_t, uint64_t>> cpu_samples;
+	/* Overall size of the requests sent. */
+	uint64_t request_bytes = 0;
+	/* The error responses overall and of each transfer. */
+	Tarantool::ErrorStats errors;
+	std::vector<uint64_t> error_counts;
+};
+
+/*
+ * Completion of the barrier all the workers wait on prior to the
+ * benchmark: the moment they're all ready is the origin of the time
+ * series. The server metrics sampler is started at the same moment.
+ */
+struct Origin {
+	uint64_t *origin_ns;
+	Sampler *sampler;
+
+	void
+	operator()() noexcept
+	{
+		*origin_ns = Timer::now_ns();
+		if (sampler != NULL)
+			sampler->start();
+	}
+};
+
+using Barrier = std::barrier<Origin>;
+
+/*
+ * Execute the transfers made by @a source, which either generates them
+ * or replays a recorded workload. The generated transfers are recorded
+ * into @a recorder if it's given.
+ */
+template <class Tarantool, class Source>
 Error
 benchmark(Tarantool &tt,
-	  const char *request_name,
-	  Payload &payload,
-	  size_t request_count,
-	  size_t request_count_per_transfer,
-	  std::vector<uint64_t> &latencies_ns)
+	  Source &source,
+	  size_t transfer_count,
+	  Barrier &ready,
+	  const uint64_t &origin_ns,
+	  uint64_t interval_ns,
+	  Workload::Writer *recorder,
+	  Measurements &m)
 {
 	/* Do the benchmarking. */
-	const size_t transfer_count = request_count /
-				      request_count_per_transfer;
-	latencies_ns.resize(transfer_count);
+	m.latencies_ns.resize(transfer_count);
+	m.timestamps_ns.resize(transfer_count);
+	m.phases.resize(transfer_count);
+	m.error_counts.resize(transfer_count);
 
-	typename Tarantool::TransferGenerator tg(tt, payload, request_name,
-						 request_count_per_transfer);
+	/* Start with the rest of the workers. */
+	ready.arrive_and_wait();
+	m.cpu_samples.emplace_back(origin_ns, Phases::cpu_ns());
 
 	for (size_t i = 0; i < transfer_count; i++) {
-		auto transfer = tg.next();
+		Phases &phases = m.phases[i];
+
+		const uint64_t generate_start_ns = Timer::now_ns();
+		auto transfer = source.next();
 		if (!transfer)
 			return Error_BatchBuild(transfer.error(), i);
+		if (recorder != NULL) {
+			if (Error error = recorder->write(*transfer); error)
+				return Error_WorkloadRecord(error);
+		}
 
-		Timer timer;
+		const uint64_t generate_end_ns = Timer::now_ns();
+		phases.ns[Phases::GENERATE] = generate_end_ns - generate_start_ns;
 
-		if (Error error = tt.execute(*transfer); error)
+		/* Keep the original timing of the replayed log if asked. */
+		if constexpr (requires { source.pace(origin_ns); })
+			source.pace(origin_ns);
+
+		const uint64_t start_ns = Timer::now_ns();
+		m.request_bytes += transfer->request_size;
+		const uint64_t error_count = tt.errors().count;
+
+		if (Error error = tt.execute(*transfer, phases); error)
 			return Error_BatchTransfer(error, i);
 
-		latencies_ns[i] = timer.ns();
+		/* The responses have been checked while being received. */
+		const uint64_t end_ns = Timer::now_ns();
+		m.latencies_ns[i] = end_ns - start_ns;
+		m.timestamps_ns[i] = end_ns;
+		m.error_counts[i] = tt.errors().count - error_count;
+
+		/* Sample the CPU time once per interval. */
+		if ((end_ns - origin_ns) / interval_ns >
+		    (m.cpu_samples.back().first - origin_ns) / interval_ns)
+			m.cpu_samples.emplace_back(end_ns, Phases::cpu_ns());
+	}
+	m.cpu_samples.emplace_back(Timer::now_ns(), Phases::cpu_ns());
+	m.errors = tt.errors();
+
+	return {};
+}
+
+/* A client worker running the benchmark over its own connection. */
+struct Worker {
+	Payload payload;
+	size_t request_count;
+	/* CPUs to pin the worker to, empty for no pinning. */
+	std::string cpus;
+	/* Where the worker has been running at start. */
+	int cpu = -1;
+	int node = -1;
+	Measurements m;
+	Error error;
+
+	Worker(const Payload &payload, size_t request_count)
+	: payload(payload)
+	, request_count(request_count)
+	{}
+};
+
+/* Settings shared by all the workers. */
+struct WorkerSetup {
+	Net::Endpoint endpoint;
+	const char *request_name;
+	size_t request_count_per_transfer;
+	uint64_t interval_ns;
+	/* Allocate the buffers on the NUMA node of the worker. */
+	bool numa_local;
+	/* SO_BUSY_POLL value, zero to receive in a blocking way. */
+	int busy_poll_us;
+	/* Send the requests with scatter-gather I/O. */
+	bool scatter;
+	/* Minimal transfer size sent with MSG_ZEROCOPY, 0 to never. */
+	size_t zerocopy_threshold;
+	/* The bound of the buffer the responses are received into. */
+	size_t response_buffer_size;
+	size_t worker_count;
+	/* The workload to replay instead of generating the transfers. */
+	const Workload::Reader *replay;
+	/* The file to record the generated transfers into. */
+	Workload::Writer *recorder;
+	/* The log to replay the user data changes of. */
+	const Xlog::File *xlog;
+	const Xlog::Summary *xlog_summary;
+	/* Preserve the original timing of the log rows. */
+	bool paced;
+	Barrier *ready;
+	const uint64_t *origin_ns;
+};
+
+Error
+run_worker(Worker &w, size_t id, const WorkerSetup &setup)
+{
+	/* Place the worker prior to allocating anything. */
+	Error error;
+	if (!w.cpus.empty())
+		error = Topology::pin(w.cpus);
+	if (!error && setup.numa_local)
+		error = Topology::use_local_memory();
+	if (error) {
+		setup.ready->arrive_and_drop();
+		return error;
+	}
+	Topology::where(w.cpu, w.node);
+	Rng::seed(id + 1);
+
+	/* Connect to Tarantool. */
+	Tarantool tt(setup.endpoint);
+	tt.set_response_buffer_size(setup.response_buffer_size);
+	if (setup.busy_poll_us != 0)
+		error = tt.set_busy_poll(setup.busy_poll_us);
+	if (!error && setup.zerocopy_threshold != 0)
+		error = tt.set_zerocopy(setup.zerocopy_threshold);
+	if (error) {
+		setup.ready->arrive_and_drop();
+		return error;
+	}
+
+	const size_t transfer_count = w.request_count /
+				      setup.request_count_per_transfer;
+	if (setup.replay != NULL) {
+		/* The workers take the recorded transfers in turns. */
+		Workload::Replay replay(*setup.replay, id, setup.worker_count);
+		return benchmark(tt, replay, transfer_count, *setup.ready,
+				 *setup.origin_ns, setup.interval_ns, NULL, w.m);
+	}
+	if (setup.xlog != NULL) {
+		Xlog::Replay replay(*setup.xlog, *setup.xlog_summary,
+				    setup.request_count_per_transfer, id,
+				    setup.worker_count, setup.paced);
+		return benchmark(tt, replay, transfer_count, *setup.ready,
+				 *setup.origin_ns, setup.interval_ns,
+				 setup.recorder, w.m);
+	}
+	Tarantool::TransferGenerator tg(tt, w.payload, setup.request_name,
+					setup.request_count_per_transfer,
+					setup.scatter || w.payload.has_pool());
+	return benchmark(tt, tg, transfer_count, *setup.ready,
+			 *setup.origin_ns, setup.interval_ns, setup.recorder,
+			 w.m);
+}
+
+/* CPU utilisation between two (time, CPU time) samples. */
+double
+cpu_utilisation(const std::pair<uint64_t, uint64_t> &begin,
+		const std::pair<uint64_t, uint64_t> &end)
+{
+	if (end.first <= begin.first)
+		return 0.0;
+	return double(end.second - begin.second) / (end.first - begin.first);
+}
+
+/*
+ * The CPU utilisation over [@a begin_ns, @a end_ns), between the last
+ * sample prior to the start and the first one past the end. So the
+ * intervals without samples of their own share the utilisation of the
+ * span covering them.
+ */
+double
+interval_cpu_utilisation(
+	const std::vector<std::pair<uint64_t, uint64_t>> &samples,
+	uint64_t begin_ns, uint64_t end_ns)
+{
+	size_t first = 0;
+	while (first + 1 < samples.size() &&
+	       samples[first + 1].first <= begin_ns)
+		first++;
+	size_t last = first;
+	while (last + 1 < samples.size() && samples[last].first < end_ns)
+		last++;
+	return cpu_utilisation(samples[first], samples[last]);
+}
+
+/* Write the phases as the average time per request. */
+void
+write_phases(Json::Writer &json, const Phases &phases, size_t request_count)
+{
+	json.begin_object();
+	for (int i = 0; i < Phases::COUNT; i++) {
+		json.key(Phases::names[i]);
+		json.value(phases.ns[i] / 1000.0 / request_count);
+	}
+	json.end_object();
+}
+
+/* Parse a comma-separated list of sizes, e.g. "1000,100,10". */
+Error
+parse_size_list(const char *list, std::vector<size_t> &result)
+{
+	result.clear();
+	for (const char *p = list; *p != '\0'; p += *p == ',') {
+		char *end;
+		result.push_back(strtoul(p, &end, 10));
+		if (end == p || (*end != ',' && *end != '\0'))
+			return Error_SizeList(list);
+		p = end;
+	}
+	return {};
+}
+
+/* Parse a swept parameter, e.g. "batch=1,10,100". */
+Error
+parse_sweep(const char *spec, Sweep::Settings &settings)
+{
+	const char *values = strchr(spec, '=');
+	if (values == NULL)
+		return Error_SweepParameter(spec);
+	const std::string_view name(spec, values - spec);
+	std::vector<size_t> *list = NULL;
+	if (name == "batch")
+		list = &settings.batches;
+	else if (name == "connections")
+		list = &settings.connection_counts;
+	else if (name == "depth")
+		list = &settings.depths;
+	else if (name == "rate")
+		list = &settings.rates;
+	else
+		return Error_SweepParameter(spec);
+	if (Error error = parse_size_list(values + 1, *list); error)
+		return Error_SweepParameter(spec);
+	if (list->empty() ||
+	    (list != &settings.rates && list != &settings.depths &&
+	     std::find(list->begin(), list->end(), 0) != list->end()))
+		return Error_SweepParameter(spec);
+	return {};
+}
+
+/* Parse the SLO, e.g. "99:2000" for the 99th percentile of 2 ms. */
+Error
+parse_slo(const char *spec, Slo::Target &target)
+{
+	char *end;
+	target.percentile = strtod(spec, &end) / 100.0;
+	if (*end != ':')
+		return Error_SloTarget(spec);
+	target.latency_us = strtod(end + 1, &end);
+	if (*end == ':')
+		target.run_count = strtoul(end + 1, &end, 10);
+	if (*end == ':')
+		target.error_budget = strtoull(end + 1, &end, 10);
+	if (*end != '\0' || target.percentile <= 0 ||
+	    target.percentile > 1 || target.latency_us <= 0 ||
+	    target.run_count == 0)
+		return Error_SloTarget(spec);
+	return {};
+}
 
-		if (Error error = tt.check(*transfer); error)
-			return Error_ResponseCheck(error, i);
+/*
+ * Parse a TCP port. Port 0 stands for the unix socket in an endpoint, so
+ * it isn't accepted.
+ */
+Error
+parse_port(const char *spec, int &port)
+{
+	char *end;
+	const unsigned long value = strtoul(spec, &end, 10);
+	if (*spec == '\0' || *end != '\0' || value == 0 || value > UINT16_MAX)
+		return Error_Port(spec);
+	port = value;
+	return {};
+}
+
+/*
+ * Parse a comma-separated list of endpoints: a port on localhost, a
+ * host and a port or a unix socket path (containing a slash).
+ */
+Error
+parse_endpoints(const char *list, std::vector<Net::Endpoint> &endpoints)
+{
+	std::string_view rest(list);
+	while (!rest.empty()) {
+		const size_t comma = rest.find(',');
+		const std::string item(rest.substr(0, comma));
+		rest = comma == rest.npos ? "" : rest.substr(comma + 1);
+		if (item.find('/') != item.npos) {
+			endpoints.push_back({item, 0});
+			continue;
+		}
+		const size_t colon = item.rfind(':');
+		const std::string host = colon == item.npos ? "localhost" :
+					 item.substr(0, colon);
+		const char *port = item.c_str() + (colon == item.npos ? 0 :
+						   colon + 1);
+		char *end;
+		const unsigned long value = strtoul(port, &end, 10);
+		if (*port == '\0' || *end != '\0' || value == 0 ||
+		    value > UINT16_MAX || host.empty())
+			return Error_Endpoint(item.c_str());
+		endpoints.push_back({host, uint16_t(value)});
+	}
+	if (endpoints.empty())
+		return Error_Endpoint(list);
+	return {};
+}
+
+/* Parse the user script, e.g. "get,update". */
+Error
+parse_script(const char *spec, std::vector<Users::Step> &script)
+{
+	script.clear();
+	for (const char *p = spec; ; p++) {
+		const char *end = strchrnul(p, ',');
+		const std::string_view name(p, end - p);
+		size_t step = 0;
+		while (step < Users::STEP_COUNT &&
+		       name != Users::step_names[step])
+			step++;
+		if (step == Users::STEP_COUNT)
+			return Error_UserScript(spec);
+		script.push_back(Users::Step(step));
+		if (*end == '\0')
+			return {};
+		p = end;
 	}
+}
 
+/* Parse the think time, e.g. "exponential:1000" for the mean of 1 ms. */
+Error
+parse_think_time(const char *spec, Users::ThinkTime &think_time)
+{
+	const char *colon = strchr(spec, ':');
+	if (colon == NULL)
+		return Error_ThinkTime(spec);
+	const std::string_view name(spec, colon - spec);
+	size_t i = 0;
+	while (i < std::size(Users::ThinkTime::distribution_names) &&
+	       name != Users::ThinkTime::distribution_names[i])
+		i++;
+	if (i == std::size(Users::ThinkTime::distribution_names))
+		return Error_ThinkTime(spec);
+	char *end;
+	const double mean_us = strtod(colon + 1, &end);
+	if (*end != '\0' || mean_us < 0)
+		return Error_ThinkTime(spec);
+	think_time.distribution = Users::ThinkTime::Distribution(i);
+	think_time.mean_ns = mean_us * 1000;
 	return {};
 }
 
@@ -63,19 +454,66 @@ start(int argc, char **argv)
 	const char *hist = NULL;
 	const char *rcdf = NULL;
 	const char *config_file = NULL;
+	/* All the configs given, the last one is the payload. */
+	std::vector<const char *> config_files;
+	const char *results = NULL;
+	uint64_t interval_ms = 1000;
+	uint64_t sample_interval_ms = 0;
 	int port = 3301;
+	const char *socket_path = NULL;
 	size_t request_count_per_transfer = 1000;
 	size_t request_count = 1000000;
+	size_t worker_count = 1;
+	const char *cpu_lists = NULL;
+	bool numa_local = false;
+	int busy_poll_us = 0;
+	bool scatter = false;
+	size_t zerocopy_threshold = 0;
+	size_t response_buffer_size = Tarantool::RESPONSE_BUFFER_SIZE;
+	const char *record_file = NULL;
+	const char *replay_file = NULL;
+	const char *xlog_file = NULL;
+	bool paced = false;
+	const char *dataset_file = NULL;
+	std::vector<size_t> hot_key_counts = {1000, 100, 10, 1};
+	size_t max_attempts = 100;
+	Sweep::Settings sweep_settings;
+	bool sweeping = false;
+	Slo::Target slo_target;
+	bool searching = false;
+	size_t user_count = 1000;
+	std::vector<Users::Step> script = {Users::GET, Users::UPDATE};
+	Users::ThinkTime think_time;
+	size_t requests_per_connection = 1;
+	const char *credentials = NULL;
+	std::vector<Net::Endpoint> instances;
+	size_t bucket_count = Shard::BUCKET_COUNT;
+	size_t depth = 0;
+	bool scaling = false;
+	const char *instance_script = NULL;
+	size_t vinyl_cache_mb = 0;
+	std::vector<size_t> tuple_counts;
+	size_t mix_count = 100000;
+	size_t read_percent = 50;
 	const char *request_name = NULL;
 
 	while (request_name == NULL) {
-		switch (getopt(argc, argv, "b:g:h:r:p:c:i:o:")) {
+		switch (getopt(argc, argv, "b:g:h:r:p:u:c:i:o:j:t:s:w:k:a:C:NB:SZ:m:W:R:X:TD:P:L:U:Y:K:n:A:E:H:d:GI:V:z:x:M:")) {
 		case 'b':
 			request_count_per_transfer = atol(optarg);
 			continue;
 		case 'o':
 			data = optarg;
 			continue;
+		case 'j':
+			results = optarg;
+			continue;
+		case 't':
+			interval_ms = atol(optarg);
+			continue;
+		case 's':
+			sample_interval_ms = atol(optarg);
+			continue;
 		case 'g':
 			cdf = optarg;
 			continue;
@@ -86,55 +524,574 @@ start(int argc, char **argv)
 			hist = optarg;
 			continue;
 		case 'p':
-			port = atoi(optarg);
+			if (Error error = parse_port(optarg, port); error)
+				return error;
+			continue;
+		case 'u':
+			socket_path = optarg;
 			continue;
 		case 'c':
 			request_count = atol(optarg);
 			continue;
 		case 'i':
 			config_file = optarg;
+			config_files.push_back(optarg);
+			continue;
+		case 'w':
+			worker_count = atol(optarg);
+			continue;
+		case 'C':
+			cpu_lists = optarg;
+			continue;
+		case 'N':
+			numa_local = true;
+			continue;
+		case 'B':
+			busy_poll_us = atoi(optarg);
+			continue;
+		case 'S':
+			scatter = true;
+			continue;
+		case 'Z':
+			/* Zero-copy only applies to the scattered transfers. */
+			zerocopy_threshold = atol(optarg);
+			scatter = true;
+			continue;
+		case 'm':
+			response_buffer_size = atol(optarg);
+			/* Room for the size prefix of a response at least. */
+			if (response_buffer_size < 5)
+				return Error_Argparse();
+			continue;
+		case 'W':
+			record_file = optarg;
+			continue;
+		case 'R':
+			replay_file = optarg;
+			continue;
+		case 'X':
+			xlog_file = optarg;
+			continue;
+		case 'T':
+			paced = true;
+			continue;
+		case 'D':
+			dataset_file = optarg;
+			continue;
+		case 'k':
+			if (Error error = parse_size_list(optarg,
+							  hot_key_counts); error)
+				return error;
+			/* An empty hot set has no keys to draw from. */
+			if (std::find(hot_key_counts.begin(), hot_key_counts.end(),
+				      0) != hot_key_counts.end())
+				return Error_Argparse();
+			continue;
+		case 'a':
+			max_attempts = atol(optarg);
+			continue;
+		case 'P':
+			if (Error error = parse_sweep(optarg, sweep_settings); error)
+				return error;
+			sweeping = true;
+			continue;
+		case 'L':
+			if (Error error = parse_slo(optarg, slo_target); error)
+				return error;
+			searching = true;
+			continue;
+		case 'U':
+			user_count = atol(optarg);
+			continue;
+		case 'Y':
+			if (Error error = parse_script(optarg, script); error)
+				return error;
+			continue;
+		case 'n':
+			requests_per_connection = atol(optarg);
+			continue;
+		case 'A':
+			credentials = optarg;
+			continue;
+		case 'E':
+			if (Error error = parse_endpoints(optarg,
+							  instances); error)
+				return error;
+			continue;
+		case 'H':
+			bucket_count = atol(optarg);
+			continue;
+		case 'd':
+			depth = atol(optarg);
+			continue;
+		case 'G':
+			scaling = true;
+			continue;
+		case 'I':
+			instance_script = optarg;
+			continue;
+		case 'V':
+			vinyl_cache_mb = atol(optarg);
+			continue;
+		case 'z':
+			if (Error error = parse_size_list(optarg,
+							  tuple_counts); error)
+				return error;
+			continue;
+		case 'x':
+			mix_count = atol(optarg);
+			continue;
+		case 'M':
+			read_percent = atol(optarg);
+			continue;
+		case 'K':
+			if (Error error = parse_think_time(optarg, think_time); error)
+				return error;
 			continue;
 		case '?':
 			return Error_Argparse();
 		case -1:
-			if (optind == argc)
+			if (optind < argc) {
+				request_name = argv[optind];
+			} else if (replay_file != NULL) {
+				/* Replaced by the recorded request name. */
+				request_name = "replay";
+			} else if (xlog_file != NULL) {
+				request_name = "xlog";
+			} else {
 				return Error_Usage(argv[0]);
-			request_name = argv[optind];
+			}
 			break;
 		};
 	}
+
+	/* Calibrate the timer prior to any measurement. */
+	Timer::calibrate();
+
+	/* The unix socket takes precedence over the TCP port. */
+	const Net::Endpoint endpoint = socket_path != NULL ?
+		Net::Endpoint{socket_path, 0} :
+		Net::Endpoint{"localhost", uint16_t(port)};
+
+	/* The contention benchmark doesn't send the generated payload. */
+	if (strcmp(request_name, "contention") == 0) {
+		if (worker_count == 0 || max_attempts == 0 ||
+		    hot_key_counts.empty())
+			return Error_Argparse();
+		if (Error error = Contention::benchmark(endpoint, worker_count,
+							hot_key_counts,
+							request_count,
+							max_attempts); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/* The churn sessions make their own requests. */
+	if (strcmp(request_name, "churn") == 0) {
+		if (worker_count == 0)
+			return Error_Argparse();
+		/* The credentials are "user[:password]". */
+		std::string user = credentials != NULL ? credentials : "";
+		std::string password;
+		if (const size_t colon = user.find(':'); colon != user.npos) {
+			password = user.substr(colon + 1);
+			user.resize(colon);
+		}
+		const Churn::Settings settings = {
+			.endpoint = endpoint,
+			.thread_count = worker_count,
+			.session_count = request_count,
+			.request_count = requests_per_connection,
+			.user = user,
+			.password = password,
+		};
+		if (Error error = Churn::benchmark(settings, results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/*
+	 * The replication lag is measured with the keys of its own, the
+	 * batch sizes and the rates are taken from the sweep parameters.
+	 */
+	if (strcmp(request_name, "replication") == 0) {
+		auto &s = sweep_settings;
+		if (instances.size() != 2 || !s.connection_counts.empty() ||
+		    !s.depths.empty())
+			return Error_Argparse();
+		if (s.batches.empty())
+			s.batches = {request_count_per_transfer};
+		if (s.rates.empty())
+			s.rates = {0};
+		if (request_count < *std::max_element(s.batches.begin(),
+						      s.batches.end()))
+			return Error_Argparse();
+		if (Error error = Replication::benchmark(instances[0],
+							 instances[1],
+							 instance_script, s,
+							 request_count,
+							 searching ? &slo_target : NULL,
+							 sample_interval_ms,
+							 results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/* The virtual users run their own scripts instead of the payload. */
+	if (strcmp(request_name, "users") == 0) {
+		if (worker_count == 0 || user_count == 0)
+			return Error_Argparse();
+		const Users::Settings settings = {
+			.user_count = user_count,
+			.connection_count = worker_count,
+			.script = script,
+			.think_time = think_time,
+			.request_count = request_count,
+		};
+		if (Error error = Users::benchmark(endpoint, settings,
+						   results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+	if (interval_ms == 0 || worker_count == 0 ||
+	    (record_file != NULL && replay_file != NULL) ||
+	    (xlog_file != NULL && replay_file != NULL))
+		return Error_Argparse();
+
+	/* The replayed workload defines the requests and the batches. */
+	Workload::Reader replay;
+	if (replay_file != NULL) {
+		if (Error error = replay.open(replay_file); error)
+			return error;
+		request_name = replay.header().request_name;
+		request_count_per_transfer =
+			replay.header().request_count_per_transfer;
+		request_count = replay.header().transfer_count *
+				request_count_per_transfer;
+	}
+
+	/*
+	 * The whole log is replayed, the rows which don't make up a whole
+	 * transfer are left out.
+	 */
+	Xlog::File xlog;
+	Xlog::Summary xlog_summary;
+	if (xlog_file != NULL) {
+		if (Error error = xlog.open(xlog_file); error)
+			return error;
+		auto summary = Xlog::summarize(xlog,
+					       request_count_per_transfer);
+		if (!summary)
+			return std::move(summary.error());
+		xlog_summary = *summary;
+		request_count = xlog_summary.row_count -
+				xlog_summary.row_count % request_count_per_transfer;
+		if (request_count == 0)
+			return Error_Xlog(xlog_file, "not enough user data changes");
+	}
 	if (request_count % request_count_per_transfer != 0)
 		return Error_BatchSize(request_count,
 				       request_count_per_transfer);
 
 	/*
-	 * Create a test payload. +1 for the first request to compute the
-	 * response sizes for next requests.
+	 * The recovery and the growth fill the space up to the largest of
+	 * the sizes, the growth mixes insert past it with the payload.
 	 */
-	Payload payload(request_count + 1);
+	const bool growth_mode = strcmp(request_name, "growth") == 0;
+	if (growth_mode && tuple_counts.empty())
+		tuple_counts = {request_count};
+	std::sort(tuple_counts.begin(), tuple_counts.end());
+	tuple_counts.erase(std::unique(tuple_counts.begin(), tuple_counts.end()),
+			   tuple_counts.end());
+	if (!tuple_counts.empty())
+		request_count = tuple_counts.back();
+	if (growth_mode)
+		request_count += tuple_counts.size() * mix_count;
 
-	if (Error error = payload.parse_config(config_file); error)
-		return Error_ConfigParseFailed(error, config_file);
+	/*
+	 * Create a test payload. +1 per worker for the first request to
+	 * compute the response sizes for next requests. Nothing is
+	 * generated if the workload is replayed.
+	 */
+	const bool generate = replay_file == NULL && xlog_file == NULL;
+	Payload payload(generate ? request_count + worker_count : 0);
 
-	/* Connect to Tarantool. */
-	Tarantool tt("localhost", port);
+	if (generate) {
+		if (Error error = payload.parse_config(config_file); error)
+			return Error_ConfigParseFailed(error, config_file);
+	}
+
+	/* The column parts take the records of the dataset in turn. */
+	if (generate && dataset_file != NULL) {
+		auto dataset = std::make_shared<Dataset>();
+		if (Error error = dataset->open(dataset_file); error)
+			return error;
+		if (Error error = dataset->bind(payload); error)
+			return error;
+		payload.dataset = std::move(dataset);
+	}
+	if (generate && payload.has_columns() && payload.dataset == NULL)
+		return Error_NoDataset();
+
+	/* The recovery restarts the instance, so it has to launch it. */
+	if (strcmp(request_name, "recovery") == 0) {
+		if (!generate || record_file != NULL || sweeping ||
+		    searching || !instances.empty() ||
+		    instance_script == NULL || request_count == 0)
+			return Error_Argparse();
+		if (tuple_counts.empty())
+			tuple_counts = {request_count};
+		/* The generator's own tuple leaves the rest for the load. */
+		if (tuple_counts.front() < 2)
+			return Error_Argparse();
+		if (Error error = Recovery::benchmark(endpoint, instance_script,
+						      payload, tuple_counts,
+						      request_count_per_transfer,
+						      worker_count,
+						      response_buffer_size,
+						      results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/* The growth streams the payload instead of generating it whole. */
+	if (growth_mode) {
+		if (!generate || record_file != NULL || sweeping ||
+		    searching || !instances.empty() ||
+		    tuple_counts.front() == 0 || read_percent > 100 ||
+		    mix_count < worker_count)
+			return Error_Argparse();
+		if (Error error = Growth::benchmark(endpoint, instance_script,
+						    payload, tuple_counts,
+						    mix_count, read_percent,
+						    request_count_per_transfer,
+						    worker_count,
+						    response_buffer_size,
+						    results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/* Each of the configs is a tuple shape measured on its own. */
+	if (strcmp(request_name, "memory") == 0) {
+		if (!generate || record_file != NULL || sweeping ||
+		    searching || !instances.empty() || request_count == 0 ||
+		    (config_files.size() > 1 && dataset_file != NULL))
+			return Error_Argparse();
+		if (Error error = Memory::benchmark(endpoint, instance_script,
+						    payload, config_files,
+						    request_count,
+						    request_count_per_transfer,
+						    worker_count,
+						    response_buffer_size,
+						    results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/* The vinyl phases preload and read the space on their own. */
+	if (strcmp(request_name, "vinyl") == 0) {
+		if (!generate || record_file != NULL || sweeping ||
+		    searching || !instances.empty() || request_count == 0)
+			return Error_Argparse();
+		if (Error error = Vinyl::benchmark(endpoint, instance_script,
+						   payload, request_count,
+						   request_count_per_transfer,
+						   worker_count, vinyl_cache_mb,
+						   sample_interval_ms,
+						   response_buffer_size,
+						   results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	if (!instances.empty()) {
+		if (!generate || record_file != NULL || sweeping ||
+		    searching || bucket_count == 0)
+			return Error_Argparse();
+		/* The in-flight window holds at least a batch. */
+		depth = std::max(depth, request_count_per_transfer);
+		if (Error error = Shard::benchmark(instances, payload,
+						   request_name, request_count,
+						   request_count_per_transfer,
+						   depth, worker_count,
+						   bucket_count, scaling,
+						   busy_poll_us,
+						   response_buffer_size,
+						   results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	/*
+	 * The sweep sends the same requests at each point, the parameters
+	 * not swept are taken from the options.
+	 */
+	if (sweeping) {
+		if (!generate || record_file != NULL || searching)
+			return Error_Argparse();
+		auto &s = sweep_settings;
+		if (s.batches.empty())
+			s.batches = {request_count_per_transfer};
+		if (s.connection_counts.empty())
+			s.connection_counts = {worker_count};
+		if (s.depths.empty())
+			s.depths = {0};
+		if (s.rates.empty())
+			s.rates = {0};
+		if (Error error = Sweep::benchmark(endpoint, payload,
+						   request_name, s,
+						   request_count, busy_poll_us,
+						   response_buffer_size,
+						   results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+	if (searching) {
+		if (!generate || record_file != NULL)
+			return Error_Argparse();
+		if (Error error = Slo::benchmark(endpoint, payload,
+						 request_name, slo_target,
+						 request_count,
+						 request_count_per_transfer,
+						 worker_count, busy_poll_us,
+						 response_buffer_size,
+						 results); error)
+			return Error_BenchmarkFailed(error);
+		return {};
+	}
+
+	Workload::Writer recorder;
+	if (record_file != NULL) {
+		if (Error error = recorder.open(record_file, request_name,
+						request_count_per_transfer); error)
+			return Error_WorkloadRecord(error);
+	}
+
+	/* Give each of the workers its own slice of transfers and payload. */
+	const size_t transfer_count = request_count / request_count_per_transfer;
+	const std::vector<std::string> cpus = cpu_lists != NULL ?
+		Topology::split_cpu_lists(cpu_lists) :
+		std::vector<std::string>();
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (size_t i = 0, offset = 0; i < worker_count; i++) {
+		const size_t worker_transfer_count = transfer_count / worker_count +
+						     (i < transfer_count % worker_count);
+		const size_t worker_request_count = worker_transfer_count *
+						    request_count_per_transfer;
+		workers.push_back(std::make_unique<Worker>(payload,
+							   worker_request_count));
+		workers.back()->payload.skip(offset);
+		if (!cpus.empty())
+			workers.back()->cpus = cpus[i % cpus.size()];
+		offset += worker_request_count + 1;
+	}
+
+	/* Sample the server-side metrics during the run if requested. */
+	std::unique_ptr<Sampler> sampler;
+	if (sample_interval_ms != 0) {
+		sampler = std::make_unique<Sampler>(endpoint,
+						    sample_interval_ms * 1000000);
+	}
 
 	/* Benchmark it. */
-	std::vector<uint64_t> latencies_ns;
-	if (Error error = benchmark(tt, request_name, payload, request_count,
-				    request_count_per_transfer, latencies_ns); error)
-		return Error_BenchmarkFailed(error);
+	uint64_t origin_ns = 0;
+	Barrier ready(worker_count, Origin{&origin_ns, sampler.get()});
+	const WorkerSetup setup = {
+		.endpoint = endpoint,
+		.request_name = request_name,
+		.request_count_per_transfer = request_count_per_transfer,
+		.interval_ns = interval_ms * 1000000,
+		.numa_local = numa_local,
+		.busy_poll_us = busy_poll_us,
+		.scatter = scatter,
+		.zerocopy_threshold = zerocopy_threshold,
+		.response_buffer_size = response_buffer_size,
+		.worker_count = worker_count,
+		.replay = replay_file != NULL ? &replay : NULL,
+		.recorder = record_file != NULL ? &recorder : NULL,
+		.xlog = xlog_file != NULL ? &xlog : NULL,
+		.xlog_summary = &xlog_summary,
+		.paced = paced,
+		.ready = &ready,
+		.origin_ns = &origin_ns,
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < worker_count; i++) {
+		threads.emplace_back([&w = *workers[i], i, &setup] {
+			w.error = run_worker(w, i, setup);
+		});
+	}
+	for (auto &thread: threads)
+		thread.join();
+	if (sampler) {
+		if (Error error = sampler->stop(); error)
+			return Error_SamplerFailed(error);
+	}
+	if (record_file != NULL) {
+		if (Error error = recorder.close(); error)
+			return Error_WorkloadRecord(error);
+	}
+
+	/*
+	 * Merge the measurements of the workers. The RPS and the request
+	 * throughput of each worker are computed from its own transfer
+	 * latencies.
+	 */
+	Measurements m;
+	std::vector<uint64_t> &latencies_ns = m.latencies_ns;
+	double rps = 0;
+	double request_mbps = 0;
+	for (auto &w: workers) {
+		if (w->error)
+			return Error_BenchmarkFailed(w->error);
+		const double worker_ns = std::accumulate(w->m.latencies_ns.begin(),
+							 w->m.latencies_ns.end(),
+							 0ULL);
+		rps += (double)w->request_count / (worker_ns / 1000000000.0);
+		request_mbps += (double)w->m.request_bytes / (worker_ns / 1000.0);
+		latencies_ns.insert(latencies_ns.end(),
+				    w->m.latencies_ns.begin(),
+				    w->m.latencies_ns.end());
+		m.timestamps_ns.insert(m.timestamps_ns.end(),
+				       w->m.timestamps_ns.begin(),
+				       w->m.timestamps_ns.end());
+		m.request_bytes += w->m.request_bytes;
+		m.phases.insert(m.phases.end(), w->m.phases.begin(),
+				w->m.phases.end());
+		m.error_counts.insert(m.error_counts.end(),
+				      w->m.error_counts.begin(),
+				      w->m.error_counts.end());
+		m.errors.merge(w->m.errors);
+	}
+	/* The CPU time is process-wide, so any worker's samples do. */
+	m.cpu_samples = workers[0]->m.cpu_samples;
+
+	/* Split the latencies into the interval series prior to sorting. */
+	const auto intervals = Statistics::split_intervals(latencies_ns,
+							   m.timestamps_ns,
+							   origin_ns,
+							   interval_ms * 1000000);
+
+	/* Sum up the client-side phases and the errors per interval. */
+	Phases phases_total;
+	std::vector<Phases> phases_intervals(intervals.size());
+	std::vector<uint64_t> errors_intervals(intervals.size());
+	for (size_t i = 0; i < m.phases.size(); i++) {
+		const size_t interval = (m.timestamps_ns[i] - origin_ns) /
+					(interval_ms * 1000000);
+		phases_total += m.phases[i];
+		phases_intervals[interval] += m.phases[i];
+		errors_intervals[interval] += m.error_counts[i];
+	}
+	const double cpu = cpu_utilisation(m.cpu_samples.front(),
+					   m.cpu_samples.back());
 
 	/* Sort the collected data. */
 	std::sort(latencies_ns.begin(), latencies_ns.end());
 
-	/* Calculate the overall time. */
-	const double overall_ns = std::accumulate(latencies_ns.begin(),
-						  latencies_ns.end(), 0ULL);
-
 	/* Calculate statistics. */
 	using namespace Statistics;
-	const double rps = (double)request_count / (overall_ns / 1000000000.0);
 	const double avg_us = average(latencies_ns) / 1000.0;
 	const double med_us = median(latencies_ns) / 1000.0;
 	const double min_us = (double)latencies_ns[0] / 1000.0;
@@ -145,8 +1102,21 @@ start(int argc, char **argv)
 
 	/* Print it out. */
 	printf("Request: %s\n", request_name);
+	if (endpoint.is_unix())
+		printf("Socket: %s\n", endpoint.host.c_str());
+	else
+		printf("Port: %u\n", endpoint.port);
 	printf("Batch size: %lu\n", request_count_per_transfer);
+	printf("Workers: %lu\n", worker_count);
+	for (size_t i = 0; i < worker_count && (cpu_lists || numa_local); i++) {
+		printf("Worker %lu: CPU %d, node %d\n", i, workers[i]->cpu,
+		       workers[i]->node);
+	}
 	printf("RPS: %.0f\n", rps);
+	Report::print_errors(m.errors, "Errors", "Error", request_count);
+	printf("Request size (bytes): %.0f\n",
+	       (double)m.request_bytes / request_count);
+	printf("Request throughput (MB/s): %.1f\n", request_mbps);
 	printf("Avg (μs): %.3f\n", avg_us / request_count_per_transfer);
 	printf("Med (μs): %.3f\n", med_us / request_count_per_transfer);
 	printf("Min (μs): %.3f\n", min_us / request_count_per_transfer);
@@ -154,6 +1124,13 @@ start(int argc, char **argv)
 	printf("90%% (μs): %.3f\n", p90_us / request_count_per_transfer);
 	printf("99%% (μs): %.3f\n", p99_us / request_count_per_transfer);
 	printf("99.9%% (μs): %.3f\n", p999_us / request_count_per_transfer);
+	for (int i = 0; i < Phases::COUNT; i++) {
+		printf("Phase %s (μs): %.3f\n", Phases::names[i],
+		       phases_total.ns[i] / 1000.0 / request_count);
+	}
+	printf("Client CPU (%%): %.1f\n", cpu * 100.0);
+	printf("Timer: %s, overhead (ns): %.1f\n", Timer::source(),
+	       Timer::overhead_ns());
 
 	/* Output the raw data. */
 	if (data) {
@@ -163,6 +1140,153 @@ start(int argc, char **argv)
 		fclose(out);
 	}
 
+	/* Output the results file. */
+	if (results) {
+		FILE *out = fopen(results, "w");
+		Json::Writer json(out);
+		json.begin_object();
+		json.key("request");
+		json.value(request_name);
+		json.key("batch");
+		json.value(uint64_t(request_count_per_transfer));
+		json.key("topology");
+		json.begin_object();
+		{
+			json.key("numa_local");
+			json.value(numa_local);
+			json.key("busy_poll_us");
+			json.value(int64_t(busy_poll_us));
+			json.key("workers");
+			json.begin_array();
+			for (const auto &w: workers) {
+				json.begin_object();
+				json.key("cpus");
+				json.value(w->cpus);
+				json.key("cpu");
+				json.value(int64_t(w->cpu));
+				json.key("node");
+				json.value(int64_t(w->node));
+				json.end_object();
+			}
+			json.end_array();
+		}
+		json.end_object();
+		json.key("timer");
+		json.begin_object();
+		{
+			json.key("source");
+			json.value(Timer::source());
+			json.key("tsc_ghz");
+			json.value(Timer::tsc_ghz());
+			json.key("overhead_ns");
+			json.value(Timer::overhead_ns());
+		}
+		json.end_object();
+		json.key("summary");
+		json.begin_object();
+		{
+			json.key("rps");
+			json.value(rps);
+			json.key("errors");
+			json.value(m.errors.count);
+			json.key("errors_by_code");
+			json.begin_array();
+			for (const auto &[code, c]: m.errors.codes) {
+				json.begin_object();
+				json.key("code");
+				json.value(uint64_t(code));
+				json.key("count");
+				json.value(c.count);
+				json.key("samples");
+				json.begin_array();
+				for (const auto &message: c.samples)
+					json.value(message);
+				json.end_array();
+				json.end_object();
+			}
+			json.end_array();
+			json.key("request_bytes");
+			json.value(m.request_bytes);
+			json.key("request_mbps");
+			json.value(request_mbps);
+			json.key("avg_us");
+			json.value(avg_us / request_count_per_transfer);
+			json.key("med_us");
+			json.value(med_us / request_count_per_transfer);
+			json.key("min_us");
+			json.value(min_us / request_count_per_transfer);
+			json.key("max_us");
+			json.value(max_us / request_count_per_transfer);
+			json.key("p90_us");
+			json.value(p90_us / request_count_per_transfer);
+			json.key("p99_us");
+			json.value(p99_us / request_count_per_transfer);
+			json.key("p999_us");
+			json.value(p999_us / request_count_per_transfer);
+			json.key("phases_us");
+			write_phases(json, phases_total, request_count);
+			json.key("client_cpu");
+			json.value(cpu);
+		}
+		json.end_object();
+
+		/* The client-side interval series. */
+		json.key("interval_s");
+		json.value(interval_ms / 1000.0);
+		json.key("intervals");
+		json.begin_array();
+		for (size_t i = 0; i < intervals.size(); i++) {
+			const auto &latencies = intervals[i];
+			const double batch = request_count_per_transfer;
+			json.begin_object();
+			json.key("t");
+			json.value(double(i * interval_ms) / 1000.0);
+			json.key("requests");
+			json.value(uint64_t(latencies.size() *
+					    request_count_per_transfer));
+			json.key("rps");
+			json.value(latencies.size() * batch * 1000.0 / interval_ms);
+			json.key("errors");
+			json.value(errors_intervals[i]);
+			if (!latencies.empty()) {
+				json.key("avg_us");
+				json.value(average(latencies) / 1000.0 / batch);
+				json.key("med_us");
+				json.value(median(latencies) / 1000.0 / batch);
+				json.key("p99_us");
+				json.value(percentile(latencies, 0.99) / 1000.0 / batch);
+				json.key("max_us");
+				json.value(latencies.back() / 1000.0 / batch);
+				json.key("phases_us");
+				write_phases(json, phases_intervals[i],
+					     latencies.size() * batch);
+			}
+			json.key("client_cpu");
+			json.value(interval_cpu_utilisation(
+				m.cpu_samples, origin_ns + i * interval_ms * 1000000,
+				origin_ns + (i + 1) * interval_ms * 1000000));
+			json.end_object();
+		}
+		json.end_array();
+
+		/* The server-side samples on the same time scale. */
+		json.key("server");
+		json.begin_array();
+		for (size_t i = 0; sampler && i < sampler->samples().size(); i++) {
+			const auto &sample = sampler->samples()[i];
+			const char *data = (const char *)sample.data.data();
+			json.begin_object();
+			json.key("t");
+			json.value(double(sample.time_ns - origin_ns) / 1e9);
+			json.key("metrics");
+			json.msgpack(&data);
+			json.end_object();
+		}
+		json.end_array();
+		json.end_object();
+		fclose(out);
+	}
+
 	/* Output the cumulative distribution function. */
 	if (cdf) {
 		FILE *out = fopen(cdf, "w");
@@ -0,0 +1,169 @@
+/*
+ * A microbenchmark of the tuple encoding: tuples of unsigned integers
+ * are encoded value by value (as the generic tuple generator does) and
+ * column by column with the scalar and the AVX2 columnar encoders.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "msgpuck/msgpuck.h"
+#include "Columnar.hpp"
+#include "Rng.hpp"
+
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The values of the fields, column by column. */
+struct Batch {
+	size_t tuple_count;
+	size_t field_count;
+	std::vector<uint64_t> values;
+
+	uint64_t
+	value(size_t tuple, size_t field) const
+	{
+		return values[field * tuple_count + tuple];
+	}
+};
+
+/* Values of up to @a max_bits bits with all the encoded sizes mixed. */
+static Batch
+make_batch(size_t tuple_count, size_t field_count, unsigned max_bits)
+{
+	Batch batch = {tuple_count, field_count, {}};
+	batch.values.resize(tuple_count * field_count);
+	for (auto &value: batch.values) {
+		const unsigned bits = 1 + Rng::u32() % max_bits;
+		const uint64_t random = (uint64_t)Rng::u32() << 32 | Rng::u32();
+		value = bits == 64 ? random : random & ((1ULL << bits) - 1);
+	}
+	return batch;
+}
+
+/* Size the whole output first, then encode value by value. */
+static size_t
+encode_values(const Batch &batch, std::vector<char> &output)
+{
+	size_t size = 0;
+	for (size_t t = 0; t < batch.tuple_count; t++) {
+		size += mp_sizeof_array(batch.field_count);
+		for (size_t f = 0; f < batch.field_count; f++)
+			size += mp_sizeof_uint(batch.value(t, f));
+	}
+	output.resize(size);
+	char *data = output.data();
+	for (size_t t = 0; t < batch.tuple_count; t++) {
+		data = mp_encode_array(data, batch.field_count);
+		for (size_t f = 0; f < batch.field_count; f++)
+			data = mp_encode_uint(data, batch.value(t, f));
+	}
+	return data - output.data();
+}
+
+/* Encode the columns, then write the tuples row by row. */
+static size_t
+encode_columns(const Batch &batch, std::vector<Columnar::UintColumn> &columns,
+	       bool vector, std::vector<char> &output)
+{
+	columns.resize(batch.field_count);
+	size_t size = batch.tuple_count * mp_sizeof_array(batch.field_count);
+	for (size_t f = 0; f < batch.field_count; f++) {
+		columns[f].encode(&batch.values[f * batch.tuple_count],
+				  batch.tuple_count, vector);
+		for (size_t t = 0; t < batch.tuple_count; t++)
+			size += columns[f].size(t);
+	}
+	output.resize(size + Columnar::SLACK);
+	char *data = output.data();
+	for (size_t t = 0; t < batch.tuple_count; t++) {
+		data = mp_encode_array(data, batch.field_count);
+		for (const auto &column: columns)
+			data = column.write(data, t);
+	}
+	return data - output.data();
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t tuple_count = 10000;
+	size_t field_count = 8;
+	size_t round_count = 200;
+	for (int opt; (opt = getopt(argc, argv, "n:f:r:")) != -1; ) {
+		switch (opt) {
+		case 'n':
+			tuple_count = atol(optarg);
+			break;
+		case 'f':
+			field_count = atol(optarg);
+			break;
+		case 'r':
+			round_count = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: `%s [-n <tuple_count>] "
+				"[-f <field_count>] [-r <round_count>]'\n",
+				argv[0]);
+			return -1;
+		}
+	}
+	if (tuple_count == 0 || field_count == 0 || round_count == 0) {
+		fprintf(stderr, "The counts must be positive.\n");
+		return -1;
+	}
+
+	const bool avx2 = Columnar::has_avx2();
+	printf("Tuples: %lu, fields: %lu, rounds: %lu, AVX2: %s\n",
+	       tuple_count, field_count, round_count, avx2 ? "yes" : "no");
+	printf("%8s %12s %12s %12s\n", "bits", "value ns", "scalar ns",
+	       "avx2 ns");
+
+	std::vector<char> expected, output;
+	std::vector<Columnar::UintColumn> columns;
+	for (unsigned max_bits: {7, 16, 32, 64}) {
+		const Batch batch = make_batch(tuple_count, field_count, max_bits);
+
+		/* The columnar encodings must match the reference one. */
+		const size_t size = encode_values(batch, expected);
+		for (bool vector: {false, avx2}) {
+			if (encode_columns(batch, columns, vector, output) != size ||
+			    memcmp(output.data(), expected.data(), size) != 0) {
+				fprintf(stderr, "The %s encoding differs.\n",
+					vector ? "AVX2" : "scalar");
+				return -1;
+			}
+		}
+
+		double ns[3] = {0, 0, 0};
+		for (int encoder = 0; encoder < 3; encoder++) {
+			if (encoder == 2 && !avx2)
+				break;
+			const uint64_t start_ns = now_ns();
+			for (size_t r = 0; r < round_count; r++) {
+				if (encoder == 0)
+					encode_values(batch, output);
+				else
+					encode_columns(batch, columns, encoder == 2,
+						       output);
+			}
+			ns[encoder] = double(now_ns() - start_ns) /
+				      round_count / batch.values.size();
+		}
+		printf("%8u %12.3f %12.3f %12.3f\n", max_bits, ns[0], ns[1],
+		       ns[2]);
+	}
+	return 0;
+}